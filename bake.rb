@@ -28,3 +28,16 @@ def clean
 	end
 end
 
+# Run the allocation overhead benchmarks and print a JSON report.
+#
+# @parameter scale [Float] Multiply the number of allocations in each workload.
+# @parameter repeat [Integer] Run each case this many times, keeping the fastest.
+# @parameter output [String | Nil] Write the report to this path, instead of standard output.
+def benchmark(scale: 1.0, repeat: 3, output: nil)
+	build
+	
+	arguments = ["--scale", scale.to_s, "--repeat", repeat.to_s]
+	arguments.push("--output", output) if output
+	
+	system(RbConfig.ruby, File.expand_path("benchmark/capture.rb", __dir__), *arguments) or raise "benchmark failed"
+end
@@ -0,0 +1,273 @@
+#!/usr/bin/env ruby
+# frozen_string_literal: true
+
+# Released under the MIT License.
+# Copyright, 2025, by Samuel Williams.
+
+# Allocation overhead benchmark across capture modes.
+#
+# Usage: ruby benchmark/capture.rb [--scale 1.0] [--repeat 3] [--output report.json]
+#
+# Runs each workload under each capture mode in a forked process, so every case starts from the same heap, and prints a JSON report. For each case, it reports the time per allocation (the fastest of the repetitions), the overhead compared with the same workload without a capture, the peak event queue and object table sizes, and the number and duration of garbage collections.
+
+require_relative "../config/environment"
+require_relative "../lib/memory/profiler"
+
+require "json"
+require "optparse"
+
+# Allocation workloads. Each allocates `count` objects and returns the ones it retains, so they stay alive until the measurement is complete.
+module Workloads
+	Workload = Struct.new(:name, :classes, :block) do
+		def call(count)
+			block.call(count)
+		end
+	end
+	
+	TYPES = [Object, String, Array, Hash]
+	
+	def self.allocate(type, index)
+		if type == String
+			"x" * (index % 64)
+		elsif type == Array
+			Array.new(4, index)
+		elsif type == Hash
+			{index => index}
+		else
+			type.new
+		end
+	end
+	
+	# Allocate a mix of types, keeping one object in every `ratio`.
+	def self.churn(ratio)
+		Workload.new("churn_#{ratio}", TYPES, proc do |count|
+			retained = []
+			
+			count.times do |index|
+				object = allocate(TYPES[index % TYPES.size], index)
+				retained << object if index % ratio == 0
+			end
+			
+			retained
+		end)
+	end
+	
+	# Allocate a single type, keeping one object in ten.
+	def self.type(type)
+		Workload.new("type_#{type.name.downcase}", [type], proc do |count|
+			retained = []
+			
+			count.times do |index|
+				object = allocate(type, index)
+				retained << object if index % 10 == 0
+			end
+			
+			retained
+		end)
+	end
+	
+	# Allocate objects of many classes in turn, keeping one object in ten.
+	def self.classes(cardinality)
+		classes = cardinality.times.map{Class.new}
+		
+		Workload.new("classes_#{cardinality}", classes, proc do |count|
+			retained = []
+			
+			count.times do |index|
+				object = classes[index % cardinality].new
+				retained << object if index % 10 == 0
+			end
+			
+			retained
+		end)
+	end
+	
+	# Churn while a large number of objects allocated earlier stay alive, so the object table is large.
+	def self.retained_heap
+		churn = self.churn(10)
+		
+		Workload.new("retained_heap", TYPES, proc do |count|
+			heap = count.times.map{|index| allocate(TYPES[index % TYPES.size], index)}
+			
+			[heap, churn.call(count)]
+		end)
+	end
+	
+	# Churn, compacting the heap four times along the way.
+	def self.compact
+		churn = self.churn(10)
+		
+		Workload.new("compact", TYPES, proc do |count|
+			4.times.map do
+				retained = churn.call(count / 4)
+				GC.compact
+				retained
+			end
+		end)
+	end
+	
+	def self.all
+		workloads = [churn(1), churn(10), churn(100)]
+		workloads.concat(TYPES.map{|type| type(type)})
+		workloads << classes(100) << classes(10_000)
+		workloads << retained_heap
+		workloads << compact if GC.respond_to?(:compact)
+		
+		workloads
+	end
+end
+
+# Ways of running a capture during a workload. Each returns the capture to start, or nil.
+MODES = {
+	"none" => proc{|workload| nil},
+	"track" => proc do |workload|
+		Memory::Profiler::Capture.new.tap do |capture|
+			workload.classes.each{|klass| capture.track(klass)}
+		end
+	end,
+	"track_all" => proc do |workload|
+		Memory::Profiler::Capture.new.tap do |capture|
+			capture.track_all = true
+		end
+	end,
+	"sites" => proc do |workload|
+		Memory::Profiler::Capture.new.tap do |capture|
+			workload.classes.each{|klass| capture.track(klass)}
+			capture.track_sites = true
+		end
+	end,
+	"methods" => proc do |workload|
+		Memory::Profiler::Capture.new.tap do |capture|
+			workload.classes.each{|klass| capture.track(klass)}
+			capture.track_methods = true
+		end
+	end,
+	# Allocations outside of any measure block, i.e. the cost of a scoped capture for unmeasured work:
+	"scoped" => proc do |workload|
+		Memory::Profiler::Capture.new.tap do |capture|
+			workload.classes.each{|klass| capture.track(klass)}
+			capture.scoped = true
+		end
+	end,
+	"tags" => proc do |workload|
+		Memory::Profiler::Capture.new.tap do |capture|
+			workload.classes.each{|klass| capture.track(klass)}
+			capture.track_tags = true
+		end
+	end,
+	"callback" => proc do |workload|
+		Memory::Profiler::Capture.new.tap do |capture|
+			workload.classes.each do |klass|
+				capture.track(klass){|klass, event, state| event == :newobj ? true : nil}
+			end
+		end
+	end,
+	"sampled" => proc do |workload|
+		Memory::Profiler::Capture.new.tap do |capture|
+			capture.track_all = true
+			capture.sampling_interval = 16
+		end
+	end,
+}
+
+def clock
+	Process.clock_gettime(Process::CLOCK_MONOTONIC)
+end
+
+def measure(workload, mode, count)
+	capture = MODES.fetch(mode).call(workload)
+	GC.start
+	
+	gc_count = GC.count
+	gc_time = GC.stat(:time) if GC.stat.key?(:time)
+	
+	started_at = clock
+	capture&.start
+	retained = workload.call(count)
+	
+	# Stopping processes any events still waiting in the queue, which is part of the cost:
+	capture&.stop
+	elapsed = clock - started_at
+	
+	result = {
+		ns_per_allocation: elapsed * 1e9 / count,
+		gc_count: GC.count - gc_count,
+		gc_time_ms: gc_time && GC.stat(:time) - gc_time,
+	}
+	
+	if capture
+		statistics = capture.statistics
+		result[:queue_peak] = statistics[:event_queue][:peak_count]
+		result[:table_peak] = statistics[:object_table][:peak_count]
+	end
+	
+	retained = nil
+	
+	result
+end
+
+# Run the block in a child process, so each case starts from the same heap, and the event queue's peak is its own.
+def isolate(&block)
+	return block.call unless Process.respond_to?(:fork)
+	
+	reader, writer = IO.pipe
+	
+	pid = fork do
+		reader.close
+		writer.write(JSON.dump(block.call))
+		writer.close
+		exit!(0)
+	end
+	
+	writer.close
+	result = JSON.parse(reader.read, symbolize_names: true)
+	reader.close
+	Process.wait(pid)
+	
+	result
+end
+
+options = {scale: 1.0, repeat: 3, output: nil}
+
+OptionParser.new do |parser|
+	parser.banner = "Usage: #{$0} [options]"
+	parser.on("--scale FACTOR", Float, "Multiply the number of allocations in each workload (default: 1.0).") {|value| options[:scale] = value}
+	parser.on("--repeat COUNT", Integer, "Run each case this many times, keeping the fastest (default: 3).") {|value| options[:repeat] = value}
+	parser.on("--output PATH", "Write the report to this path, instead of standard output.") {|value| options[:output] = value}
+end.parse!
+
+count = (100_000 * options[:scale]).to_i
+results = []
+
+Workloads.all.each do |workload|
+	baseline = nil
+	
+	MODES.each_key do |mode|
+		runs = options[:repeat].times.map{isolate{measure(workload, mode, count)}}
+		result = runs.min_by{|run| run[:ns_per_allocation]}
+		
+		baseline ||= result[:ns_per_allocation]
+		
+		results << {
+			workload: workload.name,
+			mode: mode,
+			allocations: count,
+			**result,
+			overhead_ns_per_allocation: result[:ns_per_allocation] - baseline,
+		}
+		
+		$stderr.puts "#{workload.name} #{mode}: #{result[:ns_per_allocation].round(1)}ns/allocation"
+	end
+end
+
+report = JSON.pretty_generate(
+	ruby: RUBY_DESCRIPTION,
+	version: Memory::Profiler::VERSION,
+	results: results,
+)
+
+if options[:output]
+	File.write(options[:output], report)
+else
+	puts report
+end
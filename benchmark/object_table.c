@@ -0,0 +1,637 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+// Object table microbenchmark and differential test harness.
+// Built against the stub <ruby.h> in object_table/, so it runs without libruby. Replays either a list of heap addresses (one hexadecimal address per line) through standard scenarios, or a recorded operation trace, and reports the time per operation and the probe lengths.
+// With --verify, every operation is checked against a simple chained hash map, and the table is checked in full (count, entries, class lists) after each phase. Mismatches are reported and make the harness fail.
+// Built and run by object_table.rb, which extracts the addresses from a heap dump.
+
+#include "../ext/memory/profiler/table.c"
+
+#include <stdio.h>
+
+enum {
+	// Spread the addresses over a few class ids, so the per-class lists are exercised too:
+	CLASSES = 16,
+	
+	// Compaction moves objects to addresses above this, which are never used by the heap:
+	MOVED_BASE = 0x7f0000000000,
+	MOVED_STRIDE = 40,
+	
+	// Report at most this many mismatches:
+	MAXIMUM_REPORTS = 20,
+};
+
+static inline uint32_t class_of(size_t i) {
+	return (uint32_t)(i % CLASSES) + 1;
+}
+
+// Some classes have callback data, which must follow the entry through deletes, reinserts and compaction:
+static inline VALUE data_for(VALUE object, uint32_t klass) {
+	return (klass % 4 == 0) ? (object | 1) : Qnil;
+}
+
+static double now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static uint64_t random_state = 0x2545F4914F6CDD1DULL;
+
+static inline uint64_t next_random(void) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return random_state;
+}
+
+// Reference map: separate chaining with a different hash, so it shares no logic with the table under test.
+struct Reference_Node {
+	VALUE object;
+	uint32_t klass;
+	VALUE data;
+	struct Reference_Node *next;
+};
+
+struct Reference {
+	size_t capacity;
+	size_t count;
+	struct Reference_Node **buckets;
+};
+
+static void reference_initialize(struct Reference *reference) {
+	reference->capacity = 1024;
+	reference->count = 0;
+	reference->buckets = calloc(reference->capacity, sizeof(struct Reference_Node *));
+}
+
+static void reference_free(struct Reference *reference) {
+	for (size_t i = 0; i < reference->capacity; i++) {
+		struct Reference_Node *node = reference->buckets[i];
+		while (node) {
+			struct Reference_Node *next = node->next;
+			free(node);
+			node = next;
+		}
+	}
+	
+	free(reference->buckets);
+	reference->buckets = NULL;
+	reference->capacity = reference->count = 0;
+}
+
+static inline size_t reference_bucket(const struct Reference *reference, VALUE object) {
+	// splitmix64 finalizer:
+	uint64_t hash = object;
+	hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+	hash ^= hash >> 31;
+	
+	return (size_t)(hash & (reference->capacity - 1));
+}
+
+static struct Reference_Node* reference_find(const struct Reference *reference, VALUE object) {
+	for (struct Reference_Node *node = reference->buckets[reference_bucket(reference, object)]; node; node = node->next) {
+		if (node->object == object) return node;
+	}
+	
+	return NULL;
+}
+
+static void reference_grow(struct Reference *reference) {
+	struct Reference old = *reference;
+	
+	reference->capacity *= 2;
+	reference->buckets = calloc(reference->capacity, sizeof(struct Reference_Node *));
+	
+	for (size_t i = 0; i < old.capacity; i++) {
+		struct Reference_Node *node = old.buckets[i];
+		while (node) {
+			struct Reference_Node *next = node->next;
+			size_t bucket = reference_bucket(reference, node->object);
+			node->next = reference->buckets[bucket];
+			reference->buckets[bucket] = node;
+			node = next;
+		}
+	}
+	
+	free(old.buckets);
+}
+
+static void reference_set(struct Reference *reference, VALUE object, uint32_t klass, VALUE data) {
+	struct Reference_Node *node = reference_find(reference, object);
+	
+	if (!node) {
+		if (reference->count >= reference->capacity) reference_grow(reference);
+		
+		node = malloc(sizeof(struct Reference_Node));
+		node->object = object;
+		
+		size_t bucket = reference_bucket(reference, object);
+		node->next = reference->buckets[bucket];
+		reference->buckets[bucket] = node;
+		reference->count++;
+	}
+	
+	node->klass = klass;
+	node->data = data;
+}
+
+static int reference_remove(struct Reference *reference, VALUE object) {
+	struct Reference_Node **link = &reference->buckets[reference_bucket(reference, object)];
+	
+	for (; *link; link = &(*link)->next) {
+		if ((*link)->object == object) {
+			struct Reference_Node *node = *link;
+			*link = node->next;
+			free(node);
+			reference->count--;
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+// State shared by the operations of a scenario.
+struct Harness {
+	struct Memory_Profiler_Object_Table *table;
+	
+	// What the table should contain (only maintained when verifying):
+	struct Reference reference;
+	int verify;
+	
+	// Pending compaction: where each object moves to, as the data of its node:
+	struct Reference moves;
+	size_t moved;
+	
+	size_t operations;
+	size_t checks;
+	size_t mismatches;
+};
+
+// The harness is the garbage collector: compaction moves objects according to the pending moves.
+static struct Harness *current;
+
+void rb_gc_mark_movable(VALUE object) {
+}
+
+VALUE rb_gc_location(VALUE object) {
+	if (current && current->moves.count) {
+		struct Reference_Node *node = reference_find(&current->moves, object);
+		if (node) return node->data;
+	}
+	
+	return object;
+}
+
+static void mismatch(struct Harness *harness, const char *message, VALUE object) {
+	if (harness->mismatches++ < MAXIMUM_REPORTS) {
+		fprintf(stderr, "Mismatch after %zu operations: %s (object 0x%llx)\n", harness->operations, message, (unsigned long long)object);
+	}
+}
+
+static void harness_initialize(struct Harness *harness, int verify) {
+	memset(harness, 0, sizeof(*harness));
+	
+	harness->table = Memory_Profiler_Object_Table_new(1024);
+	harness->verify = verify;
+	reference_initialize(&harness->reference);
+	reference_initialize(&harness->moves);
+	
+	current = harness;
+}
+
+static void harness_free(struct Harness *harness) {
+	Memory_Profiler_Object_Table_free(harness->table);
+	reference_free(&harness->reference);
+	reference_free(&harness->moves);
+	
+	current = NULL;
+}
+
+static void check_entry(struct Harness *harness, struct Memory_Profiler_Object_Table_Entry *entry, VALUE object) {
+	struct Reference_Node *node = reference_find(&harness->reference, object);
+	harness->checks++;
+	
+	if (!entry && !node) return;
+	
+	if (!entry) {
+		mismatch(harness, "present in the reference, but not found", object);
+	} else if (!node) {
+		mismatch(harness, "found, but not present in the reference", object);
+	} else if (entry->object != object) {
+		mismatch(harness, "found the wrong entry", object);
+	} else if (entry->klass != node->klass) {
+		mismatch(harness, "wrong class", object);
+	} else if (Memory_Profiler_Object_Table_data(harness->table, entry) != node->data) {
+		mismatch(harness, "wrong data", object);
+	}
+}
+
+static void operation_insert(struct Harness *harness, VALUE object, uint32_t klass) {
+	harness->operations++;
+	
+	struct Memory_Profiler_Object_Table_Entry *entry = Memory_Profiler_Object_Table_insert(harness->table, object, klass);
+	if (!entry) return;
+	
+	VALUE data = data_for(object, klass);
+	if (!NIL_P(data)) {
+		Memory_Profiler_Object_Table_set_data(harness->table, entry, data);
+	}
+	
+	if (harness->verify) {
+		reference_set(&harness->reference, object, klass, data);
+		check_entry(harness, entry, object);
+	}
+}
+
+static int operation_lookup(struct Harness *harness, VALUE object) {
+	harness->operations++;
+	
+	struct Memory_Profiler_Object_Table_Entry *entry = Memory_Profiler_Object_Table_lookup(harness->table, object);
+	
+	if (harness->verify) {
+		check_entry(harness, entry, object);
+	}
+	
+	return entry != NULL;
+}
+
+static void operation_delete(struct Harness *harness, VALUE object) {
+	harness->operations++;
+	
+	Memory_Profiler_Object_Table_delete(harness->table, object);
+	
+	if (harness->verify) {
+		reference_remove(&harness->reference, object);
+		
+		if (Memory_Profiler_Object_Table_lookup(harness->table, object)) {
+			mismatch(harness, "still found after delete", object);
+		}
+	}
+}
+
+// Schedule an object to move at the next compaction. The destination must not be in use.
+static void operation_move(struct Harness *harness, VALUE from, VALUE to) {
+	reference_set(&harness->moves, from, 0, to);
+}
+
+static void count_moved(VALUE from, VALUE to, void *argument) {
+	struct Harness *harness = argument;
+	harness->moved++;
+}
+
+static void operation_compact(struct Harness *harness) {
+	harness->operations++;
+	harness->moved = 0;
+	
+	Memory_Profiler_Object_Table_compact(harness->table, count_moved, harness);
+	
+	if (harness->verify) {
+		size_t expected = 0;
+		
+		for (size_t i = 0; i < harness->moves.capacity; i++) {
+			for (struct Reference_Node *move = harness->moves.buckets[i]; move; move = move->next) {
+				struct Reference_Node *node = reference_find(&harness->reference, move->object);
+				if (!node) continue;
+				
+				uint32_t klass = node->klass;
+				VALUE data = node->data;
+				reference_remove(&harness->reference, move->object);
+				reference_set(&harness->reference, move->data, klass, data);
+				expected++;
+			}
+		}
+		
+		if (harness->moved != expected) {
+			mismatch(harness, "wrong number of entries relocated by compaction", 0);
+		}
+	}
+	
+	reference_free(&harness->moves);
+	reference_initialize(&harness->moves);
+}
+
+// Check the whole table against the reference: the count, every entry, and the class lists.
+static void verify_all(struct Harness *harness) {
+	if (!harness->verify) return;
+	
+	struct Memory_Profiler_Object_Table *table = harness->table;
+	
+	if (Memory_Profiler_Object_Table_size(table) != harness->reference.count) {
+		mismatch(harness, "table size differs from the reference", 0);
+	}
+	
+	for (size_t i = 0; i < harness->reference.capacity; i++) {
+		for (struct Reference_Node *node = harness->reference.buckets[i]; node; node = node->next) {
+			check_entry(harness, Memory_Profiler_Object_Table_lookup(table, node->object), node->object);
+		}
+	}
+	
+	// Every entry is on exactly its class's list:
+	size_t linked = 0;
+	for (uint32_t klass = 1; klass <= CLASSES; klass++) {
+		for (struct Memory_Profiler_Object_Table_Entry *entry = Memory_Profiler_Object_Table_first(table, klass); entry; entry = Memory_Profiler_Object_Table_next(table, entry)) {
+			if (entry->klass != klass) {
+				mismatch(harness, "entry on the wrong class list", entry->object);
+			}
+			
+			if (++linked > table->count) {
+				mismatch(harness, "class lists are longer than the table", entry->object);
+				return;
+			}
+		}
+	}
+	
+	if (linked != table->count) {
+		mismatch(harness, "class lists are missing entries", 0);
+	}
+}
+
+static void report(const char *name, double duration, struct Harness *harness) {
+	struct Memory_Profiler_Object_Table *table = harness->table;
+	const struct Memory_Profiler_Object_Table_Statistics *statistics = Memory_Profiler_Object_Table_statistics(table);
+	
+	printf("%-12s %10zu operations %8.2f ns/operation\n", name, harness->operations, duration * 1e9 / harness->operations);
+	printf("  Capacity: %zu, count: %zu, tombstones: %zu, resizes: %zu, compactions: %zu, relocations: %zu\n",
+		table->capacity, table->count, table->tombstones, statistics->resizes, statistics->compactions, statistics->relocations
+	);
+	printf("  Maximum probe: %zu, long probes: %zu, aborted probes: %zu\n", statistics->maximum_probe, statistics->long_probes, statistics->aborted_probes);
+	printf("  Probes:");
+	for (size_t i = 0; i < MEMORY_PROFILER_OBJECT_TABLE_PROBE_BUCKETS; i++) {
+		if (statistics->probes[i]) printf(" %zu:%zu", (size_t)1 << i, statistics->probes[i]);
+	}
+	printf("\n");
+}
+
+// Insert every address, look each one up, then delete them all.
+static void scenario_fill(struct Harness *harness, VALUE *addresses, size_t count, size_t rounds) {
+	for (size_t round = 0; round < rounds; round++) {
+		for (size_t i = 0; i < count; i++) {
+			operation_insert(harness, addresses[i], class_of(i));
+		}
+		
+		for (size_t i = 0; i < count; i++) {
+			operation_lookup(harness, addresses[i]);
+		}
+		
+		verify_all(harness);
+		
+		for (size_t i = 0; i < count; i++) {
+			operation_delete(harness, addresses[i]);
+		}
+		
+		verify_all(harness);
+	}
+}
+
+// Random inserts (45%), lookups (35%) and deletes (20%) over the addresses, including reinserting addresses that are already present, as happens when a free is missed.
+static void scenario_mix(struct Harness *harness, VALUE *addresses, size_t count, size_t rounds) {
+	size_t operations = count * rounds * 2;
+	
+	for (size_t i = 0; i < operations; i++) {
+		uint64_t random = next_random();
+		size_t index = (random >> 8) % count;
+		unsigned choice = random % 100;
+		
+		if (choice < 45) {
+			operation_insert(harness, addresses[index], class_of(index + (random >> 40)));
+		} else if (choice < 80) {
+			operation_lookup(harness, addresses[index]);
+		} else {
+			operation_delete(harness, addresses[index]);
+		}
+	}
+	
+	verify_all(harness);
+}
+
+// Keep a quarter of the addresses live, and repeatedly insert and delete batches of the rest, so tombstones pile up between resizes.
+static void scenario_tombstones(struct Harness *harness, VALUE *addresses, size_t count, size_t rounds) {
+	size_t live = count / 4;
+	size_t batch = 1024;
+	
+	for (size_t i = 0; i < live; i++) {
+		operation_insert(harness, addresses[i], class_of(i));
+	}
+	
+	for (size_t round = 0; round < rounds; round++) {
+		for (size_t start = live; start < count; start += batch) {
+			size_t finish = start + batch < count ? start + batch : count;
+			
+			for (size_t i = start; i < finish; i++) {
+				operation_insert(harness, addresses[i], class_of(i));
+			}
+			
+			for (size_t i = start; i < finish; i++) {
+				operation_delete(harness, addresses[i]);
+			}
+		}
+		
+		for (size_t i = 0; i < live; i++) {
+			operation_lookup(harness, addresses[i]);
+		}
+		
+		verify_all(harness);
+	}
+}
+
+// Insert every address, then repeatedly move a quarter of the live objects to fresh addresses and compact, looking up every object after each compaction.
+static void scenario_compaction(struct Harness *harness, VALUE *addresses, size_t count, size_t rounds) {
+	VALUE *live = malloc(count * sizeof(VALUE));
+	VALUE fresh = MOVED_BASE;
+	
+	for (size_t i = 0; i < count; i++) {
+		live[i] = addresses[i];
+		operation_insert(harness, live[i], class_of(i));
+	}
+	
+	for (size_t round = 0; round < rounds; round++) {
+		for (size_t i = 0; i < count; i++) {
+			if (next_random() % 4 == 0) {
+				operation_move(harness, live[i], fresh);
+				live[i] = fresh;
+				fresh += MOVED_STRIDE;
+			}
+		}
+		
+		operation_compact(harness);
+		
+		for (size_t i = 0; i < count; i++) {
+			if (!operation_lookup(harness, live[i])) {
+				mismatch(harness, "lost by compaction", live[i]);
+			}
+		}
+		
+		verify_all(harness);
+	}
+	
+	free(live);
+}
+
+// Replay a recorded trace. Each line is an operation:
+//   + <address> <class>   insert
+//   ? <address>           lookup
+//   - <address>           delete
+//   > <from> <to>         move an object at the next compaction
+//   c                     compact
+// Addresses are hexadecimal, classes are decimal (at most MEMORY_PROFILER_CLASSES_MAXIMUM_ID).
+static int replay(struct Harness *harness, const char *path) {
+	FILE *file = fopen(path, "r");
+	if (!file) return 0;
+	
+	char line[256];
+	size_t number = 0;
+	
+	while (fgets(line, sizeof(line), file)) {
+		unsigned long long object, to;
+		unsigned klass;
+		number++;
+		
+		switch (line[0]) {
+			case '+':
+				if (sscanf(line + 1, "%llx %u", &object, &klass) != 2) goto invalid;
+				operation_insert(harness, (VALUE)object, klass);
+				break;
+			case '?':
+				if (sscanf(line + 1, "%llx", &object) != 1) goto invalid;
+				operation_lookup(harness, (VALUE)object);
+				break;
+			case '-':
+				if (sscanf(line + 1, "%llx", &object) != 1) goto invalid;
+				operation_delete(harness, (VALUE)object);
+				break;
+			case '>':
+				if (sscanf(line + 1, "%llx %llx", &object, &to) != 2) goto invalid;
+				operation_move(harness, (VALUE)object, (VALUE)to);
+				break;
+			case 'c':
+				operation_compact(harness);
+				verify_all(harness);
+				break;
+			case '#': case '\n':
+				break;
+			default:
+			invalid:
+				fprintf(stderr, "%s:%zu: invalid operation: %s", path, number, line);
+				fclose(file);
+				return 0;
+		}
+	}
+	
+	fclose(file);
+	
+	verify_all(harness);
+	
+	return 1;
+}
+
+static VALUE* read_addresses(const char *path, size_t *count) {
+	FILE *file = fopen(path, "r");
+	if (!file) return NULL;
+	
+	size_t capacity = 1024;
+	VALUE *addresses = malloc(capacity * sizeof(VALUE));
+	*count = 0;
+	
+	unsigned long long address;
+	while (fscanf(file, "%llx", &address) == 1) {
+		if (*count == capacity) {
+			capacity *= 2;
+			addresses = realloc(addresses, capacity * sizeof(VALUE));
+		}
+		
+		addresses[(*count)++] = (VALUE)address;
+	}
+	
+	fclose(file);
+	
+	return addresses;
+}
+
+typedef void (*Scenario)(struct Harness *harness, VALUE *addresses, size_t count, size_t rounds);
+
+static size_t run(const char *name, Scenario scenario, VALUE *addresses, size_t count, size_t rounds, int verify) {
+	struct Harness harness;
+	harness_initialize(&harness, verify);
+	
+	double start = now();
+	scenario(&harness, addresses, count, rounds);
+	report(name, now() - start, &harness);
+	
+	size_t mismatches = harness.mismatches;
+	if (verify) printf("  Checked: %zu, mismatches: %zu\n", harness.checks, mismatches);
+	
+	harness_free(&harness);
+	
+	return mismatches;
+}
+
+static void usage(const char *program) {
+	fprintf(stderr, "Usage: %s [--verify] [--rounds N] addresses.txt\n", program);
+	fprintf(stderr, "       %s [--verify] --trace operations.txt\n", program);
+}
+
+int main(int argc, char **argv) {
+	int verify = 0;
+	size_t rounds = 10;
+	const char *trace = NULL;
+	const char *path = NULL;
+	
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--verify") == 0) {
+			verify = 1;
+		} else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+			rounds = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			trace = argv[++i];
+		} else if (argv[i][0] != '-' && !path) {
+			path = argv[i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	
+	size_t mismatches = 0;
+	
+	if (trace) {
+		struct Harness harness;
+		harness_initialize(&harness, verify);
+		
+		double start = now();
+		if (!replay(&harness, trace)) {
+			fprintf(stderr, "Could not replay %s!\n", trace);
+			return 1;
+		}
+		report("trace", now() - start, &harness);
+		
+		mismatches = harness.mismatches;
+		if (verify) printf("  Checked: %zu, mismatches: %zu\n", harness.checks, mismatches);
+		
+		harness_free(&harness);
+	} else if (path) {
+		size_t count;
+		VALUE *addresses = read_addresses(path, &count);
+		if (!addresses || count == 0) {
+			fprintf(stderr, "Could not read addresses from %s!\n", path);
+			return 1;
+		}
+		
+		printf("Addresses: %zu, rounds: %zu%s\n", count, rounds, verify ? " (verifying, timings include checks)" : "");
+		
+		mismatches += run("fill", scenario_fill, addresses, count, rounds, verify);
+		mismatches += run("mix", scenario_mix, addresses, count, rounds, verify);
+		mismatches += run("tombstones", scenario_tombstones, addresses, count, rounds, verify);
+		mismatches += run("compaction", scenario_compaction, addresses, count, rounds, verify);
+		
+		free(addresses);
+	} else {
+		usage(argv[0]);
+		return 1;
+	}
+	
+	return mismatches ? 1 : 0;
+}
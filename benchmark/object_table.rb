@@ -0,0 +1,82 @@
+#!/usr/bin/env ruby
+# frozen_string_literal: true
+
+# Released under the MIT License.
+# Copyright, 2025, by Samuel Williams.
+
+# Object table microbenchmark on real heap addresses.
+#
+# Usage: ruby benchmark/object_table.rb [--verify] [--rounds N] [heap.json]
+#        ruby benchmark/object_table.rb [--verify] --trace operations.txt
+#
+# The addresses come from a heap dump, e.g. one taken from an application with `ObjectSpace.dump_all(output: File.open("heap.json", "w"))`. Without a dump, a synthetic workload mixing object types and sizes is dumped instead. The addresses are replayed through insert/lookup/delete mixes, tombstone storms and compaction by `object_table.c`, which is built against a stub `ruby.h`, without libruby. With `--verify`, every result is checked against a reference map. A recorded trace of operations can be replayed instead, see `object_table.c` for the format.
+
+require "rbconfig"
+require "objspace"
+require "optparse"
+require "tmpdir"
+
+def workload
+	retained = []
+	
+	500_000.times do |i|
+		case i % 4
+		when 0 then object = "string #{i}" * (i % 5)
+		when 1 then object = {index: i}
+		when 2 then object = Array.new(i % 10, i)
+		when 3 then object = Object.new
+		end
+		
+		# Keep one object in eight, so live objects are spread across pages:
+		retained << object if i % 8 == 0
+	end
+	
+	GC.start
+	
+	retained
+end
+
+options = []
+trace_path = nil
+
+OptionParser.new do |parser|
+	parser.on("--verify", "Check every operation against a reference map."){options << "--verify"}
+	parser.on("--rounds N", Integer, "Repeat each scenario N times."){|rounds| options.push("--rounds", rounds.to_s)}
+	parser.on("--trace PATH", "Replay a recorded trace of operations, instead of heap addresses."){|path| trace_path = File.expand_path(path)}
+end.parse!
+
+Dir.mktmpdir do |root|
+	config = RbConfig::CONFIG
+	executable = File.join(root, "object_table")
+	
+	system(
+		config["CC"], "-O3", "-Wall", "-o", executable,
+		"-I#{File.expand_path("object_table", __dir__)}",
+		File.expand_path("object_table.c", __dir__),
+		exception: true
+	)
+	
+	if trace_path
+		system(executable, *options, "--trace", trace_path, exception: true)
+		next
+	end
+	
+	heap_path = ARGV.first
+	
+	unless heap_path
+		heap_path = File.join(root, "heap.json")
+		retained = workload
+		File.open(heap_path, "w"){|file| ObjectSpace.dump_all(output: file)}
+	end
+	
+	addresses_path = File.join(root, "addresses.txt")
+	File.open(addresses_path, "w") do |output|
+		File.foreach(heap_path) do |line|
+			if address = line[/"address":"0x(\h+)"/, 1]
+				output.puts(address)
+			end
+		end
+	end
+	
+	system(executable, *options, addresses_path, exception: true)
+end
@@ -0,0 +1,20 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+// Minimal stand-in for <ruby.h>, so the object table can be built and exercised without libruby.
+// Only what table.c uses is provided. The garbage collector functions are implemented by the harness (object_table.c), which decides where objects move during compaction.
+
+#pragma once
+
+#include <stdint.h>
+
+typedef uintptr_t VALUE;
+
+// Special constants are never valid object addresses (objects are at least 8 byte aligned):
+#define Qfalse ((VALUE)0x00)
+#define Qnil ((VALUE)0x04)
+
+#define NIL_P(value) ((VALUE)(value) == Qnil)
+
+void rb_gc_mark_movable(VALUE object);
+VALUE rb_gc_location(VALUE object);
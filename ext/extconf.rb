@@ -16,12 +16,13 @@ if ENV.key?("RUBY_DEBUG")
 	append_cflags(["-DRUBY_DEBUG", "-O0"])
 end
 
-$srcs = ["memory/profiler/profiler.c", "memory/profiler/capture.c", "memory/profiler/allocations.c", "memory/profiler/events.c", "memory/profiler/table.c"]
+$srcs = ["memory/profiler/profiler.c", "memory/profiler/capture.c", "memory/profiler/allocations.c", "memory/profiler/attributions.c", "memory/profiler/classes.c", "memory/profiler/events.c", "memory/profiler/histogram.c", "memory/profiler/methods.c", "memory/profiler/metrics.c", "memory/profiler/pages.c", "memory/profiler/sites.c", "memory/profiler/snapshot.c", "memory/profiler/table.c", "memory/profiler/tags.c", "memory/profiler/trace.c"]
 $VPATH << "$(srcdir)/memory/profiler"
 
 # Check for required headers
 have_header("ruby/debug.h") or abort "ruby/debug.h is required"
 have_func("rb_ext_ractor_safe")
+have_func("rb_obj_memsize_of")
 
 if ENV.key?("RUBY_SANITIZE")
 	$stderr.puts "Enabling sanitizers..."
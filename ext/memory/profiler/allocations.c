@@ -17,12 +17,15 @@ static void Memory_Profiler_Allocations_mark(void *ptr) {
 static void Memory_Profiler_Allocations_free(void *ptr) {
 	struct Memory_Profiler_Capture_Allocations *record = ptr;
 	
-	xfree(record);
+	record->wrapper = 0;
+	Memory_Profiler_Allocations_release(record);
 }
 
 static void Memory_Profiler_Allocations_compact(void *ptr) {
 	struct Memory_Profiler_Capture_Allocations *record = ptr;
 	
+	// The wrapper itself may have moved:
+	record->wrapper = rb_gc_location(record->wrapper);
 	record->callback = rb_gc_location(record->callback);
 }
 
@@ -36,8 +39,37 @@ static const rb_data_type_t Memory_Profiler_Allocations_type = {
 	0, 0, RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED
 };
 
-VALUE Memory_Profiler_Allocations_wrap(struct Memory_Profiler_Capture_Allocations *record) {
-	return TypedData_Wrap_Struct(Memory_Profiler_Allocations, &Memory_Profiler_Allocations_type, record);
+struct Memory_Profiler_Capture_Allocations* Memory_Profiler_Allocations_new(VALUE klass) {
+	struct Memory_Profiler_Capture_Allocations *record = ALLOC(struct Memory_Profiler_Capture_Allocations);
+	record->klass = klass;
+	record->wrapper = 0;
+	record->callback = Qnil;
+	record->id = 0;
+	record->references = 1;
+	record->tracked = 0;
+	record->new_count = 0;
+	record->free_count = 0;
+	record->samples = NULL;
+	record->samples_count = 0;
+	record->samples_capacity = 0;
+	
+	return record;
+}
+
+void Memory_Profiler_Allocations_release(struct Memory_Profiler_Capture_Allocations *record) {
+	if (--record->references == 0) {
+		xfree(record->samples);
+		xfree(record);
+	}
+}
+
+VALUE Memory_Profiler_Allocations_wrapper(struct Memory_Profiler_Capture_Allocations *record) {
+	if (!record->wrapper) {
+		record->wrapper = TypedData_Wrap_Struct(Memory_Profiler_Allocations, &Memory_Profiler_Allocations_type, record);
+		record->references++;
+	}
+	
+	return record->wrapper;
 }
 
 struct Memory_Profiler_Capture_Allocations* Memory_Profiler_Allocations_get(VALUE self) {
@@ -72,25 +104,79 @@ static VALUE Memory_Profiler_Allocations_track(int argc, VALUE *argv, VALUE self
 	VALUE callback;
 	rb_scan_args(argc, argv, "&", &callback);
 	
-	RB_OBJ_WRITE(self, &record->callback, callback);
+	Memory_Profiler_Allocations_set_callback(record, callback);
 	
 	return self;
 }
 
-void Memory_Profiler_Allocations_clear(VALUE allocations) {
-	struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Allocations_get(allocations);
+void Memory_Profiler_Allocations_set_callback(struct Memory_Profiler_Capture_Allocations *record, VALUE callback) {
+	if (NIL_P(callback) && !record->wrapper) return;
+	
+	VALUE wrapper = Memory_Profiler_Allocations_wrapper(record);
+	RB_OBJ_WRITE(wrapper, &record->callback, callback);
+}
+
+void Memory_Profiler_Allocations_clear(struct Memory_Profiler_Capture_Allocations *record) {
 	record->new_count = 0;
 	record->free_count = 0;
-	RB_OBJ_WRITE(allocations, &record->callback, Qnil);
+	record->samples_count = 0;
+	Memory_Profiler_Allocations_set_callback(record, Qnil);
+}
+
+long Memory_Profiler_Allocations_sample_index(struct Memory_Profiler_Capture_Allocations *record, uint64_t random, size_t live) {
+	if (record->samples_count < MEMORY_PROFILER_ALLOCATIONS_SAMPLES) {
+		// Grow the sample on demand, most classes only ever have a few live objects:
+		if (record->samples_count == record->samples_capacity) {
+			uint32_t capacity = record->samples_capacity ? record->samples_capacity * 2 : 4;
+			if (capacity > MEMORY_PROFILER_ALLOCATIONS_SAMPLES) capacity = MEMORY_PROFILER_ALLOCATIONS_SAMPLES;
+			
+			REALLOC_N(record->samples, VALUE, capacity);
+			record->samples_capacity = capacity;
+		}
+		
+		return record->samples_count;
+	}
+	
+	// Keep the new object with probability samples/live, replacing a random sampled object:
+	size_t index = random % (live ? live : 1);
+	
+	return index < record->samples_count ? (long)index : -1;
+}
+
+int Memory_Profiler_Allocations_replace_sample(struct Memory_Profiler_Capture_Allocations *record, VALUE object, VALUE replacement) {
+	for (uint32_t i = 0; i < record->samples_count; i++) {
+		if (record->samples[i] == object) {
+			if (replacement) {
+				record->samples[i] = replacement;
+			} else {
+				record->samples[i] = record->samples[--record->samples_count];
+			}
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+void Memory_Profiler_Allocations_compact_samples(struct Memory_Profiler_Capture_Allocations *record, Memory_Profiler_Allocations_live_callback live, void *argument) {
+	for (uint32_t i = 0; i < record->samples_count;) {
+		if (live(record, record->samples[i], argument)) {
+			record->samples[i] = rb_gc_location(record->samples[i]);
+			i++;
+		} else {
+			record->samples[i] = record->samples[--record->samples_count];
+		}
+	}
 }
 
 static VALUE Memory_Profiler_Allocations_allocate(VALUE klass) {
-	struct Memory_Profiler_Capture_Allocations *record = ALLOC(struct Memory_Profiler_Capture_Allocations);
-	record->callback = Qnil;
-	record->new_count = 0;
-	record->free_count = 0;
+	struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Allocations_new(0);
+	VALUE wrapper = Memory_Profiler_Allocations_wrapper(record);
+	
+	// The wrapper is the only owner:
+	Memory_Profiler_Allocations_release(record);
 	
-	return Memory_Profiler_Allocations_wrap(record);
+	return wrapper;
 }
 
 void Init_Memory_Profiler_Allocations(VALUE Memory_Profiler)
@@ -6,26 +6,75 @@
 #include <ruby.h>
 #include <ruby/st.h>
 
-// Per-class allocation tracking record:
+enum {
+	// Maximum number of live objects sampled per class:
+	MEMORY_PROFILER_ALLOCATIONS_SAMPLES = 128,
+};
+
+// Per-class allocation tracking record.
+// Owned by a capture's class registry, and shared with its Ruby wrapper once one is created. The record is freed when the last of them releases it.
 struct Memory_Profiler_Capture_Allocations {
-	// Optional Ruby proc/lambda to call on allocation.
+	// The class being tracked (pinned by the capture, 0 for standalone records).
+	VALUE klass;
+	
+	// The Ruby wrapper, created on demand (0 if none).
+	VALUE wrapper;
+	
+	// Optional Ruby proc/lambda to call on allocation. Only set through the wrapper, which marks it.
 	VALUE callback;
+	
+	// Identifier of the class within its capture, used by object table entries (0 = not registered).
+	uint32_t id;
+	
+	// Number of owners (the registry and/or the wrapper).
+	uint32_t references;
+	
+	// Whether the class was tracked explicitly (with Capture#track), rather than automatically. Explicitly tracked classes are never evicted.
+	int tracked;
 
 	// Total allocations seen since tracking started.
 	size_t new_count;
 	// // Total frees seen since tracking started.
 	size_t free_count;
 	// Live count = new_count - free_count.
+	
+	// A uniform random sample of the live objects of the class (reservoir sampling), updated as objects are allocated and freed, so that some retained instances can be found without scanning the object table.
+	// The references are weak: the owner must remove freed objects and update the sample after compaction.
+	VALUE *samples;
+	uint32_t samples_count;
+	uint32_t samples_capacity;
 };
 
-// Wrap an allocations record in a VALUE.
-VALUE Memory_Profiler_Allocations_wrap(struct Memory_Profiler_Capture_Allocations *record);
+// Allocate a record for a class, with a single reference held by the caller.
+struct Memory_Profiler_Capture_Allocations* Memory_Profiler_Allocations_new(VALUE klass);
+
+// Release a reference to a record, freeing it once nothing refers to it.
+void Memory_Profiler_Allocations_release(struct Memory_Profiler_Capture_Allocations *record);
+
+// Get the Ruby wrapper for a record, creating it if needed. The caller is responsible for the write barrier of the object holding the record.
+VALUE Memory_Profiler_Allocations_wrapper(struct Memory_Profiler_Capture_Allocations *record);
 
 // Get allocations record from wrapper VALUE.
 struct Memory_Profiler_Capture_Allocations* Memory_Profiler_Allocations_get(VALUE self);
 
-// Clear/reset allocation counts for a record.
-void Memory_Profiler_Allocations_clear(VALUE allocations);
+// Set the callback for a record (creates the wrapper, which marks the callback).
+void Memory_Profiler_Allocations_set_callback(struct Memory_Profiler_Capture_Allocations *record, VALUE callback);
+
+// Clear/reset allocation counts and callback for a record.
+void Memory_Profiler_Allocations_clear(struct Memory_Profiler_Capture_Allocations *record);
+
+// Choose where to store a newly allocated object in the sample, given a uniformly distributed random number and the number of recorded live objects of the class, including the new one. The counts are weighted by sampling, so they can't be used here.
+// Returns the index to store the object at (if it is samples_count, the sample grows by one; otherwise, the object replaces an existing one), or -1 if the object is not sampled. May allocate.
+long Memory_Profiler_Allocations_sample_index(struct Memory_Profiler_Capture_Allocations *record, uint64_t random, size_t live);
+
+// Replace a sampled object with another live object of the class, or remove it if the replacement is 0. Returns non-zero if the object was sampled. Does not allocate.
+int Memory_Profiler_Allocations_replace_sample(struct Memory_Profiler_Capture_Allocations *record, VALUE object, VALUE replacement);
+
+// Called during compaction for each sampled object, which may already be freed: returns non-zero if it is still alive. Must not dereference the object.
+typedef int (*Memory_Profiler_Allocations_live_callback)(struct Memory_Profiler_Capture_Allocations *record, VALUE object, void *argument);
+
+// Update the sampled objects after compaction, removing the ones that are not alive. Freed objects may be in released heap pages, so they are never relocated. Does not allocate.
+void Memory_Profiler_Allocations_compact_samples(struct Memory_Profiler_Capture_Allocations *record, Memory_Profiler_Allocations_live_callback live, void *argument);
 
 // Initialize the Allocations class.
 void Init_Memory_Profiler_Allocations(VALUE Memory_Profiler);
@@ -0,0 +1,125 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "attributions.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const size_t INITIAL_CAPACITY = 64;
+
+void Memory_Profiler_Attributions_initialize(struct Memory_Profiler_Attributions *attributions) {
+	attributions->attributions = NULL;
+	attributions->count = 0;
+	attributions->capacity = 0;
+	attributions->index = NULL;
+	attributions->index_capacity = 0;
+	attributions->last = (struct Memory_Profiler_Attribution){0};
+	attributions->last_id = MEMORY_PROFILER_ATTRIBUTIONS_NONE;
+}
+
+void Memory_Profiler_Attributions_free(struct Memory_Profiler_Attributions *attributions) {
+	free(attributions->attributions);
+	free(attributions->index);
+	
+	Memory_Profiler_Attributions_initialize(attributions);
+}
+
+static inline int equal(struct Memory_Profiler_Attribution a, struct Memory_Profiler_Attribution b) {
+	return a.site == b.site && a.method == b.method && a.tag == b.tag;
+}
+
+static inline size_t hash_of(struct Memory_Profiler_Attribution attribution, size_t mask) {
+	uint64_t hash = ((((uint64_t)attribution.site << 32) | attribution.method) ^ ((uint64_t)attribution.tag * 0xC2B2AE3D27D4EB4FULL)) * 0x9E3779B97F4A7C15ULL;
+	
+	return (size_t)(hash >> __builtin_clzll(mask)) & mask;
+}
+
+// Find the index slot of an attribution: either the slot holding it, or the empty slot where it would go.
+static size_t find_slot(struct Memory_Profiler_Attributions *attributions, uint32_t *index, size_t capacity, struct Memory_Profiler_Attribution attribution) {
+	size_t mask = capacity - 1;
+	size_t i = hash_of(attribution, mask);
+	
+	while (index[i] && !equal(attributions->attributions[index[i]], attribution)) {
+		i = (i + 1) & mask;
+	}
+	
+	return i;
+}
+
+// Grow the index, keeping the load factor at or below 1/2.
+static int resize_index(struct Memory_Profiler_Attributions *attributions) {
+	size_t capacity = attributions->index_capacity ? attributions->index_capacity * 2 : INITIAL_CAPACITY;
+	uint32_t *index = calloc(capacity, sizeof(uint32_t));
+	if (!index) return 0;
+	
+	for (size_t i = 0; i < attributions->index_capacity; i++) {
+		uint32_t id = attributions->index[i];
+		
+		if (id) {
+			index[find_slot(attributions, index, capacity, attributions->attributions[id])] = id;
+		}
+	}
+	
+	free(attributions->index);
+	attributions->index = index;
+	attributions->index_capacity = capacity;
+	
+	return 1;
+}
+
+// Grow the attributions array, returns zero if out of memory.
+static int grow(struct Memory_Profiler_Attributions *attributions) {
+	size_t capacity = attributions->capacity ? attributions->capacity * 2 : INITIAL_CAPACITY;
+	struct Memory_Profiler_Attribution *array = realloc(attributions->attributions, capacity * sizeof(struct Memory_Profiler_Attribution));
+	if (!array) return 0;
+	
+	attributions->attributions = array;
+	attributions->capacity = capacity;
+	
+	return 1;
+}
+
+uint32_t Memory_Profiler_Attributions_intern(struct Memory_Profiler_Attributions *attributions, struct Memory_Profiler_Attribution attribution) {
+	if (equal(attribution, (struct Memory_Profiler_Attribution){0})) return MEMORY_PROFILER_ATTRIBUTIONS_NONE;
+	
+	if (attributions->last_id && equal(attribution, attributions->last)) return attributions->last_id;
+	
+	uint32_t id = MEMORY_PROFILER_ATTRIBUTIONS_NONE;
+	
+	if (attributions->index_capacity) {
+		id = attributions->index[find_slot(attributions, attributions->index, attributions->index_capacity, attribution)];
+	}
+	
+	if (!id) {
+		if (attributions->count == 0) {
+			if (!grow(attributions)) return MEMORY_PROFILER_ATTRIBUTIONS_NONE;
+			
+			attributions->attributions[MEMORY_PROFILER_ATTRIBUTIONS_NONE] = (struct Memory_Profiler_Attribution){0};
+			attributions->count = 1;
+		}
+		
+		if (attributions->count > MEMORY_PROFILER_ATTRIBUTIONS_MAXIMUM_ID) return MEMORY_PROFILER_ATTRIBUTIONS_NONE;
+		
+		if (attributions->count == attributions->capacity && !grow(attributions)) {
+			return MEMORY_PROFILER_ATTRIBUTIONS_NONE;
+		}
+		
+		if ((attributions->count + 1) * 2 > attributions->index_capacity && !resize_index(attributions)) {
+			return MEMORY_PROFILER_ATTRIBUTIONS_NONE;
+		}
+		
+		id = (uint32_t)attributions->count++;
+		attributions->attributions[id] = attribution;
+		attributions->index[find_slot(attributions, attributions->index, attributions->index_capacity, attribution)] = id;
+	}
+	
+	attributions->last = attribution;
+	attributions->last_id = id;
+	
+	return id;
+}
+
+size_t Memory_Profiler_Attributions_memsize(const struct Memory_Profiler_Attributions *attributions) {
+	return attributions->capacity * sizeof(struct Memory_Profiler_Attribution) + attributions->index_capacity * sizeof(uint32_t);
+}
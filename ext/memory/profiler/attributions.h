@@ -0,0 +1,56 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+	// Entries of objects allocated while nothing was attributed:
+	MEMORY_PROFILER_ATTRIBUTIONS_NONE = 0,
+	
+	// Events store attribution ids in 27 bits:
+	MEMORY_PROFILER_ATTRIBUTIONS_MAXIMUM_ID = (1 << 27) - 1,
+};
+
+// What an allocation is attributed to: its site, its method and the tag of its fiber (ids in the capture's registries, 0 = none).
+struct Memory_Profiler_Attribution {
+	uint32_t site;
+	uint32_t method;
+	uint32_t tag;
+};
+
+// Registry of attributions for a capture.
+// Events and object table entries have room for a single id, so each distinct combination of site, method and tag is interned as one attribution id. Interned from the event hook, so it uses system malloc. Ids are never reused.
+struct Memory_Profiler_Attributions {
+	// Attributions by id (id 0 is reserved):
+	struct Memory_Profiler_Attribution *attributions;
+	size_t count;
+	size_t capacity;
+	
+	// Attribution => id index (capacity is a power of two, or zero if not allocated, 0 = empty):
+	uint32_t *index;
+	size_t index_capacity;
+	
+	// The attribution interned last, as consecutive allocations usually come from the same place:
+	struct Memory_Profiler_Attribution last;
+	uint32_t last_id;
+};
+
+// Initialize an empty registry (no allocation).
+void Memory_Profiler_Attributions_initialize(struct Memory_Profiler_Attributions *attributions);
+
+// Free the registry, leaving it empty.
+void Memory_Profiler_Attributions_free(struct Memory_Profiler_Attributions *attributions);
+
+// Find or create the id of an attribution. Returns MEMORY_PROFILER_ATTRIBUTIONS_NONE if nothing is attributed, or if the attribution can't be created.
+uint32_t Memory_Profiler_Attributions_intern(struct Memory_Profiler_Attributions *attributions, struct Memory_Profiler_Attribution attribution);
+
+// Get an attribution by id, or NULL if there is none.
+static inline struct Memory_Profiler_Attribution* Memory_Profiler_Attributions_get(struct Memory_Profiler_Attributions *attributions, uint32_t id) {
+	return id != MEMORY_PROFILER_ATTRIBUTIONS_NONE && id < attributions->count ? &attributions->attributions[id] : NULL;
+}
+
+// Memory used by the registry.
+size_t Memory_Profiler_Attributions_memsize(const struct Memory_Profiler_Attributions *attributions);
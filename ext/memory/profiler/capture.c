@@ -3,17 +3,29 @@
 
 #include "capture.h"
 #include "allocations.h"
+#include "attributions.h"
+#include "classes.h"
 #include "events.h"
+#include "methods.h"
+#include "metrics.h"
+#include "pages.h"
+#include "sites.h"
+#include "snapshot.h"
 #include "table.h"
+#include "tags.h"
+#include "trace.h"
 
 #include <ruby/debug.h>
+#include <ruby/io.h>
 #include <ruby/st.h>
 #include <stdatomic.h>
 #include <stdio.h>
+#include <time.h>
+#include <unistd.h>
 
 enum {
 	DEBUG = 0,
-
+	
 	// This generates a lot of output:
 	DEBUG_EVENT = 0,
 };
@@ -23,65 +35,302 @@ static VALUE Memory_Profiler_Capture = Qnil;
 // Event symbols:
 static VALUE sym_newobj, sym_freeobj;
 
+// The fiber-local variable holding the tag of the current fiber's allocations:
+static ID id_memory_profiler_tag;
+
+// The fiber-local variable holding the captures measuring the current fiber (a frozen Array, see Capture#measure):
+static ID id_memory_profiler_scopes;
+
+#ifdef HAVE_RB_OBJ_MEMSIZE_OF
+// Exported by Ruby, but not declared in its public headers (the objspace extension declares it the same way):
+size_t rb_obj_memsize_of(VALUE object);
+#endif
+
+enum {
+	// Number of objects each_object pins at a time:
+	MEMORY_PROFILER_CAPTURE_SNAPSHOT_BATCH = 256,
+};
+
+// Addresses copied from the object table by each_object, so the block can run while GC keeps running.
+struct Memory_Profiler_Capture_Snapshot {
+	// The addresses are weak: they are checked against the object table before use, and updated when compaction moves their objects (0 = no longer tracked).
+	VALUE *objects;
+	size_t count;
+	
+	// Index of the next address to check:
+	size_t position;
+	
+	// The objects currently being yielded, pinned by the capture's mark function:
+	VALUE batch[MEMORY_PROFILER_CAPTURE_SNAPSHOT_BATCH];
+	size_t batch_count;
+	
+	// The snapshot of the enclosing iteration, if each_object is nested:
+	struct Memory_Profiler_Capture_Snapshot *next;
+};
+
+// Sampled timing of the capture's own work, enabled with timing_interval.
+struct Memory_Profiler_Capture_Timing {
+	// Time one in every interval hook invocations and processed events (0 = disabled):
+	size_t interval;
+	
+	// Invocations left until the next timed one:
+	size_t hook_countdown;
+	size_t event_countdown;
+	
+	// Whether the event being processed is timed, so its object table operations are timed too:
+	int event;
+	
+	// Nanoseconds per hook invocation, per NEWOBJ and FREEOBJ event processed, and per object table operation:
+	struct Memory_Profiler_Histogram hook;
+	struct Memory_Profiler_Histogram newobj;
+	struct Memory_Profiler_Histogram freeobj;
+	struct Memory_Profiler_Histogram table;
+};
+
+enum {
+	// Allocations are recorded one in every 2^shift, and object table entries store the shift in 4 bits:
+	MEMORY_PROFILER_CAPTURE_MAXIMUM_SHIFT = 15,
+	
+	// Timing interval used by the governor if timing is not already enabled:
+	MEMORY_PROFILER_CAPTURE_GOVERNOR_TIMING_INTERVAL = 64,
+};
+
+// Nanoseconds between adjustments of the sampling interval by the governor:
+static const uint64_t MEMORY_PROFILER_CAPTURE_GOVERNOR_WINDOW = 100 * 1000 * 1000;
+
+// Keeps the measured cost of the capture within a budget by adjusting the allocation sampling interval.
+struct Memory_Profiler_Capture_Governor {
+	// Target overhead, as a fraction of the process's CPU time (0 = not governed):
+	double budget;
+	
+	// Overhead measured over the last window:
+	double overhead;
+	
+	// Number of times the sampling interval was changed:
+	size_t adjustments;
+	
+	// The sampling interval set by the user (as a shift), restored when the budget is removed:
+	unsigned int sampling_shift;
+	
+	// Whether the governor enabled timing itself, so it disables it when the budget is removed:
+	int timing;
+	
+	// Start of the current window (0 = not started) in monotonic and process CPU time, and the timing totals at that point:
+	uint64_t started_at;
+	uint64_t cpu_started_at;
+	uint64_t hook_total;
+	uint64_t event_total;
+};
+
 // Main capture state (per-instance).
 struct Memory_Profiler_Capture {
 	// Master switch - is tracking active? (set by start/stop).
 	int running;
 	
+	// Is the FREEOBJ hook of a stopped capture installed? (see Memory_Profiler_Capture_watch_frees).
+	int watching;
+	
 	// Should we queue callbacks? (temporarily disabled during queue processing).
 	int paused;
-
+	
+	// Should we only record allocations made inside measure blocks? (checked in the hook, against the current fiber).
+	int scoped;
+	
 	// Should we automatically track all classes? (if false, only explicitly tracked classes are tracked).
 	int track_all;
-
-	// Tracked classes: class => VALUE (wrapped Memory_Profiler_Capture_Allocations).
-	st_table *tracked;
+	
+	// Should we record the source line of each allocation? (the nearest Ruby frame's path and line, read in the hook).
+	int track_sites;
+	
+	// Should we record the method of each allocation? (the method of the nearest frame, read in the hook).
+	int track_methods;
+	
+	// Should we record the tag of the current fiber for each allocation? (see Capture.tag=).
+	int track_tags;
+	
+	// Allocation sites, methods and tags with their counters:
+	struct Memory_Profiler_Sites sites;
+	struct Memory_Profiler_Methods methods;
+	struct Memory_Profiler_Tags tags;
+	
+	// The site, method and tag of allocations, interned together as a single id (used by events and object table entries).
+	struct Memory_Profiler_Attributions attributions;
+	
+	// Tracked classes: class => allocations record (with a dense id, used by object table entries).
+	struct Memory_Profiler_Classes tracked;
+	
+	// Maximum number of classes to track (0 = unlimited). When exceeded, the least retained automatically tracked classes are merged into a single "other" record.
+	size_t maximum_classes;
+	
+	// Number of classes merged into the "other" record so far.
+	size_t evicted_count;
 	
 	// Custom object table: object (address) => state hash
 	// Uses system malloc (GC-safe), updates addresses during compaction
 	struct Memory_Profiler_Object_Table *states;
-
+	
+	// Addresses of objects whose NEWOBJ event was enqueued and whose FREEOBJ has not been seen yet.
+	// Lets the FREEOBJ hook skip objects we never recorded, without probing the object table.
+	struct Memory_Profiler_Object_Pages pages;
+	
 	// Total number of allocations and frees seen since tracking started.
 	size_t new_count;
 	size_t free_count;
+	
+	// State of the random number generator used for sampling objects.
+	uint64_t random;
+	
+	// Snapshots of the each_object iterations in progress (innermost first).
+	struct Memory_Profiler_Capture_Snapshot *snapshots;
+	
+	// Timing of the capture's own work (NULL until timing is first enabled).
+	struct Memory_Profiler_Capture_Timing *timing;
+	
+	// Allocations of tracked classes are recorded one in every 2^sampling_shift, and counted with a weight of 2^sampling_shift:
+	unsigned int sampling_shift;
+	
+	struct Memory_Profiler_Capture_Governor governor;
+	
+	// The event trace being recorded (NULL if none), and the IO it's written to:
+	struct Memory_Profiler_Trace *trace;
+	VALUE trace_io;
 };
 
-// GC mark callback for tracked table.
-static int Memory_Profiler_Capture_tracked_mark(st_data_t key, st_data_t value, st_data_t arg) {
-	// Mark class as un-movable:
-	// - We don't want to re-index the table if the class moves.
-	// - We don't want objects in `freeobj` to have invalid class pointers (maybe helps).
-	VALUE klass = (VALUE)key;
-	rb_gc_mark(klass);
+static void Memory_Profiler_Capture_mark(void *ptr) {
+	struct Memory_Profiler_Capture *capture = ptr;
+	
+	Memory_Profiler_Classes_mark(&capture->tracked);
+	Memory_Profiler_Methods_mark(&capture->methods);
+	Memory_Profiler_Tags_mark(&capture->tags);
 	
-	// Mark the wrapped Allocations VALUE:
-	VALUE allocations = (VALUE)value;
-	rb_gc_mark_movable(allocations);
+	Memory_Profiler_Object_Table_mark(capture->states);
+	
+	for (struct Memory_Profiler_Capture_Snapshot *snapshot = capture->snapshots; snapshot; snapshot = snapshot->next) {
+		for (size_t i = 0; i < snapshot->batch_count; i++) {
+			rb_gc_mark(snapshot->batch[i]);
+		}
+	}
 	
-	return ST_CONTINUE;
+	// The IO being traced to, as returned by trace:
+	rb_gc_mark(capture->trace_io);
 }
 
-static void Memory_Profiler_Capture_mark(void *ptr) {
-	struct Memory_Profiler_Capture *capture = ptr;
+// Table entries of objects whose FREEOBJ is still pending are keyed by their address with the low bit set (see Memory_Profiler_Capture_detach_pending_free). Heap addresses are aligned, so it never clashes with a live object.
+static inline int Memory_Profiler_Capture_detached_p(VALUE object) {
+	return (object & 1) != 0;
+}
+
+// Cheap pseudo-random numbers for sampling (xorshift64).
+static inline uint64_t Memory_Profiler_Capture_random(struct Memory_Profiler_Capture *capture) {
+	uint64_t x = capture->random;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	
+	return capture->random = x;
+}
+
+// Replace a sampled object that is being freed with a random live object of its class, so the sample stays uniform.
+// Otherwise, the sample would only be refilled by new allocations, and could be left nearly empty when most sampled objects are freed, even though many live objects remain.
+static void Memory_Profiler_Capture_replace_sample(struct Memory_Profiler_Capture *capture, struct Memory_Profiler_Capture_Allocations *record, struct Memory_Profiler_Object_Table_Entry *entry, VALUE object) {
+	struct Memory_Profiler_Object_Table_Entry *replacement = NULL;
+	size_t count = Memory_Profiler_Object_Table_class_count(capture->states, entry->klass);
+	
+	if (count > 1) {
+		size_t start = Memory_Profiler_Capture_random(capture) % count;
+		
+		// If the chosen entry is already sampled, take the next one that isn't, wrapping around at the end of the list. There are at most samples_count of them, which bounds the walk:
+		for (size_t i = 0; i <= record->samples_count && i < count; i++) {
+			struct Memory_Profiler_Object_Table_Entry *candidate = Memory_Profiler_Object_Table_class_entry(capture->states, entry->klass, (start + i) % count);
+			
+			if (candidate != entry && !candidate->sampled && !Memory_Profiler_Capture_detached_p(candidate->object)) {
+				replacement = candidate;
+				break;
+			}
+		}
+	}
 	
-	if (capture->tracked) {
-		st_foreach(capture->tracked, Memory_Profiler_Capture_tracked_mark, 0);
+	if (Memory_Profiler_Allocations_replace_sample(record, object, replacement ? replacement->object : 0) && replacement) {
+		replacement->sampled = 1;
 	}
+}
+
+// Forget a recorded object that was freed while the capture is stopped: delete its entry and replace it in its class's sample, so the object table and samples only refer to live objects. As with the allocations, frees are not counted and callbacks are not called while stopped. Runs during GC, so it must not allocate.
+static void Memory_Profiler_Capture_forget(struct Memory_Profiler_Capture *capture, VALUE object) {
+	if (!Memory_Profiler_Object_Pages_remove(&capture->pages, object)) return;
 	
-	Memory_Profiler_Object_Table_mark(capture->states);
+	struct Memory_Profiler_Object_Table_Entry *entry = Memory_Profiler_Object_Table_lookup(capture->states, object);
+	if (!entry) return;
+	
+	if (entry->sampled) {
+		struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Classes_get(&capture->tracked, entry->klass);
+		if (record) Memory_Profiler_Capture_replace_sample(capture, record, entry, object);
+	}
+	
+	Memory_Profiler_Object_Table_delete_entry(capture->states, entry);
+}
+
+// FREEOBJ hook of a stopped capture, see Memory_Profiler_Capture_watch_frees.
+static void Memory_Profiler_Capture_freeobj_callback(VALUE data, void *ptr) {
+	rb_trace_arg_t *trace_arg = (rb_trace_arg_t *)ptr;
+	struct Memory_Profiler_Capture *capture = (struct Memory_Profiler_Capture *)(data & ~(VALUE)RUBY_FIXNUM_FLAG);
+	
+	Memory_Profiler_Capture_forget(capture, rb_tracearg_object(trace_arg));
+}
+
+// The data of the FREEOBJ hook of a stopped capture. Hook data is marked by the VM, which would keep a stopped capture alive for as long as the hook is installed. Instead, the hook is given the capture's address tagged as a Fixnum, which is never marked, and the capture removes the hook when it is freed.
+static inline VALUE Memory_Profiler_Capture_watcher(struct Memory_Profiler_Capture *capture) {
+	return (VALUE)capture | RUBY_FIXNUM_FLAG;
+}
+
+// Keep watching the frees of recorded objects while the capture is stopped, so that each_object, export_objects, sample_objects and top never see freed objects. If the event hook also sees a free, the page bitmap ensures it is only handled once.
+static void Memory_Profiler_Capture_watch_frees(struct Memory_Profiler_Capture *capture) {
+	if (capture->watching) return;
+	
+	rb_add_event_hook2(
+		(rb_event_hook_func_t)Memory_Profiler_Capture_freeobj_callback,
+		RUBY_INTERNAL_EVENT_FREEOBJ,
+		Memory_Profiler_Capture_watcher(capture),
+		RUBY_EVENT_HOOK_FLAG_SAFE | RUBY_EVENT_HOOK_FLAG_RAW_ARG
+	);
+	
+	capture->watching = 1;
+}
+
+static void Memory_Profiler_Capture_unwatch_frees(struct Memory_Profiler_Capture *capture) {
+	if (!capture->watching) return;
+	
+	rb_remove_event_hook_with_data((rb_event_hook_func_t)Memory_Profiler_Capture_freeobj_callback, Memory_Profiler_Capture_watcher(capture));
+	
+	capture->watching = 0;
 }
 
 static void Memory_Profiler_Capture_free(void *ptr) {
 	struct Memory_Profiler_Capture *capture = ptr;
-		
-	if (capture->tracked) {
-		st_free_table(capture->tracked);
-	}
+	
+	// The hook doesn't keep the capture alive, so it must not outlive it:
+	Memory_Profiler_Capture_unwatch_frees(capture);
+	
+	Memory_Profiler_Classes_free(&capture->tracked);
+	Memory_Profiler_Sites_free(&capture->sites);
+	Memory_Profiler_Methods_free(&capture->methods);
+	Memory_Profiler_Tags_free(&capture->tags);
+	Memory_Profiler_Attributions_free(&capture->attributions);
 	
 	if (capture->states) {
 		Memory_Profiler_Object_Table_free(capture->states);
 	}
 	
+	Memory_Profiler_Object_Pages_free(&capture->pages);
+	
+	if (capture->timing) {
+		if (capture->timing->interval) Memory_Profiler_Events_timing(0);
+		xfree(capture->timing);
+	}
+	
+	// This runs during GC sweep, where writing could block for as long as the descriptor does, so what's still buffered is discarded. Stopping the capture, or setting trace to nil, writes it:
+	Memory_Profiler_Trace_free(capture->trace);
+	
 	xfree(capture);
 }
 
@@ -89,43 +338,95 @@ static size_t Memory_Profiler_Capture_memsize(const void *ptr) {
 	const struct Memory_Profiler_Capture *capture = ptr;
 	size_t size = sizeof(struct Memory_Profiler_Capture);
 	
-	if (capture->tracked) {
-		size += capture->tracked->num_entries * (sizeof(st_data_t) + sizeof(struct Memory_Profiler_Capture_Allocations));
-	}
+	size += Memory_Profiler_Classes_memsize(&capture->tracked);
+	size += Memory_Profiler_Sites_memsize(&capture->sites);
+	size += Memory_Profiler_Methods_memsize(&capture->methods);
+	size += Memory_Profiler_Tags_memsize(&capture->tags);
+	size += Memory_Profiler_Attributions_memsize(&capture->attributions);
+	size += Memory_Profiler_Object_Pages_memsize(&capture->pages);
+	
+	if (capture->timing) size += sizeof(struct Memory_Profiler_Capture_Timing);
+	if (capture->trace) size += Memory_Profiler_Trace_memsize(capture->trace);
 	
 	return size;
 }
 
-// Foreach callback for st_foreach_with_replace (iteration logic).
-static int Memory_Profiler_Capture_tracked_foreach(st_data_t key, st_data_t value, st_data_t argp, int error) {
-	return ST_REPLACE;
+// Stop watching for the frees of deleted table entries.
+static void Memory_Profiler_Capture_object_deleted(VALUE object, void *argument) {
+	struct Memory_Profiler_Object_Pages *pages = argument;
+	
+	// The address of a detached entry was removed when its free was enqueued, and may already belong to another object:
+	if (Memory_Profiler_Capture_detached_p(object)) return;
+	
+	Memory_Profiler_Object_Pages_remove(pages, object);
+}
+
+// Move page membership along with relocated table entries, and record the move in the trace.
+static void Memory_Profiler_Capture_object_moved(VALUE from, VALUE to, void *argument) {
+	struct Memory_Profiler_Capture *capture = argument;
+	
+	if (Memory_Profiler_Object_Pages_remove(&capture->pages, from)) {
+		Memory_Profiler_Object_Pages_add(&capture->pages, to);
+	}
+	
+	if (capture->trace) {
+		Memory_Profiler_Trace_moved(capture->trace, Memory_Profiler_Histogram_now(), from, to);
+	}
 }
 
-// Replace callback for st_foreach_with_replace (update logic).
-static int Memory_Profiler_Capture_tracked_update(st_data_t *key, st_data_t *value, st_data_t argp, int existing) {
-	// Update wrapped Allocations VALUE if it moved:
-	VALUE old_allocations = (VALUE)*value;
-	VALUE new_allocations = rb_gc_location(old_allocations);
-	if (old_allocations != new_allocations) {
-		*value = (st_data_t)new_allocations;
+// Compaction can move a live object into the slot of a freed object whose FREEOBJ has not been processed yet. The moved entry would replace the freed one, and the pending free would then delete it. So the freed entry is detached from its address first, and the pending event is updated to match.
+static void Memory_Profiler_Capture_detach_pending_free(struct Memory_Profiler_Event *event, void *argument) {
+	struct Memory_Profiler_Capture *capture = argument;
+	
+	if (event->type != MEMORY_PROFILER_EVENT_TYPE_FREEOBJ) return;
+	if (Memory_Profiler_Capture_detached_p(event->object)) return;
+	if (RTYPEDDATA_DATA(rb_gc_location(event->capture)) != capture) return;
+	
+	struct Memory_Profiler_Object_Table_Entry *entry = Memory_Profiler_Object_Table_lookup(capture->states, event->object);
+	if (!entry) return;
+	
+	// The free must precede the moves in the trace, or replaying it would delete whatever moves into the address:
+	if (capture->trace) {
+		Memory_Profiler_Trace_freeobj(capture->trace, Memory_Profiler_Histogram_now(), event->object, entry->klass);
 	}
 	
-	return ST_CONTINUE;
+	Memory_Profiler_Object_Table_rekey(capture->states, entry, event->object | 1);
+	event->object |= 1;
+}
+
+// Whether a sampled object is still alive during compaction: it is, if it's still in the object table as an object of the class. Entries of objects whose FREEOBJ is pending are detached first, so they don't count.
+static int Memory_Profiler_Capture_sample_live_p(struct Memory_Profiler_Capture_Allocations *record, VALUE object, void *argument) {
+	struct Memory_Profiler_Capture *capture = argument;
+	
+	struct Memory_Profiler_Object_Table_Entry *entry = Memory_Profiler_Object_Table_lookup(capture->states, object);
+	return entry && entry->klass == record->id;
 }
 
 static void Memory_Profiler_Capture_compact(void *ptr) {
 	struct Memory_Profiler_Capture *capture = ptr;
 	
-	// Update tracked keys and allocations values in-place:
-	if (capture->tracked && capture->tracked->num_entries > 0) {
-		if (st_foreach_with_replace(capture->tracked, Memory_Profiler_Capture_tracked_foreach, Memory_Profiler_Capture_tracked_update, 0)) {
-			rb_raise(rb_eRuntimeError, "tracked modified during GC compaction");
+	// Update the addresses that each_object has yet to visit. This must happen before the object table is updated, as addresses no longer in the table may belong to freed heap pages and must not be dereferenced:
+	for (struct Memory_Profiler_Capture_Snapshot *snapshot = capture->snapshots; snapshot; snapshot = snapshot->next) {
+		for (size_t i = snapshot->position; i < snapshot->count; i++) {
+			VALUE object = snapshot->objects[i];
+			if (!object) continue;
+			
+			if (capture->states && Memory_Profiler_Object_Table_lookup(capture->states, object)) {
+				snapshot->objects[i] = rb_gc_location(object);
+			} else {
+				snapshot->objects[i] = 0;
+			}
 		}
 	}
 	
 	// Update custom object table (system malloc, safe during GC)
 	if (capture->states) {
-		Memory_Profiler_Object_Table_compact(capture->states);
+		Memory_Profiler_Events_each_pending(Memory_Profiler_Capture_detach_pending_free, capture);
+		
+		// Tracked classes are pinned, and wrappers update their own location, but sampled objects are weak references. Like the snapshots, they are checked against the object table before it is updated:
+		Memory_Profiler_Classes_compact(&capture->tracked, Memory_Profiler_Capture_sample_live_p, capture);
+		
+		Memory_Profiler_Object_Table_compact(capture->states, Memory_Profiler_Capture_object_moved, capture);
 	}
 }
 
@@ -158,38 +459,227 @@ const char *event_flag_name(rb_event_flag_t event_flag) {
 	}
 }
 
-// Process a NEWOBJ event. All allocation tracking logic is here.
-// object_id parameter is the Integer object_id, NOT the raw object.
+// Register a class, pinning it (the registry marks classes with rb_gc_mark).
+static struct Memory_Profiler_Capture_Allocations* Memory_Profiler_Capture_add_class(VALUE self, struct Memory_Profiler_Capture *capture, VALUE klass) {
+	struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Classes_insert(&capture->tracked, klass);
+	RB_OBJ_WRITTEN(self, Qnil, klass);
+	
+	return record;
+}
+
+// Order records by retained count, then by allocation count (least first).
+static int Memory_Profiler_Capture_compare_retained(const void *a, const void *b) {
+	const struct Memory_Profiler_Capture_Allocations *left = *(const struct Memory_Profiler_Capture_Allocations **)a;
+	const struct Memory_Profiler_Capture_Allocations *right = *(const struct Memory_Profiler_Capture_Allocations **)b;
+	
+	size_t left_retained = left->free_count > left->new_count ? 0 : left->new_count - left->free_count;
+	size_t right_retained = right->free_count > right->new_count ? 0 : right->new_count - right->free_count;
+	
+	if (left_retained != right_retained) return left_retained < right_retained ? -1 : 1;
+	if (left->new_count != right->new_count) return left->new_count < right->new_count ? -1 : 1;
+	return 0;
+}
+
+// Merge the least retained quarter of the automatically tracked classes into the "other" record.
+// Evicting in batches keeps the cost of sorting the classes amortized over many new classes.
+static void Memory_Profiler_Capture_evict_classes(struct Memory_Profiler_Capture *capture) {
+	struct Memory_Profiler_Classes *classes = &capture->tracked;
+	
+	struct Memory_Profiler_Capture_Allocations **candidates = ALLOC_N(struct Memory_Profiler_Capture_Allocations *, classes->count);
+	size_t count = 0;
+	
+	for (size_t id = 1; id < classes->records_count; id++) {
+		struct Memory_Profiler_Capture_Allocations *record = classes->records[id];
+		
+		// Explicitly tracked classes, and classes with a callback, are never evicted:
+		if (record && record->id == id && record->klass && !record->tracked && NIL_P(record->callback)) {
+			candidates[count++] = record;
+		}
+	}
+	
+	if (count > 0) {
+		qsort(candidates, count, sizeof(*candidates), Memory_Profiler_Capture_compare_retained);
+		
+		size_t evict = count / 4 > 0 ? count / 4 : 1;
+		struct Memory_Profiler_Capture_Allocations *other = Memory_Profiler_Classes_other(classes);
+		
+		for (size_t i = 0; i < evict; i++) {
+			// Relabel the entries of the merged class, so its id can be reused. Out of memory, the class is kept for now:
+			if (capture->states && !Memory_Profiler_Object_Table_relabel(capture->states, candidates[i]->id, other->id)) continue;
+			
+			Memory_Profiler_Classes_merge(classes, candidates[i]);
+			capture->evicted_count++;
+		}
+		
+		Memory_Profiler_Classes_reclaim(classes);
+	}
+	
+	xfree(candidates);
+}
+
+// Get the Allocations wrapper for a record, creating it on first use.
+static VALUE Memory_Profiler_Capture_allocations(VALUE self, struct Memory_Profiler_Capture_Allocations *record) {
+	if (record->wrapper) return record->wrapper;
+	
+	VALUE wrapper = Memory_Profiler_Allocations_wrapper(record);
+	RB_OBJ_WRITTEN(self, Qnil, wrapper);
+	
+	return wrapper;
+}
+
+// CPU time used by the process, in nanoseconds.
+static uint64_t Memory_Profiler_Capture_cpu_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+	
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// Start a new governor window on the next timed invocation, e.g. because the timing totals were reset.
+static void Memory_Profiler_Capture_governor_reset(struct Memory_Profiler_Capture *capture) {
+	capture->governor.started_at = 0;
+}
+
+// Adjust the sampling interval once per window, so the estimated cost of the hook and event processing stays within the overhead budget. Called after timed invocations. Does not allocate.
+static void Memory_Profiler_Capture_govern(struct Memory_Profiler_Capture *capture, uint64_t now) {
+	struct Memory_Profiler_Capture_Governor *governor = &capture->governor;
+	struct Memory_Profiler_Capture_Timing *timing = capture->timing;
+	
+	if (governor->budget <= 0 || !timing || !timing->interval) return;
+	if (governor->started_at && now - governor->started_at < MEMORY_PROFILER_CAPTURE_GOVERNOR_WINDOW) return;
+	
+	uint64_t cpu_time = Memory_Profiler_Capture_cpu_time();
+	uint64_t hook_total = timing->hook.total;
+	uint64_t event_total = timing->newobj.total + timing->freeobj.total;
+	
+	if (governor->started_at && cpu_time > governor->cpu_started_at) {
+		// One in every interval invocations is timed, so scale up to estimate the cost of all of them:
+		double cost = (double)((hook_total - governor->hook_total) + (event_total - governor->event_total)) * timing->interval;
+		governor->overhead = cost / (double)(cpu_time - governor->cpu_started_at);
+		
+		if (governor->overhead > governor->budget && capture->sampling_shift < MEMORY_PROFILER_CAPTURE_MAXIMUM_SHIFT) {
+			// Reduce the rate in proportion to the excess:
+			unsigned int step = 1;
+			while (governor->budget * (double)(1 << step) < governor->overhead && capture->sampling_shift + step < MEMORY_PROFILER_CAPTURE_MAXIMUM_SHIFT) step++;
+			
+			capture->sampling_shift += step;
+			governor->adjustments++;
+		} else if (governor->overhead < governor->budget / 4 && capture->sampling_shift > 0) {
+			// Well within the budget, so increase the rate gradually:
+			capture->sampling_shift--;
+			governor->adjustments++;
+		}
+	}
+	
+	governor->started_at = now;
+	governor->cpu_started_at = cpu_time;
+	governor->hook_total = hook_total;
+	governor->event_total = event_total;
+}
+
+// Start timing an object table operation, if the event being processed is timed (returns 0 otherwise).
+static inline uint64_t Memory_Profiler_Capture_table_timing_start(struct Memory_Profiler_Capture *capture) {
+	return capture->timing && capture->timing->event ? Memory_Profiler_Histogram_now() : 0;
+}
+
+static inline void Memory_Profiler_Capture_table_timing_finish(struct Memory_Profiler_Capture *capture, uint64_t started_at) {
+	if (started_at) {
+		Memory_Profiler_Histogram_record(&capture->timing->table, Memory_Profiler_Histogram_elapsed(started_at, Memory_Profiler_Histogram_now()));
+	}
+}
+
+// Record an allocation in the trace, naming its class first if the trace hasn't seen it. Naming allocates, so the capture must be paused.
+static void Memory_Profiler_Capture_trace_newobj(struct Memory_Profiler_Capture *capture, struct Memory_Profiler_Capture_Allocations *record, VALUE object, unsigned int shift, uint32_t site) {
+	struct Memory_Profiler_Trace *trace = capture->trace;
+	VALUE klass = record->klass ? record->klass : Qnil;
+	
+	if (!Memory_Profiler_Trace_class_p(trace, record->id, klass)) {
+		if (NIL_P(klass)) {
+			Memory_Profiler_Trace_class(trace, record->id, klass, "(other)", 7);
+		} else {
+			VALUE name = rb_class_path(klass);
+			Memory_Profiler_Trace_class(trace, record->id, klass, RSTRING_PTR(name), RSTRING_LEN(name));
+			RB_GC_GUARD(name);
+		}
+	}
+	
+	struct Memory_Profiler_Site *site_record = Memory_Profiler_Sites_get(&capture->sites, site);
+	if (site_record && !Memory_Profiler_Trace_site_p(trace, site)) {
+		struct Memory_Profiler_Sites_Path *path = Memory_Profiler_Sites_path(&capture->sites, site_record);
+		
+		if (!path) {
+			Memory_Profiler_Trace_site(trace, site, "", 0, 0);
+		} else {
+			Memory_Profiler_Trace_site(trace, site, path->bytes, path->length, site_record->line);
+		}
+	}
+	
+	size_t size = 0;
+#ifdef HAVE_RB_OBJ_MEMSIZE_OF
+	size = rb_obj_memsize_of(object);
+#endif
+	
+	Memory_Profiler_Trace_newobj(trace, Memory_Profiler_Histogram_now(), object, record->id, size, shift, site_record ? site : 0);
+	Memory_Profiler_Trace_flush_if_full(trace);
+}
+
+// Count allocations and frees against the site, method and tag of an attribution.
+static inline void Memory_Profiler_Capture_attribute(struct Memory_Profiler_Capture *capture, uint32_t id, size_t new_weight, size_t free_weight) {
+	struct Memory_Profiler_Attribution *attribution = Memory_Profiler_Attributions_get(&capture->attributions, id);
+	if (!attribution) return;
+	
+	struct Memory_Profiler_Site *site = Memory_Profiler_Sites_get(&capture->sites, attribution->site);
+	if (site) {
+		site->new_count += new_weight;
+		site->free_count += free_weight;
+	}
+	
+	struct Memory_Profiler_Method *method = Memory_Profiler_Methods_get(&capture->methods, attribution->method);
+	if (method) {
+		method->new_count += new_weight;
+		method->free_count += free_weight;
+	}
+	
+	struct Memory_Profiler_Tag *tag = Memory_Profiler_Tags_get(&capture->tags, attribution->tag);
+	if (tag) {
+		tag->new_count += new_weight;
+		tag->free_count += free_weight;
+	}
+}
+
 // Process a NEWOBJ event. All allocation tracking logic is here.
 // object parameter is the actual object being allocated.
-static void Memory_Profiler_Capture_process_newobj(VALUE self, VALUE klass, VALUE object) {
+// shift parameter: the object stands for 2^shift allocations, if allocations are sampled.
+// attribution parameter: the id of the allocation's site, method and tag, if any of them is tracked.
+static void Memory_Profiler_Capture_process_newobj(VALUE self, VALUE klass, VALUE object, unsigned int shift, uint32_t attribution) {
 	struct Memory_Profiler_Capture *capture;
 	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
 	
+	size_t weight = (size_t)1 << shift;
+	
 	// Pause the capture to prevent infinite loop:
 	capture->paused += 1;
 	
 	// Look up allocations record for this class:
-	st_data_t allocations_data;
-	VALUE allocations;
-	struct Memory_Profiler_Capture_Allocations *record;
+	struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Classes_lookup(&capture->tracked, klass);
 	
-	if (st_lookup(capture->tracked, (st_data_t)klass, &allocations_data)) {
+	if (record) {
 		// Existing record - class is explicitly tracked
-		allocations = (VALUE)allocations_data;
-		record = Memory_Profiler_Allocations_get(allocations);
-		record->new_count++;
+		record->new_count += weight;
 	} else if (capture->track_all) {
 		// First time seeing this class, create record automatically (if track_all is enabled)
-		record = ALLOC(struct Memory_Profiler_Capture_Allocations);
-		record->callback = Qnil;
-		record->new_count = 1;
-		record->free_count = 0;
-		
-		allocations = Memory_Profiler_Allocations_wrap(record);
-		st_insert(capture->tracked, (st_data_t)klass, (st_data_t)allocations);
-		RB_OBJ_WRITTEN(self, Qnil, klass);
-		RB_OBJ_WRITTEN(self, Qnil, allocations);
+		if (capture->maximum_classes && Memory_Profiler_Classes_size(&capture->tracked) >= capture->maximum_classes) {
+			Memory_Profiler_Capture_evict_classes(capture);
+		}
+		
+		if (capture->maximum_classes && Memory_Profiler_Classes_size(&capture->tracked) >= capture->maximum_classes) {
+			// Nothing could be evicted, so count the allocation as "other":
+			record = Memory_Profiler_Classes_other(&capture->tracked);
+		} else {
+			record = Memory_Profiler_Capture_add_class(self, capture, klass);
+		}
+		
+		record->new_count += weight;
 	} else {
 		// track_all disabled and class not explicitly tracked - skip this allocation entirely
 		capture->paused -= 1;
@@ -197,17 +687,54 @@ static void Memory_Profiler_Capture_process_newobj(VALUE self, VALUE klass, VALU
 	}
 	
 	// Increment global new count (only if we're tracking this class):
-	capture->new_count++;
+	capture->new_count += weight;
+	
+	Memory_Profiler_Capture_attribute(capture, attribution, weight, 0);
 	
 	VALUE data = Qnil;
 	if (!NIL_P(record->callback)) {
 		data = rb_funcall(record->callback, rb_intern("call"), 3, klass, sym_newobj, Qnil);
 	}
 	
-	struct Memory_Profiler_Object_Table_Entry *entry = Memory_Profiler_Object_Table_insert(capture->states, object);
-	RB_OBJ_WRITTEN(self, Qnil, object);
-	RB_OBJ_WRITE(self, &entry->klass, klass);
-	RB_OBJ_WRITE(self, &entry->data, data);
+	// Choose whether to sample the object before looking up its entry, as growing the sample may allocate. Every recorded object of the class is a candidate, whatever its weight:
+	size_t live = Memory_Profiler_Object_Table_class_count(capture->states, record->id) + 1;
+	long sample_index = Memory_Profiler_Allocations_sample_index(record, Memory_Profiler_Capture_random(capture), live);
+	
+	uint64_t started_at = Memory_Profiler_Capture_table_timing_start(capture);
+	struct Memory_Profiler_Object_Table_Entry *entry = Memory_Profiler_Object_Table_insert(capture->states, object, record->id);
+	Memory_Profiler_Capture_table_timing_finish(capture, started_at);
+	
+	if (!entry) {
+		// Out of memory - the allocation is counted, but its free will not be:
+		capture->paused -= 1;
+		return;
+	}
+	Memory_Profiler_Object_Table_set_data(capture->states, entry, data);
+	RB_OBJ_WRITTEN(self, Qnil, data);
+	entry->shift = shift;
+	
+	struct Memory_Profiler_Object_Table_Record *entry_record = Memory_Profiler_Object_Table_record(capture->states, entry);
+	entry_record->epoch = (uint32_t)rb_gc_count();
+	entry_record->attribution = attribution;
+	
+	// The entry may already be sampled if its address was reused without the free being seen:
+	if (sample_index >= 0 && !entry->sampled) {
+		if ((uint32_t)sample_index < record->samples_count) {
+			// The replaced object no longer needs to be searched for when it is freed:
+			struct Memory_Profiler_Object_Table_Entry *replaced = Memory_Profiler_Object_Table_lookup(capture->states, record->samples[sample_index]);
+			if (replaced && replaced->klass == record->id) replaced->sampled = 0;
+		} else {
+			record->samples_count++;
+		}
+		
+		record->samples[sample_index] = object;
+		entry->sampled = 1;
+	}
+	
+	if (capture->trace) {
+		struct Memory_Profiler_Attribution *attributed = Memory_Profiler_Attributions_get(&capture->attributions, attribution);
+		Memory_Profiler_Capture_trace_newobj(capture, record, object, shift, attributed ? attributed->site : MEMORY_PROFILER_SITES_NONE);
+	}
 	
 	if (DEBUG) fprintf(stderr, "[NEWOBJ] Object inserted into table: %p\n", (void*)object);
 	
@@ -224,34 +751,54 @@ static void Memory_Profiler_Capture_process_freeobj(VALUE capture_value, VALUE u
 	// Pause the capture to prevent infinite loop:
 	capture->paused += 1;
 	
+	uint64_t started_at = Memory_Profiler_Capture_table_timing_start(capture);
 	struct Memory_Profiler_Object_Table_Entry *entry = Memory_Profiler_Object_Table_lookup(capture->states, object);
+	Memory_Profiler_Capture_table_timing_finish(capture, started_at);
 	
 	if (!entry) {
 		goto done;
 	}
 	
-	VALUE klass = entry->klass;
-	VALUE data = entry->data;
-	
-	// Look up allocations from tracked table:
-	st_data_t allocations_data;
-	if (!st_lookup(capture->tracked, (st_data_t)klass, &allocations_data)) {
-		// Class not tracked - shouldn't happen, but be defensive:
-		if (DEBUG) fprintf(stderr, "[FREEOBJ] Class not found in tracked: %p\n", (void*)klass);
+	// Look up the class by id:
+	struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Classes_get(&capture->tracked, entry->klass);
+	if (!record) {
+		// Class not tracked - shouldn't happen (untrack deletes the class's entries), but be defensive:
+		if (DEBUG) fprintf(stderr, "[FREEOBJ] Class not found in tracked: %u\n", entry->klass);
+		Memory_Profiler_Object_Table_delete_entry(capture->states, entry);
 		goto done;
 	}
-	VALUE allocations = (VALUE)allocations_data;
+	VALUE klass = record->klass ? record->klass : Qnil;
+	
+	// The object's address, if its entry was detached by compaction:
+	VALUE address = object & ~(VALUE)1;
+	
+	if (entry->sampled) {
+		Memory_Profiler_Capture_replace_sample(capture, record, entry, address);
+	}
+	
+	// Read the data before deleting the entry releases it:
+	VALUE data = Memory_Profiler_Object_Table_data(capture->states, entry);
+	size_t weight = (size_t)1 << entry->shift;
+	uint32_t attribution = Memory_Profiler_Object_Table_record(capture->states, entry)->attribution;
 	
 	// Delete by entry pointer (faster - no second lookup!)
+	started_at = Memory_Profiler_Capture_table_timing_start(capture);
 	Memory_Profiler_Object_Table_delete_entry(capture->states, entry);
+	Memory_Profiler_Capture_table_timing_finish(capture, started_at);
 	
-	struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Allocations_get(allocations);
-
 	// Increment global free count
-	capture->free_count++;
+	capture->free_count += weight;
 	
 	// Increment per-class free count
-	record->free_count++;
+	record->free_count += weight;
+	
+	Memory_Profiler_Capture_attribute(capture, attribution, 0, weight);
+	
+	// Detached frees were already recorded:
+	if (capture->trace && !Memory_Profiler_Capture_detached_p(object)) {
+		Memory_Profiler_Trace_freeobj(capture->trace, Memory_Profiler_Histogram_now(), object, record->id);
+		Memory_Profiler_Trace_flush_if_full(capture->trace);
+	}
 	
 	// Call callback if present
 	if (!NIL_P(record->callback) && !NIL_P(data)) {
@@ -265,9 +812,28 @@ done:
 
 // Process a single event (NEWOBJ or FREEOBJ). Called from events.c via rb_protect to catch exceptions.
 void Memory_Profiler_Capture_process_event(struct Memory_Profiler_Event *event) {
+	if (event->type == MEMORY_PROFILER_EVENT_TYPE_NONE) return;
+	
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(event->capture, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	// Time one in every interval events:
+	struct Memory_Profiler_Capture_Timing *timing = capture->timing;
+	uint64_t started_at = 0;
+	if (timing) {
+		// Reset in case a callback raised while a timed event was processed:
+		timing->event = 0;
+		
+		if (timing->interval && --timing->event_countdown == 0) {
+			timing->event_countdown = timing->interval;
+			timing->event = 1;
+			started_at = Memory_Profiler_Histogram_now();
+		}
+	}
+	
 	switch (event->type) {
 		case MEMORY_PROFILER_EVENT_TYPE_NEWOBJ:
-			Memory_Profiler_Capture_process_newobj(event->capture, event->klass, event->object);
+			Memory_Profiler_Capture_process_newobj(event->capture, event->klass, event->object, event->shift, event->attribution);
 			break;
 		case MEMORY_PROFILER_EVENT_TYPE_FREEOBJ:
 			Memory_Profiler_Capture_process_freeobj(event->capture, event->klass, event->object);
@@ -276,6 +842,15 @@ void Memory_Profiler_Capture_process_event(struct Memory_Profiler_Event *event)
 			// Ignore.
 			break;
 	}
+	
+	if (started_at) {
+		uint64_t now = Memory_Profiler_Histogram_now();
+		
+		timing->event = 0;
+		Memory_Profiler_Histogram_record(event->type == MEMORY_PROFILER_EVENT_TYPE_NEWOBJ ? &timing->newobj : &timing->freeobj, Memory_Profiler_Histogram_elapsed(started_at, now));
+		
+		Memory_Profiler_Capture_govern(capture, now);
+	}
 }
 
 #pragma mark - Event Handlers
@@ -314,14 +889,59 @@ int Memory_Profiler_Capture_trackable_p(VALUE object) {
 	}
 }
 
-// Event hook callback with RAW_ARG
-// Signature: (VALUE data, rb_trace_arg_t *trace_arg)
-static void Memory_Profiler_Capture_event_callback(VALUE self, void *ptr) {
-	rb_trace_arg_t *trace_arg = (rb_trace_arg_t *)ptr;
+// Enqueue a FREEOBJ event, if the object's allocation was recorded (so it can be in the object table).
+static void Memory_Profiler_Capture_enqueue_freeobj(VALUE self, struct Memory_Profiler_Capture *capture, VALUE object) {
+	if (!Memory_Profiler_Object_Pages_remove(&capture->pages, object)) return;
 	
-	struct Memory_Profiler_Capture *capture;
-	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	if (DEBUG_EVENT) fprintf(stderr, "[FREEOBJ] Enqueuing event for object: %p\n", (void*)object);
+	Memory_Profiler_Events_enqueue(MEMORY_PROFILER_EVENT_TYPE_FREEOBJ, self, Qnil, object, 0, 0);
+}
+
+// Intern the site, method and tag of the allocation being reported by the hook, as an attribution id. Never allocates Ruby objects.
+// The method is the one of the nearest frame, so allocations made by C methods (e.g. Class#new or Array#map) are attributed to them, as with ObjectSpace.trace_object_allocations.
+static uint32_t Memory_Profiler_Capture_attribution(VALUE self, struct Memory_Profiler_Capture *capture, rb_trace_arg_t *trace_arg) {
+	struct Memory_Profiler_Attribution attribution = {0};
+	
+	if (capture->track_sites) {
+		VALUE path = rb_tracearg_path(trace_arg);
+		attribution.site = Memory_Profiler_Sites_intern(&capture->sites, path, FIX2INT(rb_tracearg_lineno(trace_arg)));
+	}
+	
+	if (capture->track_methods) {
+		VALUE defined_class = rb_tracearg_defined_class(trace_arg);
+		VALUE name = rb_tracearg_method_id(trace_arg);
+		attribution.method = Memory_Profiler_Methods_intern(&capture->methods, defined_class, name);
+		RB_OBJ_WRITTEN(self, Qundef, defined_class);
+		RB_OBJ_WRITTEN(self, Qundef, name);
+	}
+	
+	if (capture->track_tags) {
+		// Reading a fiber-local variable is a table lookup, which doesn't allocate:
+		VALUE tag = rb_thread_local_aref(rb_thread_current(), id_memory_profiler_tag);
+		attribution.tag = Memory_Profiler_Tags_intern(&capture->tags, tag);
+		RB_OBJ_WRITTEN(self, Qundef, tag);
+	}
+	
+	return Memory_Profiler_Attributions_intern(&capture->attributions, attribution);
+}
+
+// Whether the current fiber is inside a measure block of the capture. Reading a fiber-local variable is a table lookup, which doesn't allocate.
+static int Memory_Profiler_Capture_measuring_p(VALUE self) {
+	VALUE scopes = rb_thread_local_aref(rb_thread_current(), id_memory_profiler_scopes);
+	if (!RB_TYPE_P(scopes, T_ARRAY)) return 0;
+	
+	long length = RARRAY_LEN(scopes);
+	const VALUE *captures = RARRAY_CONST_PTR(scopes);
+	
+	for (long i = 0; i < length; i++) {
+		if (captures[i] == self) return 1;
+	}
 	
+	return 0;
+}
+
+// Handle a NEWOBJ or FREEOBJ event from the hook.
+static inline void Memory_Profiler_Capture_handle_event(VALUE self, struct Memory_Profiler_Capture *capture, rb_trace_arg_t *trace_arg) {
 	VALUE object = rb_tracearg_object(trace_arg);
 	rb_event_flag_t event_flag = rb_tracearg_event_flag(trace_arg);
 	
@@ -332,21 +952,62 @@ static void Memory_Profiler_Capture_event_callback(VALUE self, void *ptr) {
 		// Skip NEWOBJ if disabled (during callback) to prevent infinite recursion
 		if (capture->paused) return;
 		
+		// Record one in every 2^sampling_shift allocations, deciding first as it's the cheapest check (the frees of the others are filtered out by the page bitmap):
+		unsigned int shift = capture->sampling_shift;
+		if (shift && (Memory_Profiler_Capture_random(capture) & (((uint64_t)1 << shift) - 1))) return;
+		
+		// Scoped captures skip allocations made outside their measure blocks (the frees of those are filtered out by the page bitmap):
+		if (capture->scoped && !Memory_Profiler_Capture_measuring_p(self)) return;
+		
 		VALUE klass = rb_obj_class(object);
 		
 		// Skip if klass is not a Class
 		if (rb_type(klass) != RUBY_T_CLASS) return;
 		
+		// Skip classes we would ignore anyway, so their frees are filtered out below too:
+		if (!capture->track_all && !Memory_Profiler_Classes_lookup(&capture->tracked, klass)) return;
+		
+		// The allocating line, method and fiber are only known now, so intern them here (without allocating Ruby objects):
+		uint32_t attribution = MEMORY_PROFILER_ATTRIBUTIONS_NONE;
+		if (capture->track_sites || capture->track_methods || capture->track_tags) {
+			attribution = Memory_Profiler_Capture_attribution(self, capture, trace_arg);
+		}
+		
+		Memory_Profiler_Object_Pages_add(&capture->pages, object);
+		
 		if (DEBUG_EVENT) fprintf(stderr, "[NEWOBJ] Enqueuing event for object: %p\n", (void*)object);
-		Memory_Profiler_Events_enqueue(MEMORY_PROFILER_EVENT_TYPE_NEWOBJ, self, klass, object);
+		Memory_Profiler_Events_enqueue(MEMORY_PROFILER_EVENT_TYPE_NEWOBJ, self, klass, object, shift, attribution);
 	} else if (event_flag == RUBY_INTERNAL_EVENT_FREEOBJ) {
-		if (DEBUG_EVENT) fprintf(stderr, "[FREEOBJ] Enqueuing event for object: %p\n", (void*)object);
-		Memory_Profiler_Events_enqueue(MEMORY_PROFILER_EVENT_TYPE_FREEOBJ, self, Qnil, object);
+		Memory_Profiler_Capture_enqueue_freeobj(self, capture, object);
 	}
 }
 
-// Allocate new capture
-static VALUE Memory_Profiler_Capture_alloc(VALUE klass) {
+// Event hook callback with RAW_ARG
+// Signature: (VALUE data, rb_trace_arg_t *trace_arg)
+static void Memory_Profiler_Capture_event_callback(VALUE self, void *ptr) {
+	rb_trace_arg_t *trace_arg = (rb_trace_arg_t *)ptr;
+	
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	// Time one in every interval invocations:
+	struct Memory_Profiler_Capture_Timing *timing = capture->timing;
+	if (timing && timing->interval && --timing->hook_countdown == 0) {
+		timing->hook_countdown = timing->interval;
+		
+		uint64_t started_at = Memory_Profiler_Histogram_now();
+		Memory_Profiler_Capture_handle_event(self, capture, trace_arg);
+		uint64_t now = Memory_Profiler_Histogram_now();
+		
+		Memory_Profiler_Histogram_record(&timing->hook, Memory_Profiler_Histogram_elapsed(started_at, now));
+		Memory_Profiler_Capture_govern(capture, now);
+	} else {
+		Memory_Profiler_Capture_handle_event(self, capture, trace_arg);
+	}
+}
+
+// Allocate new capture
+static VALUE Memory_Profiler_Capture_alloc(VALUE klass) {
 	struct Memory_Profiler_Capture *capture;
 	VALUE obj = TypedData_Make_Struct(klass, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
 	
@@ -354,27 +1015,42 @@ static VALUE Memory_Profiler_Capture_alloc(VALUE klass) {
 		rb_raise(rb_eRuntimeError, "Failed to allocate Memory::Profiler::Capture");
 	}
 	
-	capture->tracked = st_init_numtable();
-	
-	if (!capture->tracked) {
-		rb_raise(rb_eRuntimeError, "Failed to initialize tracked hash table");
-	}
+	Memory_Profiler_Classes_initialize(&capture->tracked);
+	Memory_Profiler_Sites_initialize(&capture->sites);
+	Memory_Profiler_Methods_initialize(&capture->methods);
+	Memory_Profiler_Tags_initialize(&capture->tags);
+	Memory_Profiler_Attributions_initialize(&capture->attributions);
+	capture->maximum_classes = 0;
+	capture->evicted_count = 0;
 	
 	// Initialize custom object table (uses system malloc, GC-safe)
 	capture->states = Memory_Profiler_Object_Table_new(1024);
 	if (!capture->states) {
-		st_free_table(capture->tracked);
 		rb_raise(rb_eRuntimeError, "Failed to initialize object table");
 	}
 	
+	Memory_Profiler_Object_Pages_initialize(&capture->pages);
+	
 	// Initialize allocation tracking counters
 	capture->new_count = 0;
 	capture->free_count = 0;
 	
+	capture->random = (uint64_t)(uintptr_t)capture ^ 0x9E3779B97F4A7C15ULL;
+	capture->snapshots = NULL;
+	capture->timing = NULL;
+	capture->sampling_shift = 0;
+	capture->trace = NULL;
+	capture->trace_io = Qnil;
+	
 	// Initialize state flags - not running, callbacks disabled, track_all disabled by default
 	capture->running = 0;
+	capture->watching = 0;
 	capture->paused = 0;
+	capture->scoped = 0;
 	capture->track_all = 0;
+	capture->track_sites = 0;
+	capture->track_methods = 0;
+	capture->track_tags = 0;
 	
 	// Global event queue system will auto-initialize on first use (lazy initialization)
 	
@@ -404,6 +1080,317 @@ static VALUE Memory_Profiler_Capture_track_all_set(VALUE self, VALUE value) {
 	return value;
 }
 
+// Get track_sites setting
+static VALUE Memory_Profiler_Capture_track_sites_get(VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	return capture->track_sites ? Qtrue : Qfalse;
+}
+
+// Set track_sites setting. Objects allocated while it was disabled are not counted by any site, including their frees.
+static VALUE Memory_Profiler_Capture_track_sites_set(VALUE self, VALUE value) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	capture->track_sites = RTEST(value) ? 1 : 0;
+	
+	return value;
+}
+
+// Get track_methods setting
+static VALUE Memory_Profiler_Capture_track_methods_get(VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	return capture->track_methods ? Qtrue : Qfalse;
+}
+
+// Set track_methods setting. Objects allocated while it was disabled are not counted by any method, including their frees.
+static VALUE Memory_Profiler_Capture_track_methods_set(VALUE self, VALUE value) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	capture->track_methods = RTEST(value) ? 1 : 0;
+	
+	return value;
+}
+
+// Get track_tags setting
+static VALUE Memory_Profiler_Capture_track_tags_get(VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	return capture->track_tags ? Qtrue : Qfalse;
+}
+
+// Set track_tags setting. Objects allocated while it was disabled are not counted by any tag, including their frees.
+static VALUE Memory_Profiler_Capture_track_tags_set(VALUE self, VALUE value) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	capture->track_tags = RTEST(value) ? 1 : 0;
+	
+	return value;
+}
+
+// Get scoped setting
+static VALUE Memory_Profiler_Capture_scoped_get(VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	return capture->scoped ? Qtrue : Qfalse;
+}
+
+// Set scoped setting. When enabled, a running capture only records allocations made inside its measure blocks. Frees are still recorded for every object it recorded.
+static VALUE Memory_Profiler_Capture_scoped_set(VALUE self, VALUE value) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	capture->scoped = RTEST(value) ? 1 : 0;
+	
+	return value;
+}
+
+// Restore the captures measuring the current fiber when a measure block exits.
+static VALUE Memory_Profiler_Capture_measure_ensure(VALUE previous) {
+	rb_thread_local_aset(rb_thread_current(), id_memory_profiler_scopes, previous);
+	
+	return Qnil;
+}
+
+// Run the block, recording the allocations it makes on the current fiber if the capture is scoped. Allocations made by other fibers and threads, including those the block creates, are not recorded. Returns the result of the block.
+static VALUE Memory_Profiler_Capture_measure(VALUE self) {
+	rb_need_block();
+	
+	VALUE thread = rb_thread_current();
+	VALUE previous = rb_thread_local_aref(thread, id_memory_profiler_scopes);
+	
+	// The hook reads the array, so it's replaced rather than modified:
+	VALUE scopes = RB_TYPE_P(previous, T_ARRAY) ? rb_ary_dup(previous) : rb_ary_new_capa(1);
+	rb_ary_push(scopes, self);
+	rb_obj_freeze(scopes);
+	
+	rb_thread_local_aset(thread, id_memory_profiler_scopes, scopes);
+	
+	return rb_ensure(rb_yield, Qundef, Memory_Profiler_Capture_measure_ensure, previous);
+}
+
+// Get the tag of the current fiber's allocations (nil if untagged).
+static VALUE Memory_Profiler_Capture_tag_get(VALUE klass) {
+	return rb_thread_local_aref(rb_thread_current(), id_memory_profiler_tag);
+}
+
+// Set the tag of the current fiber's allocations, for every capture tracking tags. The tag is fiber-local, so it's not inherited by new fibers or threads.
+// Captures retain every tag they have seen, so only immediate and frozen values are accepted: mutable objects such as fibers would be kept alive forever.
+static VALUE Memory_Profiler_Capture_tag_set(VALUE klass, VALUE tag) {
+	if (!RB_SPECIAL_CONST_P(tag) && !RB_OBJ_FROZEN(tag)) {
+		rb_raise(rb_eArgError, "tag must be an immediate or frozen value, as captures retain it!");
+	}
+	
+	return rb_thread_local_aset(rb_thread_current(), id_memory_profiler_tag, tag);
+}
+
+// Get maximum_classes setting
+static VALUE Memory_Profiler_Capture_maximum_classes_get(VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	return capture->maximum_classes ? SIZET2NUM(capture->maximum_classes) : Qnil;
+}
+
+// Set maximum_classes setting (nil = unlimited)
+static VALUE Memory_Profiler_Capture_maximum_classes_set(VALUE self, VALUE value) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	if (NIL_P(value)) {
+		capture->maximum_classes = 0;
+	} else {
+		long maximum = NUM2LONG(value);
+		if (maximum < 1) {
+			rb_raise(rb_eArgError, "maximum_classes must be positive!");
+		}
+		capture->maximum_classes = (size_t)maximum;
+	}
+	
+	return value;
+}
+
+// Get timing_interval setting (nil if timing is disabled)
+static VALUE Memory_Profiler_Capture_timing_interval_get(VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	return capture->timing && capture->timing->interval ? SIZET2NUM(capture->timing->interval) : Qnil;
+}
+
+// Set timing_interval setting: time one in every N hook invocations and processed events, reported by statistics (nil = disabled, not allowed while overhead_budget is set)
+static VALUE Memory_Profiler_Capture_timing_interval_set(VALUE self, VALUE value) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	size_t interval = 0;
+	if (!NIL_P(value)) {
+		long number = NUM2LONG(value);
+		if (number < 1) {
+			rb_raise(rb_eArgError, "timing_interval must be positive!");
+		}
+		interval = (size_t)number;
+	} else if (capture->governor.budget > 0) {
+		// Without timing, the governor would see no cost and stop adjusting sampling_interval:
+		rb_raise(rb_eArgError, "timing_interval can't be disabled while overhead_budget is set!");
+	}
+	
+	int enabled = capture->timing && capture->timing->interval;
+	
+	// The user now controls timing, even if the governor enabled it:
+	capture->governor.timing = 0;
+	
+	if (interval && !capture->timing) {
+		capture->timing = ZALLOC(struct Memory_Profiler_Capture_Timing);
+		Memory_Profiler_Histogram_calibrate();
+	}
+	
+	if (capture->timing) {
+		capture->timing->interval = interval;
+		capture->timing->hook_countdown = interval;
+		capture->timing->event_countdown = interval;
+	}
+	
+	Memory_Profiler_Capture_governor_reset(capture);
+	
+	// Queue processing is shared, so it's timed while any capture has timing enabled:
+	if (!enabled && interval) {
+		Memory_Profiler_Events_timing(1);
+	} else if (enabled && !interval) {
+		Memory_Profiler_Events_timing(0);
+	}
+	
+	return value;
+}
+
+// Get sampling_interval: allocations of tracked classes are recorded one in every N, and counted N times
+static VALUE Memory_Profiler_Capture_sampling_interval_get(VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	return SIZET2NUM((size_t)1 << capture->sampling_shift);
+}
+
+// Set sampling_interval (a power of two, 1 = record every allocation)
+static VALUE Memory_Profiler_Capture_sampling_interval_set(VALUE self, VALUE value) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	long interval = NUM2LONG(value);
+	if (interval < 1 || interval > (1L << MEMORY_PROFILER_CAPTURE_MAXIMUM_SHIFT) || (interval & (interval - 1))) {
+		rb_raise(rb_eArgError, "sampling_interval must be a power of two, at most %ld!", 1L << MEMORY_PROFILER_CAPTURE_MAXIMUM_SHIFT);
+	}
+	
+	unsigned int shift = 0;
+	while ((1L << shift) < interval) shift++;
+	
+	capture->sampling_shift = shift;
+	capture->governor.sampling_shift = shift;
+	Memory_Profiler_Capture_governor_reset(capture);
+	
+	return value;
+}
+
+// Get overhead_budget setting (nil if the sampling interval is not governed)
+static VALUE Memory_Profiler_Capture_overhead_budget_get(VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	return capture->governor.budget > 0 ? DBL2NUM(capture->governor.budget) : Qnil;
+}
+
+// Set overhead_budget: the fraction of CPU time the capture may use (e.g. 0.02), adjusting sampling_interval to stay within it (nil = restore the sampling_interval set before, and stop the timing the budget enabled)
+static VALUE Memory_Profiler_Capture_overhead_budget_set(VALUE self, VALUE value) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	if (NIL_P(value)) {
+		if (capture->governor.budget > 0) {
+			capture->governor.budget = 0;
+			capture->sampling_shift = capture->governor.sampling_shift;
+			
+			if (capture->governor.timing) {
+				Memory_Profiler_Capture_timing_interval_set(self, Qnil);
+			}
+		}
+		
+		return value;
+	}
+	
+	double budget = NUM2DBL(value);
+	if (!(budget > 0 && budget <= 1)) {
+		rb_raise(rb_eArgError, "overhead_budget must be greater than 0 and at most 1!");
+	}
+	
+	// The governor measures the cost using timing:
+	if (!capture->timing || !capture->timing->interval) {
+		Memory_Profiler_Capture_timing_interval_set(self, INT2FIX(MEMORY_PROFILER_CAPTURE_GOVERNOR_TIMING_INTERVAL));
+		capture->governor.timing = 1;
+	}
+	
+	capture->governor.budget = budget;
+	Memory_Profiler_Capture_governor_reset(capture);
+	
+	return value;
+}
+
+// Get the IO the event trace is being written to (nil if not tracing)
+static VALUE Memory_Profiler_Capture_trace_get(VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	return capture->trace_io;
+}
+
+// Set the IO to write the event trace to, finishing the current trace if any (nil = stop tracing). The trace writes to a duplicate of the IO's file descriptor, which it closes when finished; the IO itself is not closed by the capture.
+// Buffered records are written by stop and when the trace is finished. A capture that is garbage collected while running discards them, rather than block the GC on a write.
+static VALUE Memory_Profiler_Capture_trace_set(VALUE self, VALUE io) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	if (capture->trace) {
+		// Include the events that are still queued:
+		Memory_Profiler_Events_process_all();
+		
+		struct Memory_Profiler_Trace *trace = capture->trace;
+		capture->trace = NULL;
+		RB_OBJ_WRITE(self, &capture->trace_io, Qnil);
+		
+		Memory_Profiler_Trace_flush(trace);
+		Memory_Profiler_Trace_free(trace);
+	}
+	
+	if (NIL_P(io)) return io;
+	
+	// Anything already buffered by the IO must come first, as the trace writes to the file directly:
+	VALUE file = rb_io_get_io(io);
+	rb_io_flush(file);
+	
+	// The trace owns a copy of the descriptor, so closing the IO can't make it write to whatever reuses the descriptor's number:
+	int descriptor = rb_cloexec_dup(rb_io_descriptor(file));
+	if (descriptor < 0) {
+		rb_sys_fail("dup");
+	}
+	rb_update_max_fd(descriptor);
+	
+	capture->trace = Memory_Profiler_Trace_new(descriptor);
+	if (!capture->trace) {
+		close(descriptor);
+		rb_raise(rb_eNoMemError, "Failed to allocate trace buffer!");
+	}
+	
+	RB_OBJ_WRITE(self, &capture->trace_io, io);
+	
+	return io;
+}
+
 // Start capturing allocations
 static VALUE Memory_Profiler_Capture_start(VALUE self) {
 	struct Memory_Profiler_Capture *capture;
@@ -423,6 +1410,9 @@ static VALUE Memory_Profiler_Capture_start(VALUE self) {
 		RUBY_EVENT_HOOK_FLAG_SAFE | RUBY_EVENT_HOOK_FLAG_RAW_ARG
 	);
 	
+	// The event hook sees frees too:
+	Memory_Profiler_Capture_unwatch_frees(capture);
+	
 	// Set both flags - we're now running and callbacks are enabled
 	capture->running = 1;
 	capture->paused = 0;
@@ -437,6 +1427,9 @@ static VALUE Memory_Profiler_Capture_stop(VALUE self) {
 	
 	if (!capture->running) return Qfalse;
 	
+	// Watch frees before the event hook is removed, so none are missed:
+	Memory_Profiler_Capture_watch_frees(capture);
+	
 	// Remove event hook using same data (self) we registered with. No more events will be queued after this point:
 	rb_remove_event_hook_with_data((rb_event_hook_func_t)Memory_Profiler_Capture_event_callback, self);
 	
@@ -444,6 +1437,10 @@ static VALUE Memory_Profiler_Capture_stop(VALUE self) {
 	// This ensures all callbacks are invoked and object_states is properly maintained.
 	Memory_Profiler_Events_process_all();
 	
+	if (capture->trace) {
+		Memory_Profiler_Trace_flush(capture->trace);
+	}
+	
 	// Clear both flags - we're no longer running and callbacks are disabled
 	capture->running = 0;
 	capture->paused = 0;
@@ -461,29 +1458,18 @@ static VALUE Memory_Profiler_Capture_track(int argc, VALUE *argv, VALUE self) {
 	
 	VALUE klass, callback;
 	rb_scan_args(argc, argv, "1&", &klass, &callback);
-		
-	st_data_t allocations_data;
-	VALUE allocations;
 	
-	if (st_lookup(capture->tracked, (st_data_t)klass, &allocations_data)) {
-		allocations = (VALUE)allocations_data;
-		struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Allocations_get(allocations);
-		RB_OBJ_WRITE(self, &record->callback, callback);
-	} else {
-		struct Memory_Profiler_Capture_Allocations *record = ALLOC(struct Memory_Profiler_Capture_Allocations);
-		RB_OBJ_WRITE(self, &record->callback, callback);
-		record->new_count = 0;
-		record->free_count = 0;
-		// NOTE: States table removed - now at Capture level
-		
-		// Wrap the record in a VALUE
-		allocations = Memory_Profiler_Allocations_wrap(record);
-		
-		st_insert(capture->tracked, (st_data_t)klass, (st_data_t)allocations);
-		RB_OBJ_WRITTEN(self, Qnil, klass);
-		RB_OBJ_WRITTEN(self, Qnil, allocations);
+	struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Classes_lookup(&capture->tracked, klass);
+	
+	if (!record) {
+		record = Memory_Profiler_Capture_add_class(self, capture, klass);
 	}
 	
+	record->tracked = 1;
+	
+	VALUE allocations = Memory_Profiler_Capture_allocations(self, record);
+	Memory_Profiler_Allocations_set_callback(record, callback);
+	
 	return allocations;
 }
 
@@ -492,11 +1478,14 @@ static VALUE Memory_Profiler_Capture_untrack(VALUE self, VALUE klass) {
 	struct Memory_Profiler_Capture *capture;
 	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
 	
-	st_data_t allocations_data;
-	if (st_delete(capture->tracked, (st_data_t *)&klass, &allocations_data)) {
-		// The wrapped Allocations VALUE will be GC'd naturally
-		// No manual cleanup needed
-	}
+	struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Classes_lookup(&capture->tracked, klass);
+	if (!record) return self;
+	
+	// Forget the class's objects, so their table slots are released (costs O(objects of the class)):
+	Memory_Profiler_Object_Table_delete_class(capture->states, record->id, Memory_Profiler_Capture_object_deleted, &capture->pages);
+	
+	// No entry refers to the id any more, so it can be reused. Any wrapper keeps its own reference to the record:
+	Memory_Profiler_Classes_remove(&capture->tracked, klass);
 	
 	return self;
 }
@@ -506,7 +1495,7 @@ static VALUE Memory_Profiler_Capture_tracking_p(VALUE self, VALUE klass) {
 	struct Memory_Profiler_Capture *capture;
 	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
 	
-	return st_lookup(capture->tracked, (st_data_t)klass, NULL) ? Qtrue : Qfalse;
+	return Memory_Profiler_Classes_lookup(&capture->tracked, klass) ? Qtrue : Qfalse;
 }
 
 // Get count of live objects for a specific class (O(1) lookup!)
@@ -514,10 +1503,8 @@ static VALUE Memory_Profiler_Capture_retained_count_of(VALUE self, VALUE klass)
 	struct Memory_Profiler_Capture *capture;
 	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
 	
-	st_data_t allocations_data;
-	if (st_lookup(capture->tracked, (st_data_t)klass, &allocations_data)) {
-		VALUE allocations = (VALUE)allocations_data;
-		struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Allocations_get(allocations);
+	struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Classes_lookup(&capture->tracked, klass);
+	if (record) {
 		if (record->free_count <= record->new_count) {
 			return SIZET2NUM(record->new_count - record->free_count);
 		}
@@ -526,15 +1513,6 @@ static VALUE Memory_Profiler_Capture_retained_count_of(VALUE self, VALUE klass)
 	return INT2FIX(0);
 }
 
-// Iterator to reset each class record
-static int Memory_Profiler_Capture_tracked_clear(st_data_t key, st_data_t value, st_data_t arg) {
-	VALUE allocations = (VALUE)value;
-	
-	Memory_Profiler_Allocations_clear(allocations);
-	
-	return ST_CONTINUE;
-}
-
 // Clear all allocation tracking (resets all counts to 0)
 static VALUE Memory_Profiler_Capture_clear(VALUE self) {
 	struct Memory_Profiler_Capture *capture;
@@ -549,7 +1527,14 @@ static VALUE Memory_Profiler_Capture_clear(VALUE self) {
 	}
 	
 	// Reset all counts to 0 (don't free, just reset):
-	st_foreach(capture->tracked, Memory_Profiler_Capture_tracked_clear, 0);
+	for (size_t id = 1; id < capture->tracked.records_count; id++) {
+		struct Memory_Profiler_Capture_Allocations *record = capture->tracked.records[id];
+		if (record) Memory_Profiler_Allocations_clear(record);
+	}
+	
+	Memory_Profiler_Sites_clear(&capture->sites);
+	Memory_Profiler_Methods_clear(&capture->methods);
+	Memory_Profiler_Tags_clear(&capture->tags);
 	
 	// Clear custom object table by recreating it
 	if (capture->states) {
@@ -557,22 +1542,23 @@ static VALUE Memory_Profiler_Capture_clear(VALUE self) {
 		capture->states = Memory_Profiler_Object_Table_new(1024);
 	}
 	
+	Memory_Profiler_Object_Pages_free(&capture->pages);
+	
 	// Reset allocation tracking counters
 	capture->new_count = 0;
 	capture->free_count = 0;
+	capture->evicted_count = 0;
 	
-	return self;
-}
-
-// Iterator callback for each
-static int Memory_Profiler_Capture_each_allocation(st_data_t key, st_data_t value, st_data_t arg) {
-	VALUE klass = (VALUE)key;
-	VALUE allocations = (VALUE)value;  // Already a wrapped VALUE
+	if (capture->timing) {
+		Memory_Profiler_Histogram_clear(&capture->timing->hook);
+		Memory_Profiler_Histogram_clear(&capture->timing->newobj);
+		Memory_Profiler_Histogram_clear(&capture->timing->freeobj);
+		Memory_Profiler_Histogram_clear(&capture->timing->table);
+	}
 	
-	// Yield class and allocations wrapper
-	rb_yield_values(2, klass, allocations);
+	Memory_Profiler_Capture_governor_reset(capture);
 	
-	return ST_CONTINUE;
+	return self;
 }
 
 // Iterate over all tracked classes with their allocation data
@@ -582,121 +1568,742 @@ static VALUE Memory_Profiler_Capture_each(VALUE self) {
 	
 	RETURN_ENUMERATOR(self, 0, 0);
 	
-	st_foreach(capture->tracked, Memory_Profiler_Capture_each_allocation, 0);
+	// Classes registered or removed by the block are handled by re-reading the records on each step:
+	for (size_t id = 1; id < capture->tracked.records_count; id++) {
+		struct Memory_Profiler_Capture_Allocations *record = capture->tracked.records[id];
+		
+		// Skip removed classes and the "other" record:
+		if (!record || !record->klass) continue;
+		
+		// Yield class and allocations wrapper
+		rb_yield_values(2, record->klass, Memory_Profiler_Capture_allocations(self, record));
+	}
 	
 	return self;
 }
 
-// Struct for filtering states during each_object iteration
-struct Memory_Profiler_Each_Object_Arguments {
-	VALUE self;
-	
-	// The allocations wrapper to filter by (Qnil = no filter).
-	VALUE allocations;
+// Iterate over the allocation sites with their counts: yields path, line, new_count and free_count (path and line are nil for allocations with no Ruby frame).
+static VALUE Memory_Profiler_Capture_each_site(VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
 	
-	// Previous GC state (to restore in ensure handler)
-	int gc_was_enabled;
-};
-
-// Cleanup function to restore GC state
-static VALUE Memory_Profiler_Capture_each_object_ensure(VALUE arg) {
-	struct Memory_Profiler_Each_Object_Arguments *arguments = (struct Memory_Profiler_Each_Object_Arguments *)arg;
+	RETURN_ENUMERATOR(self, 0, 0);
 	
-	// Restore GC state only if it was enabled before
-	if (arguments->gc_was_enabled) {
-		rb_gc_enable();
+	// Sites interned by the block are handled by re-reading the sites on each step:
+	for (uint32_t id = MEMORY_PROFILER_SITES_UNKNOWN; id < capture->sites.count; id++) {
+		struct Memory_Profiler_Site *site = Memory_Profiler_Sites_get(&capture->sites, id);
+		
+		// Skip sites with nothing recorded since they were cleared:
+		if (site->new_count == 0 && site->free_count == 0) continue;
+		
+		VALUE path = Memory_Profiler_Sites_path_string(&capture->sites, site);
+		VALUE line = NIL_P(path) ? Qnil : INT2NUM(site->line);
+		
+		rb_yield_values(4, path, line, SIZET2NUM(site->new_count), SIZET2NUM(site->free_count));
 	}
 	
-	return Qnil;
+	return self;
 }
 
-// Main iteration function
-static VALUE Memory_Profiler_Capture_each_object_body(VALUE arg) {
-	struct Memory_Profiler_Each_Object_Arguments *arguments = (struct Memory_Profiler_Each_Object_Arguments *)arg;
+// Iterate over the allocating methods with their counts: yields the defining class or module, the method name, new_count and free_count (the class and name are nil for allocations outside of any method).
+static VALUE Memory_Profiler_Capture_each_method(VALUE self) {
 	struct Memory_Profiler_Capture *capture;
-	TypedData_Get_Struct(arguments->self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
 	
-	// Iterate custom object table entries
-	if (capture->states) {
-		if (DEBUG) fprintf(stderr, "[ITER] Iterating table, capacity=%zu, count=%zu\n", capture->states->capacity, capture->states->count);
+	RETURN_ENUMERATOR(self, 0, 0);
+	
+	// Methods interned by the block are handled by re-reading the methods on each step:
+	for (uint32_t id = MEMORY_PROFILER_METHODS_UNKNOWN; id < capture->methods.count; id++) {
+		struct Memory_Profiler_Method *method = Memory_Profiler_Methods_get(&capture->methods, id);
 		
-		for (size_t i = 0; i < capture->states->capacity; i++) {
-			struct Memory_Profiler_Object_Table_Entry *entry = &capture->states->entries[i];
-			
-			// Skip empty or deleted slots (0 = not set, Qnil = deleted)
-			if (entry->object == 0 || entry->object == Qnil) {
-				continue;
-			}
-			
-			// Look up allocations from klass
-			st_data_t allocations_data;
-			VALUE allocations = Qnil;
-			if (st_lookup(capture->tracked, (st_data_t)entry->klass, &allocations_data)) {
-				allocations = (VALUE)allocations_data;
-			}
-			
-			// Filter by allocations if specified
-			if (!NIL_P(arguments->allocations)) {
-				if (allocations != arguments->allocations) continue;
-			}
-			
-			rb_yield_values(2, entry->object, allocations);
-		}
+		// Skip methods with nothing recorded since they were cleared:
+		if (method->new_count == 0 && method->free_count == 0) continue;
+		
+		VALUE defined_class = method->defined_class ? method->defined_class : Qnil;
+		VALUE name = method->name ? method->name : Qnil;
+		
+		rb_yield_values(4, defined_class, name, SIZET2NUM(method->new_count), SIZET2NUM(method->free_count));
 	}
 	
-	return arguments->self;
+	return self;
 }
 
-// Iterate over tracked object IDs, optionally filtered by class
-// Called as: 
-//   capture.each_object(String) { |object_id, state| ... }  # Specific class
-//   capture.each_object { |object_id, state| ... }          // All objects
-// 
-// Yields object_id as Integer. Caller can:
-//   - Format as hex: "0x%x" % object_id
-//   - Convert to object with ObjectSpace._id2ref (may raise RangeError if recycled)
-// Future-proof for Ruby 3.5 where _id2ref is deprecated
-static VALUE Memory_Profiler_Capture_each_object(int argc, VALUE *argv, VALUE self) {
+// Iterate over the tags with their counts: yields the tag, new_count and free_count (the tag is nil for allocations made while untagged).
+static VALUE Memory_Profiler_Capture_each_tag(VALUE self) {
 	struct Memory_Profiler_Capture *capture;
 	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
 	
-	VALUE klass;
-	rb_scan_args(argc, argv, "01", &klass);
+	RETURN_ENUMERATOR(self, 0, 0);
+	
+	// Tags interned by the block are handled by re-reading the tags on each step:
+	for (uint32_t id = MEMORY_PROFILER_TAGS_UNTAGGED; id < capture->tags.count; id++) {
+		struct Memory_Profiler_Tag *tag = Memory_Profiler_Tags_get(&capture->tags, id);
+		
+		// Skip tags with nothing recorded since they were cleared:
+		if (tag->new_count == 0 && tag->free_count == 0) continue;
+		
+		rb_yield_values(3, tag->value, SIZET2NUM(tag->new_count), SIZET2NUM(tag->free_count));
+	}
+	
+	return self;
+}
+
+// Finish the lazy sweep of the last GC, if any. Until an object is swept, it is dead but still in the object table, as its FREEOBJ event has not been enqueued. rb_gc_disable finishes the sweep before disabling GC, which is only needed for that.
+static void Memory_Profiler_Capture_finish_sweep(void) {
+	if (rb_gc_disable() == Qfalse) {
+		rb_gc_enable();
+	}
+}
+
+// Sweep and process events until none are pending, so every object remaining in the object table is alive. Processing runs callbacks, which may trigger a GC that leaves more objects to sweep, hence the loop. Callers must not allocate until they are done with the object table.
+static void Memory_Profiler_Capture_drain_events(void) {
+	while (1) {
+		Memory_Profiler_Capture_finish_sweep();
+		
+		if (!Memory_Profiler_Events_pending_p()) break;
+		
+		Memory_Profiler_Events_process_all();
+	}
+}
+
+// Struct for filtering states during each_object iteration
+struct Memory_Profiler_Each_Object_Arguments {
+	VALUE self;
+	
+	// The class id to filter by (0 = no filter).
+	uint32_t id;
+	
+	struct Memory_Profiler_Capture_Snapshot snapshot;
+	
+	// For export_objects: the String to append records to, or the IO to write them to (if not nil):
+	VALUE output;
+	VALUE io;
+	
+	// For export_objects: the maximum number of records, and the number written so far:
+	size_t limit;
+	size_t count;
+};
+
+// Cleanup function to release the snapshot
+static VALUE Memory_Profiler_Capture_each_object_ensure(VALUE arg) {
+	struct Memory_Profiler_Each_Object_Arguments *arguments = (struct Memory_Profiler_Each_Object_Arguments *)arg;
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(arguments->self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	// Iterations may be nested, but always finish in reverse order:
+	capture->snapshots = arguments->snapshot.next;
+	
+	free(arguments->snapshot.objects);
+	arguments->snapshot.objects = NULL;
+	
+	return Qnil;
+}
+
+// Fill the next batch with the objects of the snapshot that are still in the object table. Returns the number of objects in the batch (0 at the end of the snapshot).
+static size_t Memory_Profiler_Capture_each_object_batch(struct Memory_Profiler_Capture *capture, struct Memory_Profiler_Each_Object_Arguments *arguments) {
+	struct Memory_Profiler_Capture_Snapshot *snapshot = &arguments->snapshot;
+	
+	snapshot->batch_count = 0;
+	
+	while (snapshot->batch_count == 0 && snapshot->position < snapshot->count) {
+		Memory_Profiler_Capture_drain_events();
+		
+		// Nothing allocates from here on, so no GC can run until the batch is filled, after which it is pinned by the mark function:
+		while (snapshot->batch_count < MEMORY_PROFILER_CAPTURE_SNAPSHOT_BATCH && snapshot->position < snapshot->count) {
+			VALUE object = snapshot->objects[snapshot->position++];
+			if (!object) continue;
+			
+			struct Memory_Profiler_Object_Table_Entry *entry = Memory_Profiler_Object_Table_lookup(capture->states, object);
+			if (!entry || (arguments->id && entry->klass != arguments->id)) continue;
+			
+			snapshot->batch[snapshot->batch_count++] = object;
+			RB_OBJ_WRITTEN(arguments->self, Qundef, object);
+		}
+	}
+	
+	return snapshot->batch_count;
+}
+
+// Copy the addresses of the objects matching arguments->id into a snapshot, and run the body over it (see each_object). Returns Qundef without running the body if there is nothing to iterate.
+static VALUE Memory_Profiler_Capture_iterate(struct Memory_Profiler_Capture *capture, struct Memory_Profiler_Each_Object_Arguments *arguments, VALUE (*body)(VALUE)) {
+	// Process all pending events to clean up stale entries:
+	Memory_Profiler_Capture_drain_events();
+	
+	struct Memory_Profiler_Object_Table *states = capture->states;
+	if (!states) return Qundef;
+	
+	uint32_t id = arguments->id;
+	
+	// Count the objects to copy, walking the class's list when filtering, so the cost is proportional to the class's objects rather than the table's capacity:
+	size_t count = 0;
+	if (id) {
+		for (struct Memory_Profiler_Object_Table_Entry *entry = Memory_Profiler_Object_Table_first(states, id); entry; entry = Memory_Profiler_Object_Table_next(states, entry)) {
+			count++;
+		}
+	} else {
+		count = states->count;
+	}
+	
+	if (count == 0) return Qundef;
+	
+	// System malloc, so no GC can run while the snapshot is taken:
+	VALUE *objects = malloc(count * sizeof(VALUE));
+	if (!objects) {
+		rb_raise(rb_eNoMemError, "Failed to allocate each_object snapshot");
+	}
+	
+	size_t position = 0;
+	if (id) {
+		for (struct Memory_Profiler_Object_Table_Entry *entry = Memory_Profiler_Object_Table_first(states, id); entry; entry = Memory_Profiler_Object_Table_next(states, entry)) {
+			if (Memory_Profiler_Capture_detached_p(entry->object)) continue;
+			
+			objects[position++] = entry->object;
+		}
+	} else {
+		for (size_t i = 0; i < states->capacity && position < count; i++) {
+			VALUE object = states->entries[i].object;
+			
+			// Skip empty or deleted slots (0 = not set, Qnil = deleted)
+			if (object == 0 || object == Qnil) continue;
+			
+			// Skip freed objects waiting for their FREEOBJ to be processed:
+			if (Memory_Profiler_Capture_detached_p(object)) continue;
+			
+			objects[position++] = object;
+		}
+	}
+	
+	arguments->snapshot = (struct Memory_Profiler_Capture_Snapshot){
+		.objects = objects,
+		.count = position,
+		.next = capture->snapshots,
+	};
+	
+	// Register the snapshot, so its addresses are updated by compaction and its batch is pinned:
+	capture->snapshots = &arguments->snapshot;
+	
+	// Use rb_ensure to guarantee cleanup even if exception is raised
+	return rb_ensure(
+		body, (VALUE)arguments,
+		Memory_Profiler_Capture_each_object_ensure, (VALUE)arguments
+	);
+}
+
+// Main iteration function
+static VALUE Memory_Profiler_Capture_each_object_body(VALUE arg) {
+	struct Memory_Profiler_Each_Object_Arguments *arguments = (struct Memory_Profiler_Each_Object_Arguments *)arg;
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(arguments->self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	size_t count;
+	while ((count = Memory_Profiler_Capture_each_object_batch(capture, arguments))) {
+		for (size_t i = 0; i < count; i++) {
+			VALUE object = arguments->snapshot.batch[i];
+			
+			// The block may have removed entries (e.g. by untracking the class), so check again:
+			struct Memory_Profiler_Object_Table_Entry *entry = Memory_Profiler_Object_Table_lookup(capture->states, object);
+			if (!entry || (arguments->id && entry->klass != arguments->id)) continue;
+			
+			// Look up allocations by class id
+			VALUE allocations = Qnil;
+			struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Classes_get(&capture->tracked, entry->klass);
+			if (record) {
+				allocations = Memory_Profiler_Capture_allocations(arguments->self, record);
+			}
+			
+			rb_yield_values(2, object, allocations);
+		}
+	}
+	
+	return arguments->self;
+}
+
+// Iterate over tracked object IDs, optionally filtered by class
+// Called as: 
+//   capture.each_object(String) { |object_id, state| ... }  # Specific class
+//   capture.each_object { |object_id, state| ... }          // All objects
+// 
+// Yields object_id as Integer. Caller can:
+//   - Format as hex: "0x%x" % object_id
+//   - Convert to object with ObjectSpace._id2ref (may raise RangeError if recycled)
+// Future-proof for Ruby 3.5 where _id2ref is deprecated
+// 
+// GC keeps running while the block runs: the addresses of the matching objects are copied into a snapshot, and checked against the object table in batches before being yielded. Objects freed in the meantime are skipped, and objects allocated in the meantime are not visited.
+static VALUE Memory_Profiler_Capture_each_object(int argc, VALUE *argv, VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	VALUE klass;
+	rb_scan_args(argc, argv, "01", &klass);
 	
 	RETURN_ENUMERATOR(self, argc, argv);
 	
-	// If class provided, look up its allocations wrapper
-	VALUE allocations = Qnil;
+	// If class provided, look up its id
+	uint32_t id = 0;
 	if (!NIL_P(klass)) {
-		st_data_t allocations_data;
-		if (st_lookup(capture->tracked, (st_data_t)klass, &allocations_data)) {
-			allocations = (VALUE)allocations_data;
+		struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Classes_lookup(&capture->tracked, klass);
+		if (record) {
+			id = record->id;
 		} else {
 			// Class not tracked - nothing to iterate:
 			return self;
 		}
 	}
+	
+	// Setup arguments for iteration
+	struct Memory_Profiler_Each_Object_Arguments arguments = {
+		.self = self,
+		.id = id,
+	};
+	
+	Memory_Profiler_Capture_iterate(capture, &arguments, Memory_Profiler_Capture_each_object_body);
+	
+	return self;
+}
 
-	// Disable GC to prevent objects from being collected during iteration
-	// rb_gc_disable returns Qfalse if GC was enabled before, Qtrue if GC was disabled before
-	int gc_was_enabled = (rb_gc_disable() == Qfalse);
+// Record written by export_objects, in native byte order (String#unpack("QLLQ")).
+struct Memory_Profiler_Capture_Export_Record {
+	// The address of the object, as used by ObjectSpace.dump_all:
+	uint64_t address;
 	
-	// Process all pending events to clean up stale entries:
-	Memory_Profiler_Events_process_all();
-	// At this point, all remaining objects in the table should be valid.
+	// The class id, see Capture#classes:
+	uint32_t klass;
+	
+	// The number of garbage collections that had run when the allocation was recorded (compare with GC.count):
+	uint32_t epoch;
+	
+	// The size of the object in bytes, as reported by ObjectSpace.memsize_of (0 if unavailable):
+	uint64_t size;
+};
+
+static VALUE Memory_Profiler_Capture_export_objects_body(VALUE arg) {
+	struct Memory_Profiler_Each_Object_Arguments *arguments = (struct Memory_Profiler_Each_Object_Arguments *)arg;
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(arguments->self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	struct Memory_Profiler_Capture_Export_Record records[MEMORY_PROFILER_CAPTURE_SNAPSHOT_BATCH];
+	
+	size_t count;
+	while (arguments->count < arguments->limit && (count = Memory_Profiler_Capture_each_object_batch(capture, arguments))) {
+		size_t size = 0;
+		
+		for (size_t i = 0; i < count && arguments->count < arguments->limit; i++) {
+			VALUE object = arguments->snapshot.batch[i];
+			
+			struct Memory_Profiler_Object_Table_Entry *entry = Memory_Profiler_Object_Table_lookup(capture->states, object);
+			if (!entry) continue;
+			
+			struct Memory_Profiler_Capture_Export_Record *record = &records[size++];
+			record->address = (uint64_t)object;
+			record->klass = entry->klass;
+			record->epoch = Memory_Profiler_Object_Table_record(capture->states, entry)->epoch;
+#ifdef HAVE_RB_OBJ_MEMSIZE_OF
+			record->size = rb_obj_memsize_of(object);
+#else
+			record->size = 0;
+#endif
+			
+			arguments->count++;
+		}
+		
+		// One String per batch at most, rather than one per object:
+		if (NIL_P(arguments->io)) {
+			rb_str_cat(arguments->output, (const char *)records, size * sizeof(*records));
+		} else {
+			rb_io_write(arguments->io, rb_str_new((const char *)records, size * sizeof(*records)));
+		}
+	}
+	
+	return Qnil;
+}
+
+// Export the tracked objects as packed binary records, optionally filtered by class, without allocating per object.
+// Called as:
+//   capture.export_objects(String, limit: 1000)  # => "\x..." (24 bytes per object)
+//   capture.export_objects(io: file)             # => number of records written
+// 
+// Each record is (address, class id, epoch, size), see struct Memory_Profiler_Capture_Export_Record.
+static VALUE Memory_Profiler_Capture_export_objects(int argc, VALUE *argv, VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	VALUE klass, options;
+	rb_scan_args(argc, argv, "01:", &klass, &options);
+	
+	static ID keywords[2];
+	if (!keywords[0]) {
+		keywords[0] = rb_intern("limit");
+		keywords[1] = rb_intern("io");
+	}
+	
+	VALUE values[2] = {Qundef, Qundef};
+	if (!NIL_P(options)) {
+		rb_get_kwargs(options, keywords, 0, 2, values);
+	}
 	
-	// Setup arguments for iteration
 	struct Memory_Profiler_Each_Object_Arguments arguments = {
 		.self = self,
-		.allocations = allocations,
-		.gc_was_enabled = gc_was_enabled
+		.id = 0,
+		.output = Qnil,
+		.io = values[1] == Qundef ? Qnil : values[1],
+		.limit = SIZE_MAX,
+		.count = 0,
 	};
 	
-	// Use rb_ensure to guarantee cleanup even if exception is raised
-	return rb_ensure(
-		Memory_Profiler_Capture_each_object_body, (VALUE)&arguments,
-		Memory_Profiler_Capture_each_object_ensure, (VALUE)&arguments
-	);
+	if (values[0] != Qundef && !NIL_P(values[0])) {
+		long limit = NUM2LONG(values[0]);
+		if (limit < 0) rb_raise(rb_eArgError, "negative limit");
+		arguments.limit = (size_t)limit;
+	}
+	
+	if (NIL_P(arguments.io)) {
+		arguments.output = rb_str_buf_new(0);
+	}
+	
+	if (!NIL_P(klass)) {
+		struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Classes_lookup(&capture->tracked, klass);
+		
+		// Class not tracked - nothing to export:
+		if (!record) {
+			return NIL_P(arguments.io) ? arguments.output : INT2FIX(0);
+		}
+		
+		arguments.id = record->id;
+	}
+	
+	Memory_Profiler_Capture_iterate(capture, &arguments, Memory_Profiler_Capture_export_objects_body);
+	
+	return NIL_P(arguments.io) ? arguments.output : SIZET2NUM(arguments.count);
+}
+
+// Map class ids (as used by export_objects) to classes. Ids not in the map belong to Capture#other.
+static VALUE Memory_Profiler_Capture_classes(VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	VALUE classes = rb_hash_new();
+	
+	for (size_t id = 1; id < capture->tracked.records_count; id++) {
+		struct Memory_Profiler_Capture_Allocations *record = capture->tracked.records[id];
+		if (!record || record->id != id || !record->klass) continue;
+		
+		rb_hash_aset(classes, SIZET2NUM(id), record->klass);
+	}
+	
+	return classes;
+}
+
+// Take an immutable snapshot of the per-class counters, for cheap periodic sampling:
+//   previous = capture.snapshot
+//   ...
+//   capture.snapshot.diff(previous, 100)  # => {klass => change in retained count}
+static VALUE Memory_Profiler_Capture_snapshot(VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	return Memory_Profiler_Snapshot_new(&capture->tracked);
+}
+
+// Check that a sampled object is still a live object of the class, without touching the object: a freed object's heap page may have been released. Once events are drained, the object table only holds live objects, even while the capture is stopped (see Memory_Profiler_Capture_watch_frees). Does not allocate.
+static int Memory_Profiler_Capture_sample_valid_p(struct Memory_Profiler_Capture *capture, struct Memory_Profiler_Capture_Allocations *record, VALUE object) {
+	struct Memory_Profiler_Object_Table_Entry *entry = Memory_Profiler_Object_Table_lookup(capture->states, object);
+	return entry && entry->klass == record->id;
+}
+
+// Get a random sample of the live objects of a class (at most SAMPLE_SIZE), without scanning the object table.
+// Called as:
+//   capture.sample_objects(String)  # => [object, ...]
+static VALUE Memory_Profiler_Capture_sample_objects(VALUE self, VALUE klass) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	// Process pending frees, so every sampled object that is still in the table is alive:
+	Memory_Profiler_Capture_drain_events();
+	
+	struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Classes_lookup(&capture->tracked, klass);
+	if (!record) return rb_ary_new();
+	
+	// Copy the objects without allocating, so no GC can free them in the meantime. Once on the machine stack, they are kept alive while the array is created:
+	VALUE objects[MEMORY_PROFILER_ALLOCATIONS_SAMPLES];
+	long count = 0;
+	
+	for (uint32_t i = 0; i < record->samples_count; i++) {
+		VALUE object = record->samples[i];
+		
+		if (Memory_Profiler_Capture_sample_valid_p(capture, record, object)) {
+			objects[count++] = object;
+		}
+	}
+	
+	return rb_ary_new_from_values(count, objects);
+}
+
+// What top ranks classes by.
+enum Memory_Profiler_Capture_Top_By {
+	MEMORY_PROFILER_CAPTURE_TOP_RETAINED,
+	MEMORY_PROFILER_CAPTURE_TOP_ALLOCATED,
+	MEMORY_PROFILER_CAPTURE_TOP_BYTES,
+};
+
+// A class and its value, as ranked by top.
+struct Memory_Profiler_Capture_Top_Entry {
+	VALUE klass;
+	uint32_t id;
+	size_t value;
+};
+
+// Restore the min-heap order below the given index.
+static void Memory_Profiler_Capture_top_sift_down(struct Memory_Profiler_Capture_Top_Entry *heap, size_t count, size_t index) {
+	while (1) {
+		size_t smallest = index, left = 2 * index + 1, right = left + 1;
+		
+		if (left < count && heap[left].value < heap[smallest].value) smallest = left;
+		if (right < count && heap[right].value < heap[smallest].value) smallest = right;
+		if (smallest == index) return;
+		
+		struct Memory_Profiler_Capture_Top_Entry entry = heap[index];
+		heap[index] = heap[smallest];
+		heap[smallest] = entry;
+		index = smallest;
+	}
+}
+
+// Estimate the bytes retained by a class, as its retained count times the average size of its sampled objects. Events must have been drained, so the sampled objects are alive. Does not allocate.
+static size_t Memory_Profiler_Capture_retained_bytes(struct Memory_Profiler_Capture *capture, struct Memory_Profiler_Capture_Allocations *record, size_t retained) {
+#ifdef HAVE_RB_OBJ_MEMSIZE_OF
+	size_t size = 0, count = 0;
+	
+	for (uint32_t i = 0; i < record->samples_count; i++) {
+		VALUE object = record->samples[i];
+		
+		if (Memory_Profiler_Capture_sample_valid_p(capture, record, object)) {
+			size += rb_obj_memsize_of(object);
+			count++;
+		}
+	}
+	
+	return count ? (size_t)((double)size / count * retained) : 0;
+#else
+	return 0;
+#endif
+}
+
+// Select the (at most) k registered classes with the largest non-zero values into the given array, ordered from largest to smallest, returning how many were selected. Does not allocate.
+static size_t Memory_Profiler_Capture_select_top(struct Memory_Profiler_Capture *capture, enum Memory_Profiler_Capture_Top_By by, struct Memory_Profiler_Capture_Top_Entry *heap, size_t k) {
+	size_t count = 0;
+	
+	// Keep the k largest values in a min-heap, so the smallest of them can be replaced in O(log k):
+	struct Memory_Profiler_Classes *classes = &capture->tracked;
+	for (size_t id = 1; id < classes->records_count && k > 0; id++) {
+		struct Memory_Profiler_Capture_Allocations *record = classes->records[id];
+		if (!record || record->id != id || !record->klass) continue;
+		
+		size_t retained = record->free_count > record->new_count ? 0 : record->new_count - record->free_count;
+		size_t value;
+		
+		switch (by) {
+			case MEMORY_PROFILER_CAPTURE_TOP_ALLOCATED: value = record->new_count; break;
+			case MEMORY_PROFILER_CAPTURE_TOP_BYTES: value = Memory_Profiler_Capture_retained_bytes(capture, record, retained); break;
+			default: value = retained; break;
+		}
+		
+		if (value == 0) continue;
+		
+		struct Memory_Profiler_Capture_Top_Entry entry = {record->klass, record->id, value};
+		
+		if (count < k) {
+			// Sift up:
+			size_t index = count++;
+			while (index > 0 && heap[(index - 1) / 2].value > value) {
+				heap[index] = heap[(index - 1) / 2];
+				index = (index - 1) / 2;
+			}
+			heap[index] = entry;
+		} else if (value > heap[0].value) {
+			heap[0] = entry;
+			Memory_Profiler_Capture_top_sift_down(heap, count, 0);
+		}
+	}
+	
+	// Pop the smallest remaining value into the last free position, which sorts the heap from largest to smallest:
+	for (size_t size = count; size > 1; size--) {
+		struct Memory_Profiler_Capture_Top_Entry entry = heap[0];
+		heap[0] = heap[size - 1];
+		heap[size - 1] = entry;
+		Memory_Profiler_Capture_top_sift_down(heap, size - 1, 0);
+	}
+	
+	return count;
+}
+
+// Get the k classes with the largest retained count, allocation count, or (estimated) retained bytes, ordered from largest to smallest. Classes with a value of zero are not included.
+// Called as:
+//   capture.top(20)                    # => [[klass, retained_count], ...]
+//   capture.top(20, by: :allocated)    # => [[klass, new_count], ...]
+//   capture.top(20, by: :bytes)        # => [[klass, bytes], ...]
+// 
+// Bytes are estimated from the sampled objects of each class (see sample_objects), using ObjectSpace.memsize_of.
+static VALUE Memory_Profiler_Capture_top(int argc, VALUE *argv, VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	VALUE limit, options;
+	rb_scan_args(argc, argv, "1:", &limit, &options);
+	
+	static ID keywords[1];
+	if (!keywords[0]) {
+		keywords[0] = rb_intern("by");
+	}
+	
+	VALUE values[1] = {Qundef};
+	if (!NIL_P(options)) {
+		rb_get_kwargs(options, keywords, 0, 1, values);
+	}
+	
+	enum Memory_Profiler_Capture_Top_By by = MEMORY_PROFILER_CAPTURE_TOP_RETAINED;
+	if (values[0] != Qundef) {
+		ID id = rb_sym2id(values[0]);
+		
+		if (id == rb_intern("retained")) by = MEMORY_PROFILER_CAPTURE_TOP_RETAINED;
+		else if (id == rb_intern("allocated")) by = MEMORY_PROFILER_CAPTURE_TOP_ALLOCATED;
+		else if (id == rb_intern("bytes")) by = MEMORY_PROFILER_CAPTURE_TOP_BYTES;
+		else rb_raise(rb_eArgError, "unknown ranking: %+"PRIsVALUE" (expected :retained, :allocated or :bytes)", values[0]);
+	}
+
+#ifndef HAVE_RB_OBJ_MEMSIZE_OF
+	if (by == MEMORY_PROFILER_CAPTURE_TOP_BYTES) {
+		rb_raise(rb_eNotImpError, "ObjectSpace.memsize_of is not available");
+	}
+#endif
+	
+	long k = NUM2LONG(limit);
+	if (k < 0) rb_raise(rb_eArgError, "negative limit");
+	if ((size_t)k > capture->tracked.count) k = (long)capture->tracked.count;
+	if (k == 0) return rb_ary_new();
+	
+	VALUE buffer;
+	struct Memory_Profiler_Capture_Top_Entry *heap = ALLOCV_N(struct Memory_Profiler_Capture_Top_Entry, buffer, k);
+	
+	if (by == MEMORY_PROFILER_CAPTURE_TOP_BYTES) {
+		// Process pending frees, so every sampled object that is still in the table is alive:
+		Memory_Profiler_Capture_drain_events();
+	}
+	
+	size_t count = Memory_Profiler_Capture_select_top(capture, by, heap, k);
+	
+	// The classes are pinned by the registry, which can't change while the result is built:
+	VALUE result = rb_ary_new_capa(count);
+	for (size_t i = 0; i < count; i++) {
+		rb_ary_push(result, rb_assoc_new(heap[i].klass, SIZET2NUM(heap[i].value)));
+	}
+	
+	ALLOCV_END(buffer);
+	
+	return result;
+}
+
+// Metric families written by write_metrics.
+static const struct Memory_Profiler_Capture_Metric {
+	const char *name;
+	const char *type;
+	const char *suffix;
+	const char *help;
+} Memory_Profiler_Capture_metrics[] = {
+	{"allocations", "counter", "_total", "Objects allocated, by class."},
+	{"frees", "counter", "_total", "Objects freed, by class."},
+	{"retained", "gauge", "", "Objects allocated and not yet freed, by class."},
+};
+
+static size_t Memory_Profiler_Capture_metric_value(size_t metric, struct Memory_Profiler_Capture_Allocations *record) {
+	switch (metric) {
+		case 0: return record->new_count;
+		case 1: return record->free_count;
+		default: return record->free_count > record->new_count ? 0 : record->new_count - record->free_count;
+	}
+}
+
+// Write the per-class counters in the OpenMetrics text format (which Prometheus can scrape), to an IO or appended to a String, without creating Ruby objects per class.
+// Called as:
+//   capture.write_metrics(buffer)                          # => buffer
+//   capture.write_metrics(io, prefix: "app_memory", top: 100)
+// 
+// With top:, only the classes with the largest retained counts are written. Otherwise, classes merged because of maximum_classes are written as class="(other)".
+static VALUE Memory_Profiler_Capture_write_metrics(int argc, VALUE *argv, VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	VALUE output, options;
+	rb_scan_args(argc, argv, "1:", &output, &options);
+	
+	static ID keywords[2];
+	if (!keywords[0]) {
+		keywords[0] = rb_intern("prefix");
+		keywords[1] = rb_intern("top");
+	}
+	
+	VALUE values[2] = {Qundef, Qundef};
+	if (!NIL_P(options)) {
+		rb_get_kwargs(options, keywords, 0, 2, values);
+	}
+	
+	VALUE prefix = values[0] == Qundef ? rb_str_new_cstr("memory_profiler") : values[0];
+	
+	struct Memory_Profiler_Metrics metrics;
+	Memory_Profiler_Metrics_initialize(&metrics, output, prefix);
+	
+	// Select the top classes up front, so each family lists the same classes:
+	VALUE buffer = 0;
+	struct Memory_Profiler_Capture_Top_Entry *selected = NULL;
+	size_t count = 0;
+	
+	int limited = values[1] != Qundef && !NIL_P(values[1]);
+	if (limited) {
+		long top = NUM2LONG(values[1]);
+		if (top < 0) rb_raise(rb_eArgError, "negative top");
+		
+		size_t k = (size_t)top;
+		if (k > capture->tracked.count) k = capture->tracked.count;
+		
+		if (k > 0) {
+			selected = ALLOCV_N(struct Memory_Profiler_Capture_Top_Entry, buffer, k);
+			count = Memory_Profiler_Capture_select_top(capture, MEMORY_PROFILER_CAPTURE_TOP_RETAINED, selected, k);
+		}
+	}
+	
+	// Writing to an IO runs Ruby code, which can change the registry, so records are looked up again for every sample:
+	struct Memory_Profiler_Classes *classes = &capture->tracked;
+	for (size_t metric = 0; metric < sizeof(Memory_Profiler_Capture_metrics) / sizeof(*Memory_Profiler_Capture_metrics); metric++) {
+		const struct Memory_Profiler_Capture_Metric *family = &Memory_Profiler_Capture_metrics[metric];
+		Memory_Profiler_Metrics_family(&metrics, family->name, family->type, family->help);
+		
+		if (limited) {
+			for (size_t i = 0; i < count; i++) {
+				struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Classes_get(classes, selected[i].id);
+				if (!record || record->id != selected[i].id || record->klass != selected[i].klass) continue;
+				
+				Memory_Profiler_Metrics_class_sample(&metrics, family->name, family->suffix, record->klass, Memory_Profiler_Capture_metric_value(metric, record));
+			}
+		} else {
+			for (size_t id = 1; id < classes->records_count; id++) {
+				struct Memory_Profiler_Capture_Allocations *record = classes->records[id];
+				if (!record || record->id != id || !record->klass) continue;
+				
+				Memory_Profiler_Metrics_class_sample(&metrics, family->name, family->suffix, record->klass, Memory_Profiler_Capture_metric_value(metric, record));
+			}
+			
+			if (classes->other) {
+				Memory_Profiler_Metrics_sample(&metrics, family->name, family->suffix, "(other)", Memory_Profiler_Capture_metric_value(metric, classes->other));
+			}
+		}
+	}
+	
+	Memory_Profiler_Metrics_finish(&metrics);
+	
+	if (buffer) ALLOCV_END(buffer);
+	
+	RB_GC_GUARD(prefix);
+	
+	return output;
 }
 
 // Get allocations for a specific class
@@ -704,14 +2311,59 @@ static VALUE Memory_Profiler_Capture_aref(VALUE self, VALUE klass) {
 	struct Memory_Profiler_Capture *capture;
 	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
 	
-	st_data_t allocations_data;
-	if (st_lookup(capture->tracked, (st_data_t)klass, &allocations_data)) {
-		return (VALUE)allocations_data;
+	struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Classes_lookup(&capture->tracked, klass);
+	if (record) {
+		return Memory_Profiler_Capture_allocations(self, record);
 	}
 	
 	return Qnil;
 }
 
+// Get the allocations of classes merged because of maximum_classes (nil if none were)
+static VALUE Memory_Profiler_Capture_other(VALUE self) {
+	struct Memory_Profiler_Capture *capture;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Capture, &Memory_Profiler_Capture_type, capture);
+	
+	if (capture->tracked.other) {
+		return Memory_Profiler_Capture_allocations(self, capture->tracked.other);
+	}
+	
+	return Qnil;
+}
+
+// Object table health: occupancy, probe lengths, and how much work resizing and compaction are doing.
+static VALUE Memory_Profiler_Capture_object_table_statistics(struct Memory_Profiler_Object_Table *table) {
+	const struct Memory_Profiler_Object_Table_Statistics *counters = Memory_Profiler_Object_Table_statistics(table);
+	VALUE statistics = rb_hash_new();
+	
+	rb_hash_aset(statistics, ID2SYM(rb_intern("capacity")), SIZET2NUM(table->capacity));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("count")), SIZET2NUM(table->count));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("peak_count")), SIZET2NUM(counters->peak_count));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("tombstones")), SIZET2NUM(table->tombstones));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("load_factor")), DBL2NUM((double)(table->count + table->tombstones) / table->capacity));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("tombstone_ratio")), DBL2NUM((double)table->tombstones / table->capacity));
+	
+	// Trailing empty buckets are omitted, so probes[i] counts lengths in 2**i...2**(i+1):
+	size_t buckets = MEMORY_PROFILER_OBJECT_TABLE_PROBE_BUCKETS;
+	while (buckets > 1 && counters->probes[buckets - 1] == 0) buckets--;
+	
+	VALUE probes = rb_ary_new_capa(buckets);
+	for (size_t i = 0; i < buckets; i++) {
+		rb_ary_push(probes, SIZET2NUM(counters->probes[i]));
+	}
+	rb_hash_aset(statistics, ID2SYM(rb_intern("probes")), probes);
+	
+	rb_hash_aset(statistics, ID2SYM(rb_intern("maximum_probe")), SIZET2NUM(counters->maximum_probe));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("long_probes")), SIZET2NUM(counters->long_probes));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("aborted_probes")), SIZET2NUM(counters->aborted_probes));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("resizes")), SIZET2NUM(counters->resizes));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("compactions")), SIZET2NUM(counters->compactions));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("relocations")), SIZET2NUM(counters->relocations));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("compaction_time")), DBL2NUM(counters->compaction_time / 1e9));
+	
+	return statistics;
+}
+
 // Struct to accumulate statistics during iteration
 struct Memory_Profiler_Allocations_Statistics {
 	size_t total_tracked_objects;
@@ -727,12 +2379,66 @@ static VALUE Memory_Profiler_Capture_statistics(VALUE self) {
 	VALUE statistics = rb_hash_new();
 	
 	// Tracked classes count
-	rb_hash_aset(statistics, ID2SYM(rb_intern("tracked_count")), SIZET2NUM(capture->tracked->num_entries));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("tracked_count")), SIZET2NUM(Memory_Profiler_Classes_size(&capture->tracked)));
+	
+	// Allocation sites seen, while track_sites was enabled
+	rb_hash_aset(statistics, ID2SYM(rb_intern("sites_count")), SIZET2NUM(capture->sites.count ? capture->sites.count - 2 : 0));
+	
+	// Allocating methods seen, while track_methods was enabled
+	rb_hash_aset(statistics, ID2SYM(rb_intern("methods_count")), SIZET2NUM(capture->methods.count ? capture->methods.count - 2 : 0));
+	
+	// Tags seen, while track_tags was enabled
+	rb_hash_aset(statistics, ID2SYM(rb_intern("tags_count")), SIZET2NUM(capture->tags.count ? capture->tags.count - 2 : 0));
+	
+	// Classes merged into "other" because of maximum_classes
+	rb_hash_aset(statistics, ID2SYM(rb_intern("evicted_count")), SIZET2NUM(capture->evicted_count));
 	
 	// Custom object table size
 	size_t states_size = capture->states ? Memory_Profiler_Object_Table_size(capture->states) : 0;
 	rb_hash_aset(statistics, ID2SYM(rb_intern("object_table_size")), SIZET2NUM(states_size));
 	
+	// Heap pages holding objects whose frees we are watching for
+	rb_hash_aset(statistics, ID2SYM(rb_intern("object_pages_size")), SIZET2NUM(Memory_Profiler_Object_Pages_size(&capture->pages)));
+	
+	if (capture->states) {
+		rb_hash_aset(statistics, ID2SYM(rb_intern("object_table")), Memory_Profiler_Capture_object_table_statistics(capture->states));
+	}
+	
+	// The event queue is shared by all captures:
+	rb_hash_aset(statistics, ID2SYM(rb_intern("event_queue")), Memory_Profiler_Events_queue_statistics());
+	
+	if (capture->trace) {
+		rb_hash_aset(statistics, ID2SYM(rb_intern("trace")), Memory_Profiler_Trace_statistics(capture->trace));
+	}
+	
+	// Sampled timing in nanoseconds, once timing_interval has been set:
+	if (capture->timing) {
+		struct Memory_Profiler_Capture_Timing *timing = capture->timing;
+		VALUE timing_statistics = rb_hash_new();
+		
+		rb_hash_aset(timing_statistics, ID2SYM(rb_intern("interval")), timing->interval ? SIZET2NUM(timing->interval) : Qnil);
+		rb_hash_aset(timing_statistics, ID2SYM(rb_intern("hook")), Memory_Profiler_Histogram_to_h(&timing->hook));
+		rb_hash_aset(timing_statistics, ID2SYM(rb_intern("newobj")), Memory_Profiler_Histogram_to_h(&timing->newobj));
+		rb_hash_aset(timing_statistics, ID2SYM(rb_intern("freeobj")), Memory_Profiler_Histogram_to_h(&timing->freeobj));
+		rb_hash_aset(timing_statistics, ID2SYM(rb_intern("table")), Memory_Profiler_Histogram_to_h(&timing->table));
+		
+		// Queue processing is shared by all captures:
+		rb_hash_aset(timing_statistics, ID2SYM(rb_intern("queue")), Memory_Profiler_Events_statistics());
+		
+		rb_hash_aset(statistics, ID2SYM(rb_intern("timing")), timing_statistics);
+	}
+	
+	if (capture->governor.budget > 0) {
+		VALUE governor = rb_hash_new();
+		
+		rb_hash_aset(governor, ID2SYM(rb_intern("budget")), DBL2NUM(capture->governor.budget));
+		rb_hash_aset(governor, ID2SYM(rb_intern("overhead")), DBL2NUM(capture->governor.overhead));
+		rb_hash_aset(governor, ID2SYM(rb_intern("sampling_interval")), SIZET2NUM((size_t)1 << capture->sampling_shift));
+		rb_hash_aset(governor, ID2SYM(rb_intern("adjustments")), SIZET2NUM(capture->governor.adjustments));
+		
+		rb_hash_aset(statistics, ID2SYM(rb_intern("governor")), governor);
+	}
+	
 	return statistics;
 }
 
@@ -770,12 +2476,38 @@ void Init_Memory_Profiler_Capture(VALUE Memory_Profiler)
 	rb_gc_register_mark_object(sym_newobj);
 	rb_gc_register_mark_object(sym_freeobj);
 	
+	id_memory_profiler_tag = rb_intern("memory_profiler_tag");
+	id_memory_profiler_scopes = rb_intern("memory_profiler_scopes");
+	
 	Memory_Profiler_Capture = rb_define_class_under(Memory_Profiler, "Capture", rb_cObject);
 	rb_define_alloc_func(Memory_Profiler_Capture, Memory_Profiler_Capture_alloc);
 	
+	rb_define_const(Memory_Profiler_Capture, "SAMPLE_SIZE", INT2NUM(MEMORY_PROFILER_ALLOCATIONS_SAMPLES));
+	
 	rb_define_method(Memory_Profiler_Capture, "initialize", Memory_Profiler_Capture_initialize, 0);
+	rb_define_method(Memory_Profiler_Capture, "scoped", Memory_Profiler_Capture_scoped_get, 0);
+	rb_define_method(Memory_Profiler_Capture, "scoped=", Memory_Profiler_Capture_scoped_set, 1);
+	rb_define_method(Memory_Profiler_Capture, "measure", Memory_Profiler_Capture_measure, 0);
 	rb_define_method(Memory_Profiler_Capture, "track_all", Memory_Profiler_Capture_track_all_get, 0);
 	rb_define_method(Memory_Profiler_Capture, "track_all=", Memory_Profiler_Capture_track_all_set, 1);
+	rb_define_method(Memory_Profiler_Capture, "track_sites", Memory_Profiler_Capture_track_sites_get, 0);
+	rb_define_method(Memory_Profiler_Capture, "track_sites=", Memory_Profiler_Capture_track_sites_set, 1);
+	rb_define_method(Memory_Profiler_Capture, "track_methods", Memory_Profiler_Capture_track_methods_get, 0);
+	rb_define_method(Memory_Profiler_Capture, "track_methods=", Memory_Profiler_Capture_track_methods_set, 1);
+	rb_define_method(Memory_Profiler_Capture, "track_tags", Memory_Profiler_Capture_track_tags_get, 0);
+	rb_define_method(Memory_Profiler_Capture, "track_tags=", Memory_Profiler_Capture_track_tags_set, 1);
+	rb_define_singleton_method(Memory_Profiler_Capture, "tag", Memory_Profiler_Capture_tag_get, 0);
+	rb_define_singleton_method(Memory_Profiler_Capture, "tag=", Memory_Profiler_Capture_tag_set, 1);
+	rb_define_method(Memory_Profiler_Capture, "maximum_classes", Memory_Profiler_Capture_maximum_classes_get, 0);
+	rb_define_method(Memory_Profiler_Capture, "maximum_classes=", Memory_Profiler_Capture_maximum_classes_set, 1);
+	rb_define_method(Memory_Profiler_Capture, "timing_interval", Memory_Profiler_Capture_timing_interval_get, 0);
+	rb_define_method(Memory_Profiler_Capture, "timing_interval=", Memory_Profiler_Capture_timing_interval_set, 1);
+	rb_define_method(Memory_Profiler_Capture, "sampling_interval", Memory_Profiler_Capture_sampling_interval_get, 0);
+	rb_define_method(Memory_Profiler_Capture, "sampling_interval=", Memory_Profiler_Capture_sampling_interval_set, 1);
+	rb_define_method(Memory_Profiler_Capture, "overhead_budget", Memory_Profiler_Capture_overhead_budget_get, 0);
+	rb_define_method(Memory_Profiler_Capture, "overhead_budget=", Memory_Profiler_Capture_overhead_budget_set, 1);
+	rb_define_method(Memory_Profiler_Capture, "trace", Memory_Profiler_Capture_trace_get, 0);
+	rb_define_method(Memory_Profiler_Capture, "trace=", Memory_Profiler_Capture_trace_set, 1);
 	rb_define_method(Memory_Profiler_Capture, "start", Memory_Profiler_Capture_start, 0);
 	rb_define_method(Memory_Profiler_Capture, "stop", Memory_Profiler_Capture_stop, 0);
 	rb_define_method(Memory_Profiler_Capture, "track", Memory_Profiler_Capture_track, -1);  // -1 to accept block
@@ -783,8 +2515,18 @@ void Init_Memory_Profiler_Capture(VALUE Memory_Profiler)
 	rb_define_method(Memory_Profiler_Capture, "tracking?", Memory_Profiler_Capture_tracking_p, 1);
 	rb_define_method(Memory_Profiler_Capture, "retained_count_of", Memory_Profiler_Capture_retained_count_of, 1);
 	rb_define_method(Memory_Profiler_Capture, "each", Memory_Profiler_Capture_each, 0);
+	rb_define_method(Memory_Profiler_Capture, "each_site", Memory_Profiler_Capture_each_site, 0);
+	rb_define_method(Memory_Profiler_Capture, "each_method", Memory_Profiler_Capture_each_method, 0);
+	rb_define_method(Memory_Profiler_Capture, "each_tag", Memory_Profiler_Capture_each_tag, 0);
 	rb_define_method(Memory_Profiler_Capture, "each_object", Memory_Profiler_Capture_each_object, -1);  // -1 = variable args
+	rb_define_method(Memory_Profiler_Capture, "export_objects", Memory_Profiler_Capture_export_objects, -1);
+	rb_define_method(Memory_Profiler_Capture, "classes", Memory_Profiler_Capture_classes, 0);
+	rb_define_method(Memory_Profiler_Capture, "snapshot", Memory_Profiler_Capture_snapshot, 0);
+	rb_define_method(Memory_Profiler_Capture, "sample_objects", Memory_Profiler_Capture_sample_objects, 1);
+	rb_define_method(Memory_Profiler_Capture, "top", Memory_Profiler_Capture_top, -1);
+	rb_define_method(Memory_Profiler_Capture, "write_metrics", Memory_Profiler_Capture_write_metrics, -1);
 	rb_define_method(Memory_Profiler_Capture, "[]", Memory_Profiler_Capture_aref, 1);
+	rb_define_method(Memory_Profiler_Capture, "other", Memory_Profiler_Capture_other, 0);
 	rb_define_method(Memory_Profiler_Capture, "clear", Memory_Profiler_Capture_clear, 0);
 	rb_define_method(Memory_Profiler_Capture, "statistics", Memory_Profiler_Capture_statistics, 0);
 	rb_define_method(Memory_Profiler_Capture, "new_count", Memory_Profiler_Capture_new_count, 0);
@@ -793,4 +2535,7 @@ void Init_Memory_Profiler_Capture(VALUE Memory_Profiler)
 	
 	// Initialize Allocations class
 	Init_Memory_Profiler_Allocations(Memory_Profiler);
+	
+	// Initialize Snapshot class
+	Init_Memory_Profiler_Snapshot(Memory_Profiler);
 }
@@ -0,0 +1,242 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "classes.h"
+
+static const size_t INITIAL_CAPACITY = 64;
+
+void Memory_Profiler_Classes_initialize(struct Memory_Profiler_Classes *classes) {
+	classes->records = NULL;
+	classes->records_count = 0;
+	classes->records_capacity = 0;
+	classes->count = 0;
+	classes->index = NULL;
+	classes->capacity = 0;
+	classes->free_ids = NULL;
+	classes->free_ids_count = 0;
+	classes->free_ids_capacity = 0;
+	classes->other = NULL;
+}
+
+void Memory_Profiler_Classes_free(struct Memory_Profiler_Classes *classes) {
+	for (size_t id = 1; id < classes->records_count; id++) {
+		struct Memory_Profiler_Capture_Allocations *record = classes->records[id];
+		
+		// Skip the ids of merged classes, which refer to the aggregate record:
+		if (record && record->id == id) {
+			Memory_Profiler_Allocations_release(record);
+		}
+	}
+	
+	xfree(classes->records);
+	xfree(classes->index);
+	xfree(classes->free_ids);
+	
+	Memory_Profiler_Classes_initialize(classes);
+}
+
+// Classes are allocated in runs, so spread consecutive addresses across the index:
+static inline size_t index_of(VALUE klass, size_t mask) {
+	uint64_t hash = ((uint64_t)klass >> 3) * 0x9E3779B97F4A7C15ULL;
+	
+	return (size_t)(hash >> __builtin_clzll(mask)) & mask;
+}
+
+// Find the index slot for a class: either the slot holding it, or the empty slot where it would go.
+static size_t find_slot(struct Memory_Profiler_Classes_Slot *index, size_t capacity, VALUE klass) {
+	size_t mask = capacity - 1;
+	size_t i = index_of(klass, mask);
+	
+	while (index[i].klass && index[i].klass != klass) {
+		i = (i + 1) & mask;
+	}
+	
+	return i;
+}
+
+struct Memory_Profiler_Capture_Allocations* Memory_Profiler_Classes_lookup(struct Memory_Profiler_Classes *classes, VALUE klass) {
+	if (classes->count == 0) return NULL;
+	
+	struct Memory_Profiler_Classes_Slot *slot = &classes->index[find_slot(classes->index, classes->capacity, klass)];
+	
+	return slot->klass ? classes->records[slot->id] : NULL;
+}
+
+// Grow the index, keeping the load factor at or below 1/2.
+static void resize_index(struct Memory_Profiler_Classes *classes) {
+	size_t capacity = classes->capacity ? classes->capacity * 2 : INITIAL_CAPACITY;
+	struct Memory_Profiler_Classes_Slot *index = ZALLOC_N(struct Memory_Profiler_Classes_Slot, capacity);
+	
+	for (size_t i = 0; i < classes->capacity; i++) {
+		if (classes->index[i].klass) {
+			index[find_slot(index, capacity, classes->index[i].klass)] = classes->index[i];
+		}
+	}
+	
+	xfree(classes->index);
+	classes->index = index;
+	classes->capacity = capacity;
+}
+
+// Assign an id to a new record, reusing a reclaimed id if possible.
+static void assign_id(struct Memory_Profiler_Classes *classes, struct Memory_Profiler_Capture_Allocations *record) {
+	if (classes->free_ids_count > 0) {
+		record->id = classes->free_ids[--classes->free_ids_count];
+		classes->records[record->id] = record;
+		return;
+	}
+	
+	if (classes->records_count > MEMORY_PROFILER_CLASSES_MAXIMUM_ID) {
+		Memory_Profiler_Allocations_release(record);
+		rb_raise(rb_eRuntimeError, "Too many tracked classes!");
+	}
+	
+	if (classes->records_count == classes->records_capacity) {
+		classes->records_capacity = classes->records_capacity ? classes->records_capacity * 2 : INITIAL_CAPACITY;
+		REALLOC_N(classes->records, struct Memory_Profiler_Capture_Allocations *, classes->records_capacity);
+		
+		// Reserve id 0 to mean "no class":
+		if (classes->records_count == 0) {
+			classes->records[0] = NULL;
+			classes->records_count = 1;
+		}
+	}
+	
+	record->id = (uint32_t)classes->records_count++;
+	classes->records[record->id] = record;
+}
+
+struct Memory_Profiler_Capture_Allocations* Memory_Profiler_Classes_insert(struct Memory_Profiler_Classes *classes, VALUE klass) {
+	if ((classes->count + 1) * 2 > classes->capacity) {
+		resize_index(classes);
+	}
+	
+	struct Memory_Profiler_Capture_Allocations *record = Memory_Profiler_Allocations_new(klass);
+	assign_id(classes, record);
+	
+	struct Memory_Profiler_Classes_Slot *slot = &classes->index[find_slot(classes->index, classes->capacity, klass)];
+	slot->klass = klass;
+	slot->id = record->id;
+	classes->count++;
+	
+	return record;
+}
+
+// Make an id available for reuse.
+static void free_id(struct Memory_Profiler_Classes *classes, uint32_t id) {
+	if (classes->free_ids_count == classes->free_ids_capacity) {
+		classes->free_ids_capacity = classes->free_ids_capacity ? classes->free_ids_capacity * 2 : INITIAL_CAPACITY;
+		REALLOC_N(classes->free_ids, uint32_t, classes->free_ids_capacity);
+	}
+	
+	classes->free_ids[classes->free_ids_count++] = id;
+}
+
+// Remove the class at the given index slot, shifting later slots of the probe run back so lookups never need tombstones.
+static void remove_slot(struct Memory_Profiler_Classes *classes, size_t i) {
+	size_t mask = classes->capacity - 1;
+	
+	classes->index[i].klass = 0;
+	classes->count--;
+	
+	size_t next = (i + 1) & mask;
+	while (classes->index[next].klass) {
+		size_t home = index_of(classes->index[next].klass, mask);
+		
+		// Move the slot back if the hole lies on its probe path (cyclically between home and next):
+		if (((next - home) & mask) >= ((next - i) & mask)) {
+			classes->index[i] = classes->index[next];
+			classes->index[next].klass = 0;
+			i = next;
+		}
+		
+		next = (next + 1) & mask;
+	}
+}
+
+int Memory_Profiler_Classes_remove(struct Memory_Profiler_Classes *classes, VALUE klass) {
+	if (classes->count == 0) return 0;
+	
+	size_t i = find_slot(classes->index, classes->capacity, klass);
+	if (!classes->index[i].klass) return 0;
+	
+	uint32_t id = classes->index[i].id;
+	Memory_Profiler_Allocations_release(classes->records[id]);
+	classes->records[id] = NULL;
+	free_id(classes, id);
+	
+	remove_slot(classes, i);
+	
+	return 1;
+}
+
+struct Memory_Profiler_Capture_Allocations* Memory_Profiler_Classes_other(struct Memory_Profiler_Classes *classes) {
+	if (!classes->other) {
+		struct Memory_Profiler_Capture_Allocations *other = Memory_Profiler_Allocations_new(0);
+		other->tracked = 1;
+		assign_id(classes, other);
+		classes->other = other;
+	}
+	
+	return classes->other;
+}
+
+void Memory_Profiler_Classes_merge(struct Memory_Profiler_Classes *classes, struct Memory_Profiler_Capture_Allocations *record) {
+	struct Memory_Profiler_Capture_Allocations *other = Memory_Profiler_Classes_other(classes);
+	
+	other->new_count += record->new_count;
+	other->free_count += record->free_count;
+	
+	remove_slot(classes, find_slot(classes->index, classes->capacity, record->klass));
+	
+	classes->records[record->id] = other;
+	Memory_Profiler_Allocations_release(record);
+}
+
+void Memory_Profiler_Classes_reclaim(struct Memory_Profiler_Classes *classes) {
+	for (size_t id = 1; id < classes->records_count; id++) {
+		struct Memory_Profiler_Capture_Allocations *record = classes->records[id];
+		
+		if (record && record->id != id) {
+			classes->records[id] = NULL;
+			free_id(classes, (uint32_t)id);
+		}
+	}
+}
+
+void Memory_Profiler_Classes_mark(struct Memory_Profiler_Classes *classes) {
+	for (size_t id = 1; id < classes->records_count; id++) {
+		struct Memory_Profiler_Capture_Allocations *record = classes->records[id];
+		if (!record || record->id != id) continue;
+		
+		// Pin the class:
+		// - We don't want to re-index the registry if the class moves.
+		// - We don't want objects in `freeobj` to have invalid class pointers (maybe helps).
+		rb_gc_mark(record->klass);
+		
+		// The wrapper (if any) marks the callback, and updates its own location if it moves:
+		if (record->wrapper) {
+			rb_gc_mark_movable(record->wrapper);
+		}
+	}
+}
+
+void Memory_Profiler_Classes_compact(struct Memory_Profiler_Classes *classes, Memory_Profiler_Allocations_live_callback live, void *argument) {
+	for (size_t id = 1; id < classes->records_count; id++) {
+		struct Memory_Profiler_Capture_Allocations *record = classes->records[id];
+		if (!record || record->id != id) continue;
+		
+		Memory_Profiler_Allocations_compact_samples(record, live, argument);
+	}
+}
+
+size_t Memory_Profiler_Classes_size(struct Memory_Profiler_Classes *classes) {
+	return classes->count;
+}
+
+size_t Memory_Profiler_Classes_memsize(const struct Memory_Profiler_Classes *classes) {
+	return classes->capacity * sizeof(struct Memory_Profiler_Classes_Slot)
+		+ classes->records_capacity * sizeof(struct Memory_Profiler_Capture_Allocations *)
+		+ classes->free_ids_capacity * sizeof(uint32_t)
+		+ classes->count * sizeof(struct Memory_Profiler_Capture_Allocations);
+}
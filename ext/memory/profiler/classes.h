@@ -0,0 +1,87 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include "allocations.h"
+
+#include <ruby.h>
+#include <stdint.h>
+
+enum {
+	// Object table entries store class ids in 27 bits:
+	MEMORY_PROFILER_CLASSES_MAXIMUM_ID = (1 << 27) - 1,
+};
+
+// Slot in the class index (klass = 0 means empty).
+struct Memory_Profiler_Classes_Slot {
+	VALUE klass;
+	uint32_t id;
+};
+
+// Registry of tracked classes for a capture.
+// Each class gets a dense id (so object table entries can refer to it in 32 bits) and an allocations record holding its counters. Classes are found through an open-addressed index, and no Ruby object is created per class: the Allocations wrapper is created on demand (see Memory_Profiler_Allocations_wrapper).
+// Lookups do not allocate, so they are safe from event hooks. Classes are pinned by the owner's mark function, so the index never needs rehashing during compaction.
+struct Memory_Profiler_Classes {
+	// Records by id (id 0 is reserved, NULL if unused).
+	// A merged class's id refers to the record it was merged into, until the owner has relabelled its entries and reclaims the id.
+	struct Memory_Profiler_Capture_Allocations **records;
+	size_t records_count;
+	size_t records_capacity;
+	
+	// Reclaimed ids, available for reuse:
+	uint32_t *free_ids;
+	size_t free_ids_count;
+	size_t free_ids_capacity;
+	
+	// Aggregate record for merged classes (NULL until the first merge). It has an id but no class, and is not in the index.
+	struct Memory_Profiler_Capture_Allocations *other;
+	
+	// Number of classes currently registered:
+	size_t count;
+	
+	// Class => id index (capacity is a power of two, or zero if not allocated):
+	struct Memory_Profiler_Classes_Slot *index;
+	size_t capacity;
+};
+
+// Initialize an empty registry (no allocation).
+void Memory_Profiler_Classes_initialize(struct Memory_Profiler_Classes *classes);
+
+// Release all records and free the registry, leaving it empty.
+void Memory_Profiler_Classes_free(struct Memory_Profiler_Classes *classes);
+
+// Find the record for a class, or NULL if it is not registered. Does not allocate.
+struct Memory_Profiler_Capture_Allocations* Memory_Profiler_Classes_lookup(struct Memory_Profiler_Classes *classes, VALUE klass);
+
+// Get the record for an id, or NULL if there is none. Does not allocate.
+static inline struct Memory_Profiler_Capture_Allocations* Memory_Profiler_Classes_get(struct Memory_Profiler_Classes *classes, uint32_t id) {
+	return id < classes->records_count ? classes->records[id] : NULL;
+}
+
+// Register a class, returning its new record. The class must not already be registered. Raises if there are too many classes.
+struct Memory_Profiler_Capture_Allocations* Memory_Profiler_Classes_insert(struct Memory_Profiler_Classes *classes, VALUE klass);
+
+// Remove a class, releasing the registry's reference to its record, and making its id available for reuse. Call once no object table entry refers to it. Returns non-zero if the class was registered.
+int Memory_Profiler_Classes_remove(struct Memory_Profiler_Classes *classes, VALUE klass);
+
+// Get the aggregate record for merged classes, creating it if needed.
+struct Memory_Profiler_Capture_Allocations* Memory_Profiler_Classes_other(struct Memory_Profiler_Classes *classes);
+
+// Remove a registered class, adding its counts to the aggregate record. Its id resolves to the aggregate record until reclaimed.
+void Memory_Profiler_Classes_merge(struct Memory_Profiler_Classes *classes, struct Memory_Profiler_Capture_Allocations *record);
+
+// Make the ids of merged classes available for reuse. Call once no object table entry refers to them.
+void Memory_Profiler_Classes_reclaim(struct Memory_Profiler_Classes *classes);
+
+// Mark the classes (pinned) and any wrappers (movable).
+void Memory_Profiler_Classes_mark(struct Memory_Profiler_Classes *classes);
+
+// Update the sampled objects of each class after compaction, removing the ones that are not alive (see Memory_Profiler_Allocations_compact_samples). Does not allocate.
+void Memory_Profiler_Classes_compact(struct Memory_Profiler_Classes *classes, Memory_Profiler_Allocations_live_callback live, void *argument);
+
+// Number of classes currently registered.
+size_t Memory_Profiler_Classes_size(struct Memory_Profiler_Classes *classes);
+
+// Memory used by the index and records.
+size_t Memory_Profiler_Classes_memsize(const struct Memory_Profiler_Classes *classes);
@@ -22,7 +22,21 @@ struct Memory_Profiler_Events {
 	
 	// Guard flag to prevent recursive processing (0 = not processing, 1 = processing)
 	int processing_flag;
-
+	
+	// The most events waiting to be processed at once:
+	size_t peak_count;
+	
+	// Number of captures with timing enabled (batches are only timed if non-zero):
+	int timing;
+	
+	// When the first event waiting in the available queue was enqueued (0 if unknown):
+	uint64_t enqueued_at;
+	
+	// Nanoseconds per batch, events per batch, and nanoseconds from the first event of a batch being enqueued until the batch is processed:
+	struct Memory_Profiler_Histogram batch_time;
+	struct Memory_Profiler_Histogram batch_size;
+	struct Memory_Profiler_Histogram latency;
+	
 	// Postponed job handle for processing the queue.
 	// Postponed job handles are an extremely limited resource, so we only register one global event queue.
 	rb_postponed_job_handle_t postponed_job_handle;
@@ -58,7 +72,7 @@ static VALUE Memory_Profiler_Events_new(void) {
 	// Initialize both queues for double buffering:
 	Memory_Profiler_Queue_initialize(&events->queues[0], sizeof(struct Memory_Profiler_Event));
 	Memory_Profiler_Queue_initialize(&events->queues[1], sizeof(struct Memory_Profiler_Event));
-
+	
 	// Start with queues[0] available for incoming events, queues[1] for processing (initially empty):
 	events->available = &events->queues[0];
 	events->processing = &events->queues[1];
@@ -79,21 +93,22 @@ static VALUE Memory_Profiler_Events_new(void) {
 	return self;
 }
 
+// The global events instance, created on first use:
+static VALUE Memory_Profiler_Events_global = Qnil;
+static struct Memory_Profiler_Events *Memory_Profiler_Events_global_events = NULL;
+
 // Get the global events instance (internal helper).
 struct Memory_Profiler_Events* Memory_Profiler_Events_instance(void) {
-	static VALUE instance = Qnil;
-	static struct Memory_Profiler_Events *events = NULL;
-
-	if (instance == Qnil) {
-		instance = Memory_Profiler_Events_new();
+	if (Memory_Profiler_Events_global == Qnil) {
+		Memory_Profiler_Events_global = Memory_Profiler_Events_new();
 		
 		// Pin the global events object so it's never GC'd:
-		rb_gc_register_mark_object(instance);
+		rb_gc_register_mark_object(Memory_Profiler_Events_global);
 		
-		TypedData_Get_Struct(instance, struct Memory_Profiler_Events, &Memory_Profiler_Events_type, events);
+		TypedData_Get_Struct(Memory_Profiler_Events_global, struct Memory_Profiler_Events, &Memory_Profiler_Events_type, Memory_Profiler_Events_global_events);
 	}
 	
-	return events;
+	return Memory_Profiler_Events_global_events;
 }
 
 // Helper to mark events in a queue.
@@ -108,7 +123,8 @@ static void Memory_Profiler_Events_mark_queue(struct Memory_Profiler_Queue *queu
 		rb_gc_mark_movable(event->klass);
 		
 		if (event->type == MEMORY_PROFILER_EVENT_TYPE_NEWOBJ) {
-			rb_gc_mark_movable(event->object);
+			// Pin pending allocations: captures index them by address until the event is processed.
+			rb_gc_mark(event->object);
 		}
 	}
 }
@@ -134,7 +150,7 @@ static void Memory_Profiler_Events_compact_queue(struct Memory_Profiler_Queue *q
 		
 		event->capture = rb_gc_location(event->capture);
 		event->klass = rb_gc_location(event->klass);
-
+		
 		if (event->type == MEMORY_PROFILER_EVENT_TYPE_NEWOBJ) {
 			event->object = rb_gc_location(event->object);
 		}
@@ -152,6 +168,25 @@ static void Memory_Profiler_Events_compact(void *ptr) {
 	Memory_Profiler_Events_compact_queue(events->processing, 1);
 }
 
+void Memory_Profiler_Events_each_pending(void (*function)(struct Memory_Profiler_Event *event, void *argument), void *argument) {
+	// Don't create the instance, as this may be called during GC:
+	struct Memory_Profiler_Events *events = Memory_Profiler_Events_global_events;
+	if (!events) return;
+	
+	// The processing queue holds the older events:
+	struct Memory_Profiler_Queue *queues[] = {events->processing, events->available};
+	
+	for (size_t q = 0; q < 2; q++) {
+		for (size_t i = 0; i < queues[q]->count; i++) {
+			struct Memory_Profiler_Event *event = Memory_Profiler_Queue_at(queues[q], i);
+			
+			if (event->type != MEMORY_PROFILER_EVENT_TYPE_NONE) {
+				function(event, argument);
+			}
+		}
+	}
+}
+
 // GC free callback.
 static void Memory_Profiler_Events_free(void *ptr) {
 	struct Memory_Profiler_Events *events = ptr;
@@ -183,14 +218,26 @@ int Memory_Profiler_Events_enqueue(
 	enum Memory_Profiler_Event_Type type,
 	VALUE capture,
 	VALUE klass,
-	VALUE object
+	VALUE object,
+	unsigned int shift,
+	uint32_t attribution
 ) {
 	struct Memory_Profiler_Events *events = Memory_Profiler_Events_instance();
 	
+	if (events->timing && events->available->count == 0) {
+		events->enqueued_at = Memory_Profiler_Histogram_now();
+	}
+	
 	// Always enqueue to the available queue - it won't be touched during processing:
 	struct Memory_Profiler_Event *event = Memory_Profiler_Queue_push(events->available);
 	if (event) {
 		event->type = type;
+		event->shift = shift;
+		event->attribution = attribution;
+		
+		if (events->available->count > events->peak_count) {
+			events->peak_count = events->available->count;
+		}
 		
 		// Use write barriers when storing VALUEs (required for RUBY_TYPED_WB_PROTECTED):
 		RB_OBJ_WRITE(events->self, &event->capture, capture);
@@ -224,6 +271,12 @@ void Memory_Profiler_Events_process_all(void) {
 	Memory_Profiler_Events_process_queue((void *)events);
 }
 
+int Memory_Profiler_Events_pending_p(void) {
+	struct Memory_Profiler_Events *events = Memory_Profiler_Events_instance();
+	
+	return events->available->count > 0;
+}
+
 // Wrapper for rb_protect - processes a single event.
 // rb_protect requires signature: VALUE func(VALUE arg).
 static VALUE Memory_Profiler_Events_process_event_protected(VALUE arg) {
@@ -247,6 +300,16 @@ static void Memory_Profiler_Events_process_queue(void *arg) {
 	// Set processing flag to prevent recursion
 	events->processing_flag = 1;
 	
+	uint64_t started_at = 0;
+	if (events->timing && events->available->count) {
+		started_at = Memory_Profiler_Histogram_now();
+		
+		if (events->enqueued_at) {
+			Memory_Profiler_Histogram_record(&events->latency, started_at - events->enqueued_at);
+		}
+	}
+	events->enqueued_at = 0;
+	
 	if (DEBUG) {
 		fprintf(stderr, "[EVENTS] process_queue START: available_count=%zu processing_count=%zu\n",
 			events->available->count, events->processing->count);
@@ -261,7 +324,7 @@ static void Memory_Profiler_Events_process_queue(void *arg) {
 		fprintf(stderr, "[EVENTS] Queues swapped: processing_count=%zu (was available), available_count=%zu (was processing)\n",
 			events->processing->count, events->available->count);
 	}
-
+	
 	// Process all events in order (maintains NEWOBJ before FREEOBJ for same object):
 	for (size_t i = 0; i < events->processing->count; i++) {
 		struct Memory_Profiler_Event *event = Memory_Profiler_Queue_at(events->processing, i);
@@ -299,6 +362,11 @@ static void Memory_Profiler_Events_process_queue(void *arg) {
 	// Clear the processing queue (which is now empty logically):
 	Memory_Profiler_Queue_clear(events->processing);
 	
+	if (started_at) {
+		Memory_Profiler_Histogram_record(&events->batch_time, Memory_Profiler_Histogram_elapsed(started_at, Memory_Profiler_Histogram_now()));
+		Memory_Profiler_Histogram_record(&events->batch_size, processed_count);
+	}
+	
 	// Clear processing flag
 	events->processing_flag = 0;
 	
@@ -306,3 +374,36 @@ static void Memory_Profiler_Events_process_queue(void *arg) {
 		fprintf(stderr, "[EVENTS] process_queue END: processed %zu events\n", processed_count);
 	}
 }
+
+void Memory_Profiler_Events_timing(int enabled) {
+	struct Memory_Profiler_Events *events = Memory_Profiler_Events_instance();
+	
+	events->timing += enabled ? 1 : -1;
+}
+
+VALUE Memory_Profiler_Events_queue_statistics(void) {
+	struct Memory_Profiler_Events *events = Memory_Profiler_Events_instance();
+	
+	VALUE statistics = rb_hash_new();
+	
+	rb_hash_aset(statistics, ID2SYM(rb_intern("count")), SIZET2NUM(events->available->count));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("peak_count")), SIZET2NUM(events->peak_count));
+	
+	// The queues swap on every batch, so the peak may have been reached by either of them:
+	size_t capacity = events->queues[0].capacity > events->queues[1].capacity ? events->queues[0].capacity : events->queues[1].capacity;
+	rb_hash_aset(statistics, ID2SYM(rb_intern("capacity")), SIZET2NUM(capacity));
+	
+	return statistics;
+}
+
+VALUE Memory_Profiler_Events_statistics(void) {
+	struct Memory_Profiler_Events *events = Memory_Profiler_Events_instance();
+	
+	VALUE statistics = rb_hash_new();
+	
+	rb_hash_aset(statistics, ID2SYM(rb_intern("batch_time")), Memory_Profiler_Histogram_to_h(&events->batch_time));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("batch_size")), Memory_Profiler_Histogram_to_h(&events->batch_size));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("latency")), Memory_Profiler_Histogram_to_h(&events->latency));
+	
+	return statistics;
+}
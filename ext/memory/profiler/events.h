@@ -5,6 +5,9 @@
 
 #include <ruby.h>
 #include "queue.h"
+#include "histogram.h"
+
+#include <stdint.h>
 
 // Event types
 enum Memory_Profiler_Event_Type {
@@ -17,12 +20,18 @@ enum Memory_Profiler_Event_Type {
 struct Memory_Profiler_Event {
 	enum Memory_Profiler_Event_Type type;
 	
+	// For NEWOBJ, when allocations are sampled: the object stands for 2^shift allocations.
+	uint32_t shift : 5;
+	
+	// For NEWOBJ, the id of the allocation's site, method and tag, if any of them is tracked (see attributions.h):
+	uint32_t attribution : 27;
+	
 	// Which Capture instance this event belongs to:
 	VALUE capture;
 	
 	// The class of the allocated object (Qnil for FREEOBJ):
 	VALUE klass;
-
+	
 	// The object pointer being alllocated or freed.
 	VALUE object;
 };
@@ -35,15 +44,34 @@ struct Memory_Profiler_Events* Memory_Profiler_Events_instance(void);
 // object parameter semantics:
 //   - NEWOBJ: the actual object being allocated (queue retains it)
 //   - FREEOBJ: Array with state data for postponed processing
+// shift parameter: for NEWOBJ, the object stands for 2^shift allocations (0 if not sampled)
+// attribution parameter: for NEWOBJ, the allocation's attribution id (0 if nothing is attributed)
 // Returns non-zero on success, zero on failure.
 // Ruby 3.5 compatible: no FL_SEEN_OBJ_ID or object_id needed
 int Memory_Profiler_Events_enqueue(
 	enum Memory_Profiler_Event_Type type,
 	VALUE capture,
 	VALUE klass,
-	VALUE object
+	VALUE object,
+	unsigned int shift,
+	uint32_t attribution
 );
 
+// Call the function for each event waiting to be processed, oldest first. Does not allocate, so it's safe during GC.
+void Memory_Profiler_Events_each_pending(void (*function)(struct Memory_Profiler_Event *event, void *argument), void *argument);
+
 // Process all queued events immediately (flush the queue)
 // Called from Capture stop() to ensure all events are processed before stopping
 void Memory_Profiler_Events_process_all(void);
+
+// Whether any events are waiting to be processed (e.g. enqueued by a GC that ran while processing).
+int Memory_Profiler_Events_pending_p(void);
+
+// Enable (or disable) timing of queue processing, on behalf of a capture. Batches are timed while at least one capture has timing enabled.
+void Memory_Profiler_Events_timing(int enabled);
+
+// The state of the queue, shared by all captures: {count:, peak_count:, capacity:}, where peak_count is the most events that were waiting at once.
+VALUE Memory_Profiler_Events_queue_statistics(void);
+
+// Timing of queue processing, shared by all captures: {batch_time:, batch_size:, latency:} histograms.
+VALUE Memory_Profiler_Events_statistics(void);
@@ -0,0 +1,48 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "histogram.h"
+
+#include <math.h>
+#include <string.h>
+
+uint64_t Memory_Profiler_Histogram_clock_overhead = 0;
+
+void Memory_Profiler_Histogram_calibrate(void) {
+	uint64_t minimum = UINT64_MAX;
+	
+	// The minimum of several back to back reads, so interruptions don't inflate it:
+	for (int i = 0; i < 32; i++) {
+		uint64_t started_at = Memory_Profiler_Histogram_now();
+		uint64_t elapsed = Memory_Profiler_Histogram_now() - started_at;
+		
+		if (elapsed < minimum) minimum = elapsed;
+	}
+	
+	Memory_Profiler_Histogram_clock_overhead = minimum;
+}
+
+void Memory_Profiler_Histogram_clear(struct Memory_Profiler_Histogram *histogram) {
+	memset(histogram, 0, sizeof(*histogram));
+}
+
+VALUE Memory_Profiler_Histogram_to_h(const struct Memory_Profiler_Histogram *histogram) {
+	VALUE hash = rb_hash_new();
+	
+	rb_hash_aset(hash, ID2SYM(rb_intern("count")), ULL2NUM(histogram->count));
+	rb_hash_aset(hash, ID2SYM(rb_intern("total")), ULL2NUM(histogram->total));
+	rb_hash_aset(hash, ID2SYM(rb_intern("maximum")), ULL2NUM(histogram->maximum));
+	rb_hash_aset(hash, ID2SYM(rb_intern("mean")), DBL2NUM(histogram->count ? (double)histogram->total / histogram->count : 0.0));
+	
+	VALUE buckets = rb_hash_new();
+	for (size_t i = 0; i < MEMORY_PROFILER_HISTOGRAM_BUCKETS; i++) {
+		if (histogram->buckets[i]) {
+			// Larger values are counted in the last bucket, so it has no upper bound:
+			VALUE upper_bound = i == MEMORY_PROFILER_HISTOGRAM_BUCKETS - 1 ? DBL2NUM(HUGE_VAL) : ULL2NUM(1ULL << i);
+			rb_hash_aset(buckets, upper_bound, ULL2NUM(histogram->buckets[i]));
+		}
+	}
+	rb_hash_aset(hash, ID2SYM(rb_intern("buckets")), buckets);
+	
+	return hash;
+}
@@ -0,0 +1,59 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <ruby.h>
+#include <stdint.h>
+#include <time.h>
+
+enum {
+	MEMORY_PROFILER_HISTOGRAM_BUCKETS = 40,
+};
+
+// Histogram with power of two buckets: bucket 0 counts zeros, and bucket i counts values in [2^(i-1), 2^i). The last bucket also counts every larger value (about 9 minutes and more, in nanoseconds).
+// Recording does not allocate, so it is safe from event hooks and during GC.
+struct Memory_Profiler_Histogram {
+	uint64_t count;
+	uint64_t total;
+	uint64_t maximum;
+	
+	uint64_t buckets[MEMORY_PROFILER_HISTOGRAM_BUCKETS];
+};
+
+// Monotonic time in nanoseconds, for timing with histograms. Served from the vDSO on Linux, so it's cheap enough to sample in hooks.
+static inline uint64_t Memory_Profiler_Histogram_now(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// The time taken to read the clock, as measured by Memory_Profiler_Histogram_calibrate.
+extern uint64_t Memory_Profiler_Histogram_clock_overhead;
+
+// Measure the time taken to read the clock, so it can be excluded from measurements.
+void Memory_Profiler_Histogram_calibrate(void);
+
+// Nanoseconds elapsed since a time returned by Memory_Profiler_Histogram_now, excluding the cost of reading the clock.
+static inline uint64_t Memory_Profiler_Histogram_elapsed(uint64_t started_at, uint64_t now) {
+	uint64_t elapsed = now - started_at;
+	
+	return elapsed > Memory_Profiler_Histogram_clock_overhead ? elapsed - Memory_Profiler_Histogram_clock_overhead : 0;
+}
+
+static inline void Memory_Profiler_Histogram_record(struct Memory_Profiler_Histogram *histogram, uint64_t value) {
+	size_t bucket = value ? 64 - __builtin_clzll(value) : 0;
+	if (bucket >= MEMORY_PROFILER_HISTOGRAM_BUCKETS) bucket = MEMORY_PROFILER_HISTOGRAM_BUCKETS - 1;
+	
+	histogram->count++;
+	histogram->total += value;
+	if (value > histogram->maximum) histogram->maximum = value;
+	histogram->buckets[bucket]++;
+}
+
+// Reset all counts to zero.
+void Memory_Profiler_Histogram_clear(struct Memory_Profiler_Histogram *histogram);
+
+// Convert to a Hash: {count:, total:, maximum:, mean:, buckets: {upper_bound => count}}. Only buckets with values are included, keyed by their exclusive upper bound, which is Float::INFINITY for the last bucket.
+VALUE Memory_Profiler_Histogram_to_h(const struct Memory_Profiler_Histogram *histogram);
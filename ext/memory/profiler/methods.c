@@ -0,0 +1,130 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "methods.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const size_t INITIAL_CAPACITY = 64;
+
+void Memory_Profiler_Methods_initialize(struct Memory_Profiler_Methods *methods) {
+	methods->methods = NULL;
+	methods->count = 0;
+	methods->capacity = 0;
+	methods->index = NULL;
+	methods->index_capacity = 0;
+}
+
+void Memory_Profiler_Methods_free(struct Memory_Profiler_Methods *methods) {
+	free(methods->methods);
+	free(methods->index);
+	
+	Memory_Profiler_Methods_initialize(methods);
+}
+
+static inline size_t index_of(VALUE defined_class, VALUE name, size_t mask) {
+	uint64_t hash = (((uint64_t)defined_class >> 3) ^ ((uint64_t)name * 31)) * 0x9E3779B97F4A7C15ULL;
+	
+	return (size_t)(hash >> __builtin_clzll(mask)) & mask;
+}
+
+// Find the index slot of a method: either the slot holding it, or the empty slot where it would go.
+static size_t find_slot(struct Memory_Profiler_Methods *methods, uint32_t *index, size_t capacity, VALUE defined_class, VALUE name) {
+	size_t mask = capacity - 1;
+	size_t i = index_of(defined_class, name, mask);
+	
+	while (index[i]) {
+		struct Memory_Profiler_Method *method = &methods->methods[index[i]];
+		if (method->defined_class == defined_class && method->name == name) break;
+		
+		i = (i + 1) & mask;
+	}
+	
+	return i;
+}
+
+// Grow the index, keeping the load factor at or below 1/2.
+static int resize_index(struct Memory_Profiler_Methods *methods) {
+	size_t capacity = methods->index_capacity ? methods->index_capacity * 2 : INITIAL_CAPACITY;
+	uint32_t *index = calloc(capacity, sizeof(uint32_t));
+	if (!index) return 0;
+	
+	for (size_t i = 0; i < methods->index_capacity; i++) {
+		uint32_t id = methods->index[i];
+		
+		if (id) {
+			struct Memory_Profiler_Method *method = &methods->methods[id];
+			index[find_slot(methods, index, capacity, method->defined_class, method->name)] = id;
+		}
+	}
+	
+	free(methods->index);
+	methods->index = index;
+	methods->index_capacity = capacity;
+	
+	return 1;
+}
+
+// Grow the methods array, returns zero if out of memory.
+static int grow(struct Memory_Profiler_Methods *methods) {
+	size_t capacity = methods->capacity ? methods->capacity * 2 : INITIAL_CAPACITY;
+	struct Memory_Profiler_Method *array = realloc(methods->methods, capacity * sizeof(struct Memory_Profiler_Method));
+	if (!array) return 0;
+	
+	methods->methods = array;
+	methods->capacity = capacity;
+	
+	return 1;
+}
+
+uint32_t Memory_Profiler_Methods_intern(struct Memory_Profiler_Methods *methods, VALUE defined_class, VALUE name) {
+	if (methods->count == 0) {
+		if (!grow(methods)) return MEMORY_PROFILER_METHODS_NONE;
+		
+		// The reserved methods have no class or name:
+		memset(methods->methods, 0, 2 * sizeof(struct Memory_Profiler_Method));
+		methods->count = 2;
+	}
+	
+	if (NIL_P(name) || !RTEST(defined_class)) return MEMORY_PROFILER_METHODS_UNKNOWN;
+	
+	if (methods->index_capacity) {
+		uint32_t id = methods->index[find_slot(methods, methods->index, methods->index_capacity, defined_class, name)];
+		if (id) return id;
+	}
+	
+	if (methods->count > UINT32_MAX / 2) return MEMORY_PROFILER_METHODS_UNKNOWN;
+	
+	if (methods->count == methods->capacity && !grow(methods)) {
+		return MEMORY_PROFILER_METHODS_UNKNOWN;
+	}
+	
+	if ((methods->count + 1) * 2 > methods->index_capacity && !resize_index(methods)) {
+		return MEMORY_PROFILER_METHODS_UNKNOWN;
+	}
+	
+	uint32_t id = (uint32_t)methods->count++;
+	methods->methods[id] = (struct Memory_Profiler_Method){.defined_class = defined_class, .name = name};
+	methods->index[find_slot(methods, methods->index, methods->index_capacity, defined_class, name)] = id;
+	
+	return id;
+}
+
+void Memory_Profiler_Methods_clear(struct Memory_Profiler_Methods *methods) {
+	for (size_t id = 0; id < methods->count; id++) {
+		methods->methods[id].new_count = 0;
+		methods->methods[id].free_count = 0;
+	}
+}
+
+void Memory_Profiler_Methods_mark(struct Memory_Profiler_Methods *methods) {
+	for (size_t id = 2; id < methods->count; id++) {
+		rb_gc_mark(methods->methods[id].defined_class);
+		rb_gc_mark(methods->methods[id].name);
+	}
+}
+
+size_t Memory_Profiler_Methods_memsize(const struct Memory_Profiler_Methods *methods) {
+	return methods->capacity * sizeof(struct Memory_Profiler_Method) + methods->index_capacity * sizeof(uint32_t);
+}
@@ -0,0 +1,62 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <ruby.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+	// Allocations not attributed to a method (methods were not tracked):
+	MEMORY_PROFILER_METHODS_NONE = 0,
+	
+	// Allocations outside of any method (e.g. at the top level of a script), or that could not be given a method:
+	MEMORY_PROFILER_METHODS_UNKNOWN = 1,
+};
+
+// A method that allocated objects, and the allocations recorded for it, weighted by sampling.
+struct Memory_Profiler_Method {
+	// The class or module defining the method, and the method's name (a Symbol):
+	VALUE defined_class;
+	VALUE name;
+	
+	size_t new_count;
+	size_t free_count;
+};
+
+// Registry of allocating methods for a capture.
+// Methods are interned from the event hook, so it uses system malloc and never allocates Ruby objects. Methods are found by the identity of their class and name, which are pinned by the owner's mark function. Ids are never reused.
+struct Memory_Profiler_Methods {
+	// Methods by id (ids 0 and 1 are reserved):
+	struct Memory_Profiler_Method *methods;
+	size_t count;
+	size_t capacity;
+	
+	// (class, name) => method id index (capacity is a power of two, or zero if not allocated, 0 = empty):
+	uint32_t *index;
+	size_t index_capacity;
+};
+
+// Initialize an empty registry (no allocation).
+void Memory_Profiler_Methods_initialize(struct Memory_Profiler_Methods *methods);
+
+// Free the registry, leaving it empty.
+void Memory_Profiler_Methods_free(struct Memory_Profiler_Methods *methods);
+
+// Find or create a method (name is a Symbol, or nil outside of a method). Never allocates Ruby objects, so it is safe from event hooks. The owner must issue write barriers for the class and name (RB_OBJ_WRITTEN) as they may now be referenced. Returns MEMORY_PROFILER_METHODS_UNKNOWN if the method can't be created.
+uint32_t Memory_Profiler_Methods_intern(struct Memory_Profiler_Methods *methods, VALUE defined_class, VALUE name);
+
+// Get a method by id, or NULL if there is none. Does not allocate.
+static inline struct Memory_Profiler_Method* Memory_Profiler_Methods_get(struct Memory_Profiler_Methods *methods, uint32_t id) {
+	return id != MEMORY_PROFILER_METHODS_NONE && id < methods->count ? &methods->methods[id] : NULL;
+}
+
+// Reset the counters of every method, keeping the ids.
+void Memory_Profiler_Methods_clear(struct Memory_Profiler_Methods *methods);
+
+// Mark the classes and names (pinned).
+void Memory_Profiler_Methods_mark(struct Memory_Profiler_Methods *methods);
+
+// Memory used by the registry.
+size_t Memory_Profiler_Methods_memsize(const struct Memory_Profiler_Methods *methods);
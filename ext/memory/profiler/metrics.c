@@ -0,0 +1,153 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static void Memory_Profiler_Metrics_flush(struct Memory_Profiler_Metrics *metrics) {
+	if (metrics->length == 0) return;
+	
+	size_t length = metrics->length;
+	metrics->length = 0;
+	
+	if (RB_TYPE_P(metrics->output, T_STRING)) {
+		rb_str_cat(metrics->output, metrics->buffer, length);
+	} else {
+		rb_io_write(metrics->output, rb_str_new(metrics->buffer, length));
+	}
+}
+
+static void Memory_Profiler_Metrics_write(struct Memory_Profiler_Metrics *metrics, const char *data, size_t length) {
+	while (length > 0) {
+		if (metrics->length == MEMORY_PROFILER_METRICS_BUFFER_SIZE) {
+			Memory_Profiler_Metrics_flush(metrics);
+		}
+		
+		size_t available = MEMORY_PROFILER_METRICS_BUFFER_SIZE - metrics->length;
+		size_t size = length < available ? length : available;
+		
+		memcpy(metrics->buffer + metrics->length, data, size);
+		metrics->length += size;
+		data += size;
+		length -= size;
+	}
+}
+
+static inline void Memory_Profiler_Metrics_puts(struct Memory_Profiler_Metrics *metrics, const char *string) {
+	Memory_Profiler_Metrics_write(metrics, string, strlen(string));
+}
+
+// Write a label value, escaping backslashes, double quotes and line feeds.
+static void Memory_Profiler_Metrics_write_label(struct Memory_Profiler_Metrics *metrics, const char *data, size_t length) {
+	size_t start = 0;
+	
+	for (size_t i = 0; i < length; i++) {
+		const char *escape = NULL;
+		
+		switch (data[i]) {
+			case '\\': escape = "\\\\"; break;
+			case '"': escape = "\\\""; break;
+			case '\n': escape = "\\n"; break;
+		}
+		
+		if (escape) {
+			Memory_Profiler_Metrics_write(metrics, data + start, i - start);
+			Memory_Profiler_Metrics_puts(metrics, escape);
+			start = i + 1;
+		}
+	}
+	
+	Memory_Profiler_Metrics_write(metrics, data + start, length - start);
+}
+
+static int Memory_Profiler_Metrics_name_p(const char *name, long length) {
+	if (length == 0) return 0;
+	
+	for (long i = 0; i < length; i++) {
+		char c = name[i];
+		
+		if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == ':') continue;
+		if (i > 0 && c >= '0' && c <= '9') continue;
+		
+		return 0;
+	}
+	
+	return 1;
+}
+
+void Memory_Profiler_Metrics_initialize(struct Memory_Profiler_Metrics *metrics, VALUE output, VALUE prefix) {
+	StringValue(prefix);
+	
+	long length = RSTRING_LEN(prefix);
+	if (length >= MEMORY_PROFILER_METRICS_PREFIX_SIZE || !Memory_Profiler_Metrics_name_p(RSTRING_PTR(prefix), length)) {
+		rb_raise(rb_eArgError, "invalid metric name prefix: %+"PRIsVALUE, prefix);
+	}
+	
+	metrics->output = output;
+	memcpy(metrics->prefix, RSTRING_PTR(prefix), length);
+	metrics->prefix_length = length;
+	metrics->length = 0;
+}
+
+static void Memory_Profiler_Metrics_write_name(struct Memory_Profiler_Metrics *metrics, const char *name) {
+	Memory_Profiler_Metrics_write(metrics, metrics->prefix, metrics->prefix_length);
+	Memory_Profiler_Metrics_puts(metrics, "_");
+	Memory_Profiler_Metrics_puts(metrics, name);
+}
+
+void Memory_Profiler_Metrics_family(struct Memory_Profiler_Metrics *metrics, const char *name, const char *type, const char *help) {
+	Memory_Profiler_Metrics_puts(metrics, "# TYPE ");
+	Memory_Profiler_Metrics_write_name(metrics, name);
+	Memory_Profiler_Metrics_puts(metrics, " ");
+	Memory_Profiler_Metrics_puts(metrics, type);
+	Memory_Profiler_Metrics_puts(metrics, "\n# HELP ");
+	Memory_Profiler_Metrics_write_name(metrics, name);
+	Memory_Profiler_Metrics_puts(metrics, " ");
+	Memory_Profiler_Metrics_puts(metrics, help);
+	Memory_Profiler_Metrics_puts(metrics, "\n");
+}
+
+static void Memory_Profiler_Metrics_write_value(struct Memory_Profiler_Metrics *metrics, size_t value) {
+	char digits[32];
+	int length = snprintf(digits, sizeof(digits), "\"} %zu\n", value);
+	
+	Memory_Profiler_Metrics_write(metrics, digits, length);
+}
+
+void Memory_Profiler_Metrics_class_sample(struct Memory_Profiler_Metrics *metrics, const char *name, const char *suffix, VALUE klass, size_t value) {
+	Memory_Profiler_Metrics_write_name(metrics, name);
+	Memory_Profiler_Metrics_puts(metrics, suffix);
+	Memory_Profiler_Metrics_puts(metrics, "{class=\"");
+	
+	// The name of a named class is cached, so this does not allocate:
+	VALUE path = rb_mod_name(klass);
+	
+	if (NIL_P(path)) {
+		// Anonymous classes are labelled like Class#inspect, so each gets a distinct label:
+		char label[64];
+		int length = snprintf(label, sizeof(label), "#<Class:%p>", (void *)klass);
+		Memory_Profiler_Metrics_write(metrics, label, length);
+	} else {
+		Memory_Profiler_Metrics_write_label(metrics, RSTRING_PTR(path), RSTRING_LEN(path));
+	}
+	
+	Memory_Profiler_Metrics_write_value(metrics, value);
+	
+	RB_GC_GUARD(path);
+	RB_GC_GUARD(klass);
+}
+
+void Memory_Profiler_Metrics_sample(struct Memory_Profiler_Metrics *metrics, const char *name, const char *suffix, const char *label, size_t value) {
+	Memory_Profiler_Metrics_write_name(metrics, name);
+	Memory_Profiler_Metrics_puts(metrics, suffix);
+	Memory_Profiler_Metrics_puts(metrics, "{class=\"");
+	Memory_Profiler_Metrics_puts(metrics, label);
+	Memory_Profiler_Metrics_write_value(metrics, value);
+}
+
+void Memory_Profiler_Metrics_finish(struct Memory_Profiler_Metrics *metrics) {
+	Memory_Profiler_Metrics_puts(metrics, "# EOF\n");
+	Memory_Profiler_Metrics_flush(metrics);
+}
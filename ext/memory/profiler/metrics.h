@@ -0,0 +1,40 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <ruby.h>
+
+enum {
+	MEMORY_PROFILER_METRICS_BUFFER_SIZE = 16 * 1024,
+	MEMORY_PROFILER_METRICS_PREFIX_SIZE = 128,
+};
+
+// Renders metrics in the OpenMetrics text format into a fixed buffer, which is appended to a String, or written to an IO, each time it fills up.
+// Only the flushes allocate (at most one String per buffer when writing to an IO), so rendering costs no Ruby object per sample.
+struct Memory_Profiler_Metrics {
+	// The String to append to, or the IO to write to:
+	VALUE output;
+	
+	// The metric name prefix (copied, so it can't change while rendering):
+	char prefix[MEMORY_PROFILER_METRICS_PREFIX_SIZE];
+	size_t prefix_length;
+	
+	size_t length;
+	char buffer[MEMORY_PROFILER_METRICS_BUFFER_SIZE];
+};
+
+// Initialize a renderer. Raises ArgumentError if the prefix is not a valid metric name.
+void Memory_Profiler_Metrics_initialize(struct Memory_Profiler_Metrics *metrics, VALUE output, VALUE prefix);
+
+// Write the metadata of a metric family. The type is "counter" or "gauge".
+void Memory_Profiler_Metrics_family(struct Memory_Profiler_Metrics *metrics, const char *name, const char *type, const char *help);
+
+// Write a sample of a metric family for a class. The suffix is "_total" for counters, and "" for gauges. May run Ruby code (when flushing to an IO).
+void Memory_Profiler_Metrics_class_sample(struct Memory_Profiler_Metrics *metrics, const char *name, const char *suffix, VALUE klass, size_t value);
+
+// Write a sample of a metric family with a literal class label.
+void Memory_Profiler_Metrics_sample(struct Memory_Profiler_Metrics *metrics, const char *name, const char *suffix, const char *label, size_t value);
+
+// Write the end of the exposition, and flush the buffer.
+void Memory_Profiler_Metrics_finish(struct Memory_Profiler_Metrics *metrics);
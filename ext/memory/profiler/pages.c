@@ -0,0 +1,177 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "pages.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const size_t INITIAL_CAPACITY = 64;
+
+void Memory_Profiler_Object_Pages_initialize(struct Memory_Profiler_Object_Pages *pages) {
+	pages->capacity = 0;
+	pages->count = 0;
+	pages->overflow = 0;
+	pages->directory = NULL;
+}
+
+void Memory_Profiler_Object_Pages_free(struct Memory_Profiler_Object_Pages *pages) {
+	if (pages->directory) {
+		for (size_t i = 0; i < pages->capacity; i++) {
+			free(pages->directory[i]);
+		}
+		
+		free(pages->directory);
+	}
+	
+	Memory_Profiler_Object_Pages_initialize(pages);
+}
+
+static inline uintptr_t page_number(VALUE object) {
+	return (uintptr_t)object >> MEMORY_PROFILER_OBJECT_PAGES_PAGE_SHIFT;
+}
+
+static inline size_t slot_index(VALUE object) {
+	return ((uintptr_t)object & ((1 << MEMORY_PROFILER_OBJECT_PAGES_PAGE_SHIFT) - 1)) >> MEMORY_PROFILER_OBJECT_PAGES_SLOT_SHIFT;
+}
+
+// Pages are mostly allocated in runs, so spread consecutive page numbers across the directory:
+static inline size_t directory_index(uintptr_t number, size_t mask) {
+	return (size_t)((number * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+// Find the directory slot for a page number: either the slot holding it, or the empty slot where it would go.
+static size_t find_slot(struct Memory_Profiler_Object_Pages_Page **directory, size_t capacity, uintptr_t number) {
+	size_t mask = capacity - 1;
+	size_t index = directory_index(number, mask);
+	
+	while (directory[index] && directory[index]->number != number) {
+		index = (index + 1) & mask;
+	}
+	
+	return index;
+}
+
+static struct Memory_Profiler_Object_Pages_Page* find_page(struct Memory_Profiler_Object_Pages *pages, uintptr_t number) {
+	if (pages->count == 0) return NULL;
+	
+	return pages->directory[find_slot(pages->directory, pages->capacity, number)];
+}
+
+// Grow the directory, keeping the load factor at or below 1/2.
+static int resize_directory(struct Memory_Profiler_Object_Pages *pages) {
+	size_t capacity = pages->capacity ? pages->capacity * 2 : INITIAL_CAPACITY;
+	struct Memory_Profiler_Object_Pages_Page **directory = calloc(capacity, sizeof(*directory));
+	
+	if (!directory) return 0;
+	
+	for (size_t i = 0; i < pages->capacity; i++) {
+		struct Memory_Profiler_Object_Pages_Page *page = pages->directory[i];
+		if (page) {
+			directory[find_slot(directory, capacity, page->number)] = page;
+		}
+	}
+	
+	free(pages->directory);
+	pages->directory = directory;
+	pages->capacity = capacity;
+	
+	return 1;
+}
+
+void Memory_Profiler_Object_Pages_add(struct Memory_Profiler_Object_Pages *pages, VALUE object) {
+	if (pages->overflow) return;
+	
+	uintptr_t number = page_number(object);
+	struct Memory_Profiler_Object_Pages_Page *page = find_page(pages, number);
+	
+	if (!page) {
+		if ((pages->count + 1) * 2 > pages->capacity && !resize_directory(pages)) {
+			pages->overflow = 1;
+			return;
+		}
+		
+		page = calloc(1, sizeof(struct Memory_Profiler_Object_Pages_Page));
+		if (!page) {
+			pages->overflow = 1;
+			return;
+		}
+		
+		page->number = number;
+		pages->directory[find_slot(pages->directory, pages->capacity, number)] = page;
+		pages->count++;
+	}
+	
+	size_t slot = slot_index(object);
+	uint64_t bit = (uint64_t)1 << (slot & 63);
+	
+	if (!(page->bits[slot >> 6] & bit)) {
+		page->bits[slot >> 6] |= bit;
+		page->count++;
+	}
+}
+
+// Remove the page at the given directory slot, shifting later entries of the probe run back so lookups never need tombstones.
+static void remove_slot(struct Memory_Profiler_Object_Pages *pages, size_t index) {
+	size_t mask = pages->capacity - 1;
+	
+	free(pages->directory[index]);
+	pages->directory[index] = NULL;
+	pages->count--;
+	
+	size_t next = (index + 1) & mask;
+	while (pages->directory[next]) {
+		struct Memory_Profiler_Object_Pages_Page *page = pages->directory[next];
+		size_t home = directory_index(page->number, mask);
+		
+		// Move the page back if the hole lies on its probe path (cyclically between home and next):
+		if (((next - home) & mask) >= ((next - index) & mask)) {
+			pages->directory[index] = page;
+			pages->directory[next] = NULL;
+			index = next;
+		}
+		
+		next = (next + 1) & mask;
+	}
+}
+
+int Memory_Profiler_Object_Pages_remove(struct Memory_Profiler_Object_Pages *pages, VALUE object) {
+	if (pages->count == 0) return pages->overflow;
+	
+	size_t index = find_slot(pages->directory, pages->capacity, page_number(object));
+	struct Memory_Profiler_Object_Pages_Page *page = pages->directory[index];
+	
+	if (!page) return pages->overflow;
+	
+	size_t slot = slot_index(object);
+	uint64_t bit = (uint64_t)1 << (slot & 63);
+	
+	if (!(page->bits[slot >> 6] & bit)) return pages->overflow;
+	
+	page->bits[slot >> 6] &= ~bit;
+	
+	if (--page->count == 0) {
+		remove_slot(pages, index);
+	}
+	
+	return 1;
+}
+
+int Memory_Profiler_Object_Pages_include_p(struct Memory_Profiler_Object_Pages *pages, VALUE object) {
+	if (pages->overflow) return 1;
+	
+	struct Memory_Profiler_Object_Pages_Page *page = find_page(pages, page_number(object));
+	if (!page) return 0;
+	
+	size_t slot = slot_index(object);
+	return (page->bits[slot >> 6] >> (slot & 63)) & 1;
+}
+
+size_t Memory_Profiler_Object_Pages_size(struct Memory_Profiler_Object_Pages *pages) {
+	return pages->count;
+}
+
+size_t Memory_Profiler_Object_Pages_memsize(const struct Memory_Profiler_Object_Pages *pages) {
+	return pages->capacity * sizeof(struct Memory_Profiler_Object_Pages_Page *)
+		+ pages->count * sizeof(struct Memory_Profiler_Object_Pages_Page);
+}
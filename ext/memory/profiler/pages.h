@@ -0,0 +1,64 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <ruby.h>
+#include <stdint.h>
+
+enum {
+	// Ruby heap pages are 64KiB aligned, and object slots are at least 8 byte aligned:
+	MEMORY_PROFILER_OBJECT_PAGES_PAGE_SHIFT = 16,
+	MEMORY_PROFILER_OBJECT_PAGES_SLOT_SHIFT = 3,
+	
+	MEMORY_PROFILER_OBJECT_PAGES_SLOTS = 1 << (MEMORY_PROFILER_OBJECT_PAGES_PAGE_SHIFT - MEMORY_PROFILER_OBJECT_PAGES_SLOT_SHIFT),
+	MEMORY_PROFILER_OBJECT_PAGES_WORDS = MEMORY_PROFILER_OBJECT_PAGES_SLOTS / 64,
+};
+
+// Membership bitmap for a single heap page.
+struct Memory_Profiler_Object_Pages_Page {
+	// The page number (object address >> PAGE_SHIFT):
+	uintptr_t number;
+	
+	// Number of bits set:
+	size_t count;
+	
+	uint64_t bits[MEMORY_PROFILER_OBJECT_PAGES_WORDS];
+};
+
+// Address membership set keyed by (heap page, slot index).
+// Each page that contains at least one member gets a bitmap, found through a small open-addressed directory, so membership is a directory probe plus a bit test - no per-object hashing or key comparison.
+// Uses system malloc/free (not ruby_xmalloc) so it can be updated from event hooks and during GC.
+struct Memory_Profiler_Object_Pages {
+	// Directory capacity (always a power of two, or zero if not allocated):
+	size_t capacity;
+	
+	// Number of pages in the directory:
+	size_t count;
+	
+	// If an allocation failed, membership can no longer be trusted, so every address is reported as a member:
+	int overflow;
+	
+	struct Memory_Profiler_Object_Pages_Page **directory;
+};
+
+// Initialize an empty set (no allocation).
+void Memory_Profiler_Object_Pages_initialize(struct Memory_Profiler_Object_Pages *pages);
+
+// Free all pages and the directory, leaving an empty set.
+void Memory_Profiler_Object_Pages_free(struct Memory_Profiler_Object_Pages *pages);
+
+// Add an address to the set. May allocate (system malloc).
+void Memory_Profiler_Object_Pages_add(struct Memory_Profiler_Object_Pages *pages, VALUE object);
+
+// Remove an address from the set, returning non-zero if it was a member. Frees the page once it becomes empty.
+int Memory_Profiler_Object_Pages_remove(struct Memory_Profiler_Object_Pages *pages, VALUE object);
+
+// Check if an address is in the set. Does not allocate.
+int Memory_Profiler_Object_Pages_include_p(struct Memory_Profiler_Object_Pages *pages, VALUE object);
+
+// Number of pages currently holding members.
+size_t Memory_Profiler_Object_Pages_size(struct Memory_Profiler_Object_Pages *pages);
+
+// Memory used by the directory and pages.
+size_t Memory_Profiler_Object_Pages_memsize(const struct Memory_Profiler_Object_Pages *pages);
@@ -0,0 +1,255 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "sites.h"
+
+#include <ruby/encoding.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const size_t INITIAL_CAPACITY = 64;
+
+// The path of the unknown site, which is never a valid index:
+static const uint32_t NO_PATH = UINT32_MAX;
+
+void Memory_Profiler_Sites_initialize(struct Memory_Profiler_Sites *sites) {
+	sites->sites = NULL;
+	sites->count = 0;
+	sites->capacity = 0;
+	sites->index = NULL;
+	sites->index_capacity = 0;
+	sites->paths = NULL;
+	sites->paths_count = 0;
+	sites->paths_capacity = 0;
+	sites->paths_size = 0;
+	sites->paths_index = NULL;
+	sites->paths_index_capacity = 0;
+	sites->last_path = NO_PATH;
+}
+
+void Memory_Profiler_Sites_free(struct Memory_Profiler_Sites *sites) {
+	free(sites->sites);
+	free(sites->index);
+	
+	for (size_t i = 0; i < sites->paths_count; i++) {
+		free(sites->paths[i].bytes);
+	}
+	free(sites->paths);
+	free(sites->paths_index);
+	
+	Memory_Profiler_Sites_initialize(sites);
+}
+
+static inline size_t hash_of(uint64_t key, size_t mask) {
+	uint64_t hash = key * 0x9E3779B97F4A7C15ULL;
+	
+	return (size_t)(hash >> __builtin_clzll(mask)) & mask;
+}
+
+static inline uint64_t key_of(uint32_t path, int line) {
+	return ((uint64_t)path << 32) | (uint32_t)line;
+}
+
+// Find the index slot of a site: either the slot holding it, or the empty slot where it would go.
+static size_t find_site(struct Memory_Profiler_Sites *sites, uint32_t *index, size_t capacity, uint32_t path, int line) {
+	size_t mask = capacity - 1;
+	size_t i = hash_of(key_of(path, line), mask);
+	
+	while (index[i]) {
+		struct Memory_Profiler_Site *site = &sites->sites[index[i]];
+		if (site->path == path && site->line == line) break;
+		
+		i = (i + 1) & mask;
+	}
+	
+	return i;
+}
+
+// Hash the bytes of a path (FNV-1a).
+static uint64_t hash_bytes(const char *bytes, size_t length) {
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ (unsigned char)bytes[i]) * 0x100000001B3ULL;
+	}
+	
+	return hash;
+}
+
+static inline int path_equal(struct Memory_Profiler_Sites_Path *path, const char *bytes, size_t length) {
+	return path->length == length && memcmp(path->bytes, bytes, length) == 0;
+}
+
+// Find the index slot of a path, by content: either the slot holding it, or the empty slot where it would go.
+static size_t find_path(struct Memory_Profiler_Sites *sites, uint32_t *index, size_t capacity, uint64_t hash, const char *bytes, size_t length) {
+	size_t mask = capacity - 1;
+	size_t i = hash_of(hash, mask);
+	
+	while (index[i]) {
+		struct Memory_Profiler_Sites_Path *path = &sites->paths[index[i] - 1];
+		if (path->hash == hash && path_equal(path, bytes, length)) break;
+		
+		i = (i + 1) & mask;
+	}
+	
+	return i;
+}
+
+// Grow an array by doubling, returns zero if out of memory.
+static int grow(void **array, size_t *capacity, size_t size) {
+	size_t new_capacity = *capacity ? *capacity * 2 : INITIAL_CAPACITY;
+	void *new_array = realloc(*array, new_capacity * size);
+	if (!new_array) return 0;
+	
+	*array = new_array;
+	*capacity = new_capacity;
+	
+	return 1;
+}
+
+// Grow the site index, keeping the load factor at or below 1/2.
+static int resize_index(struct Memory_Profiler_Sites *sites) {
+	size_t capacity = sites->index_capacity ? sites->index_capacity * 2 : INITIAL_CAPACITY;
+	uint32_t *index = calloc(capacity, sizeof(uint32_t));
+	if (!index) return 0;
+	
+	for (size_t i = 0; i < sites->index_capacity; i++) {
+		uint32_t id = sites->index[i];
+		
+		if (id) {
+			index[find_site(sites, index, capacity, sites->sites[id].path, sites->sites[id].line)] = id;
+		}
+	}
+	
+	free(sites->index);
+	sites->index = index;
+	sites->index_capacity = capacity;
+	
+	return 1;
+}
+
+// Grow the path index, keeping the load factor at or below 1/2.
+static int resize_paths_index(struct Memory_Profiler_Sites *sites) {
+	size_t capacity = sites->paths_index_capacity ? sites->paths_index_capacity * 2 : INITIAL_CAPACITY;
+	uint32_t *index = calloc(capacity, sizeof(uint32_t));
+	if (!index) return 0;
+	
+	for (size_t i = 0; i < sites->paths_count; i++) {
+		struct Memory_Profiler_Sites_Path *path = &sites->paths[i];
+		index[find_path(sites, index, capacity, path->hash, path->bytes, path->length)] = (uint32_t)(i + 1);
+	}
+	
+	free(sites->paths_index);
+	sites->paths_index = index;
+	sites->paths_index_capacity = capacity;
+	
+	return 1;
+}
+
+// Find the path index of a path string, adding a copy of it if it's new. Returns NO_PATH if out of memory.
+static uint32_t intern_path(struct Memory_Profiler_Sites *sites, VALUE string) {
+	const char *bytes = RSTRING_PTR(string);
+	size_t length = (size_t)RSTRING_LEN(string);
+	
+	if (sites->last_path != NO_PATH && path_equal(&sites->paths[sites->last_path], bytes, length)) {
+		return sites->last_path;
+	}
+	
+	uint64_t hash = hash_bytes(bytes, length);
+	
+	if (sites->paths_index_capacity) {
+		uint32_t slot = sites->paths_index[find_path(sites, sites->paths_index, sites->paths_index_capacity, hash, bytes, length)];
+		
+		if (slot) {
+			sites->last_path = slot - 1;
+			return sites->last_path;
+		}
+	}
+	
+	if (sites->paths_count >= UINT32_MAX - 1) return NO_PATH;
+	
+	if ((sites->paths_count + 1) * 2 > sites->paths_index_capacity && !resize_paths_index(sites)) {
+		return NO_PATH;
+	}
+	
+	if (sites->paths_count == sites->paths_capacity && !grow((void**)&sites->paths, &sites->paths_capacity, sizeof(struct Memory_Profiler_Sites_Path))) {
+		return NO_PATH;
+	}
+	
+	char *copy = malloc(length ? length : 1);
+	if (!copy) return NO_PATH;
+	memcpy(copy, bytes, length);
+	
+	uint32_t path = (uint32_t)sites->paths_count++;
+	sites->paths[path] = (struct Memory_Profiler_Sites_Path){.bytes = copy, .length = length, .hash = hash, .encoding = rb_enc_get_index(string)};
+	sites->paths_index[find_path(sites, sites->paths_index, sites->paths_index_capacity, hash, bytes, length)] = path + 1;
+	sites->paths_size += length;
+	
+	sites->last_path = path;
+	
+	return path;
+}
+
+// Add the reserved sites, the first time a site is interned.
+static int reserve(struct Memory_Profiler_Sites *sites) {
+	if (!grow((void**)&sites->sites, &sites->capacity, sizeof(struct Memory_Profiler_Site))) return 0;
+	
+	memset(sites->sites, 0, 2 * sizeof(struct Memory_Profiler_Site));
+	sites->sites[MEMORY_PROFILER_SITES_NONE].path = NO_PATH;
+	sites->sites[MEMORY_PROFILER_SITES_UNKNOWN].path = NO_PATH;
+	sites->count = 2;
+	
+	return 1;
+}
+
+uint32_t Memory_Profiler_Sites_intern(struct Memory_Profiler_Sites *sites, VALUE path, int line) {
+	if (sites->count == 0 && !reserve(sites)) return MEMORY_PROFILER_SITES_NONE;
+	
+	if (!RB_TYPE_P(path, T_STRING)) return MEMORY_PROFILER_SITES_UNKNOWN;
+	
+	uint32_t index = intern_path(sites, path);
+	if (index == NO_PATH) return MEMORY_PROFILER_SITES_UNKNOWN;
+	
+	if (sites->index_capacity) {
+		uint32_t id = sites->index[find_site(sites, sites->index, sites->index_capacity, index, line)];
+		if (id) return id;
+	}
+	
+	if (sites->count > UINT32_MAX / 2) return MEMORY_PROFILER_SITES_UNKNOWN;
+	
+	if (sites->count == sites->capacity && !grow((void**)&sites->sites, &sites->capacity, sizeof(struct Memory_Profiler_Site))) {
+		return MEMORY_PROFILER_SITES_UNKNOWN;
+	}
+	
+	if ((sites->count + 1) * 2 > sites->index_capacity && !resize_index(sites)) {
+		return MEMORY_PROFILER_SITES_UNKNOWN;
+	}
+	
+	uint32_t id = (uint32_t)sites->count++;
+	sites->sites[id] = (struct Memory_Profiler_Site){.path = index, .line = line};
+	sites->index[find_site(sites, sites->index, sites->index_capacity, index, line)] = id;
+	
+	return id;
+}
+
+void Memory_Profiler_Sites_clear(struct Memory_Profiler_Sites *sites) {
+	for (size_t id = 0; id < sites->count; id++) {
+		sites->sites[id].new_count = 0;
+		sites->sites[id].free_count = 0;
+	}
+}
+
+VALUE Memory_Profiler_Sites_path_string(struct Memory_Profiler_Sites *sites, struct Memory_Profiler_Site *site) {
+	struct Memory_Profiler_Sites_Path *path = Memory_Profiler_Sites_path(sites, site);
+	if (!path) return Qnil;
+	
+	return rb_enc_str_new(path->bytes, path->length, rb_enc_from_index(path->encoding));
+}
+
+size_t Memory_Profiler_Sites_memsize(const struct Memory_Profiler_Sites *sites) {
+	return sites->capacity * sizeof(struct Memory_Profiler_Site)
+		+ sites->index_capacity * sizeof(uint32_t)
+		+ sites->paths_capacity * sizeof(struct Memory_Profiler_Sites_Path)
+		+ sites->paths_size
+		+ sites->paths_index_capacity * sizeof(uint32_t);
+}
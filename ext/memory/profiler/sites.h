@@ -0,0 +1,88 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <ruby.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+	// Entries of objects allocated while sites were not tracked:
+	MEMORY_PROFILER_SITES_NONE = 0,
+	
+	// Allocations with no Ruby frame to attribute them to, or that could not be given a site:
+	MEMORY_PROFILER_SITES_UNKNOWN = 1,
+};
+
+// An allocation site (a source line) and the allocations recorded there, weighted by sampling.
+struct Memory_Profiler_Site {
+	// Index of the path in the registry's paths, and the line:
+	uint32_t path;
+	int line;
+	
+	size_t new_count;
+	size_t free_count;
+};
+
+// A distinct source path. The bytes are copied out of the path string, so no strings are retained.
+struct Memory_Profiler_Sites_Path {
+	char *bytes;
+	size_t length;
+	uint64_t hash;
+	int encoding;
+};
+
+// Registry of allocation sites for a capture.
+// Sites are interned from the event hook, so it uses system malloc and never allocates Ruby objects. Source paths are found by content, so every file maps to one path however many strings name it, and the cost of finding a path doesn't depend on the number of paths (code compiled with eval may have a new path string each time). Ids are never reused.
+struct Memory_Profiler_Sites {
+	// Sites by id (ids 0 and 1 are reserved):
+	struct Memory_Profiler_Site *sites;
+	size_t count;
+	size_t capacity;
+	
+	// (path, line) => site id index (capacity is a power of two, or zero if not allocated, 0 = empty):
+	uint32_t *index;
+	size_t index_capacity;
+	
+	// Distinct paths, by content:
+	struct Memory_Profiler_Sites_Path *paths;
+	size_t paths_count;
+	size_t paths_capacity;
+	size_t paths_size; // Bytes copied
+	
+	// Path content => path index + 1 (capacity is a power of two, or zero if not allocated, 0 = empty):
+	uint32_t *paths_index;
+	size_t paths_index_capacity;
+	
+	// The path seen last, as consecutive allocations usually come from the same file:
+	uint32_t last_path;
+};
+
+// Initialize an empty registry (no allocation).
+void Memory_Profiler_Sites_initialize(struct Memory_Profiler_Sites *sites);
+
+// Free the registry, leaving it empty.
+void Memory_Profiler_Sites_free(struct Memory_Profiler_Sites *sites);
+
+// Find or create the site of a source line (path is a String, or nil if there is no Ruby frame). Never allocates Ruby objects, and doesn't retain the path, so it is safe from event hooks. Returns MEMORY_PROFILER_SITES_UNKNOWN if the site can't be created.
+uint32_t Memory_Profiler_Sites_intern(struct Memory_Profiler_Sites *sites, VALUE path, int line);
+
+// Get a site by id, or NULL if there is none. Does not allocate.
+static inline struct Memory_Profiler_Site* Memory_Profiler_Sites_get(struct Memory_Profiler_Sites *sites, uint32_t id) {
+	return id != MEMORY_PROFILER_SITES_NONE && id < sites->count ? &sites->sites[id] : NULL;
+}
+
+// The path of a site, or NULL for the unknown site. Does not allocate.
+static inline struct Memory_Profiler_Sites_Path* Memory_Profiler_Sites_path(struct Memory_Profiler_Sites *sites, struct Memory_Profiler_Site *site) {
+	return site->path < sites->paths_count ? &sites->paths[site->path] : NULL;
+}
+
+// The path of a site as a new String (nil for the unknown site).
+VALUE Memory_Profiler_Sites_path_string(struct Memory_Profiler_Sites *sites, struct Memory_Profiler_Site *site);
+
+// Reset the counters of every site, keeping the ids.
+void Memory_Profiler_Sites_clear(struct Memory_Profiler_Sites *sites);
+
+// Memory used by the registry.
+size_t Memory_Profiler_Sites_memsize(const struct Memory_Profiler_Sites *sites);
@@ -0,0 +1,174 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "snapshot.h"
+
+static VALUE Memory_Profiler_Snapshot = Qnil;
+
+static void Memory_Profiler_Snapshot_mark(void *ptr) {
+	struct Memory_Profiler_Snapshot *snapshot = ptr;
+	
+	for (size_t i = 0; i < snapshot->count; i++) {
+		rb_gc_mark_movable(snapshot->entries[i].klass);
+	}
+}
+
+static void Memory_Profiler_Snapshot_compact(void *ptr) {
+	struct Memory_Profiler_Snapshot *snapshot = ptr;
+	
+	for (size_t i = 0; i < snapshot->count; i++) {
+		snapshot->entries[i].klass = rb_gc_location(snapshot->entries[i].klass);
+	}
+}
+
+static void Memory_Profiler_Snapshot_free(void *ptr) {
+	struct Memory_Profiler_Snapshot *snapshot = ptr;
+	
+	xfree(snapshot->entries);
+	xfree(snapshot);
+}
+
+static size_t Memory_Profiler_Snapshot_memsize(const void *ptr) {
+	const struct Memory_Profiler_Snapshot *snapshot = ptr;
+	
+	return sizeof(struct Memory_Profiler_Snapshot) + snapshot->count * sizeof(struct Memory_Profiler_Snapshot_Entry);
+}
+
+static const rb_data_type_t Memory_Profiler_Snapshot_type = {
+	"Memory::Profiler::Snapshot",
+	{
+		.dmark = Memory_Profiler_Snapshot_mark,
+		.dcompact = Memory_Profiler_Snapshot_compact,
+		.dfree = Memory_Profiler_Snapshot_free,
+		.dsize = Memory_Profiler_Snapshot_memsize,
+	},
+	0, 0, RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED
+};
+
+static inline size_t Memory_Profiler_Snapshot_retained(const struct Memory_Profiler_Snapshot_Entry *entry) {
+	// Handle underflow when free_count > new_count:
+	return entry->free_count > entry->new_count ? 0 : entry->new_count - entry->free_count;
+}
+
+VALUE Memory_Profiler_Snapshot_new(struct Memory_Profiler_Classes *classes) {
+	struct Memory_Profiler_Snapshot *snapshot;
+	VALUE self = TypedData_Make_Struct(Memory_Profiler_Snapshot, struct Memory_Profiler_Snapshot, &Memory_Profiler_Snapshot_type, snapshot);
+	
+	// The registry only changes when events are processed, which can't happen while we allocate:
+	snapshot->entries = ALLOC_N(struct Memory_Profiler_Snapshot_Entry, classes->count ? classes->count : 1);
+	
+	for (size_t id = 1; id < classes->records_count && snapshot->count < classes->count; id++) {
+		struct Memory_Profiler_Capture_Allocations *record = classes->records[id];
+		if (!record || record->id != id || !record->klass) continue;
+		
+		snapshot->entries[snapshot->count++] = (struct Memory_Profiler_Snapshot_Entry){
+			.klass = record->klass,
+			.id = record->id,
+			.new_count = record->new_count,
+			.free_count = record->free_count,
+		};
+		RB_OBJ_WRITTEN(self, Qundef, record->klass);
+	}
+	
+	rb_obj_freeze(self);
+	
+	return self;
+}
+
+static struct Memory_Profiler_Snapshot* Memory_Profiler_Snapshot_get(VALUE self) {
+	struct Memory_Profiler_Snapshot *snapshot;
+	TypedData_Get_Struct(self, struct Memory_Profiler_Snapshot, &Memory_Profiler_Snapshot_type, snapshot);
+	return snapshot;
+}
+
+// Snapshot#size
+static VALUE Memory_Profiler_Snapshot_size(VALUE self) {
+	return SIZET2NUM(Memory_Profiler_Snapshot_get(self)->count);
+}
+
+// Snapshot#each {|klass, new_count, free_count, retained_count| ...}
+static VALUE Memory_Profiler_Snapshot_each(VALUE self) {
+	RETURN_SIZED_ENUMERATOR(self, 0, 0, Memory_Profiler_Snapshot_size);
+	
+	struct Memory_Profiler_Snapshot *snapshot = Memory_Profiler_Snapshot_get(self);
+	
+	for (size_t i = 0; i < snapshot->count; i++) {
+		const struct Memory_Profiler_Snapshot_Entry *entry = &snapshot->entries[i];
+		
+		rb_yield_values(4, entry->klass, SIZET2NUM(entry->new_count), SIZET2NUM(entry->free_count), SIZET2NUM(Memory_Profiler_Snapshot_retained(entry)));
+	}
+	
+	return self;
+}
+
+// Record the change in retained count of a class.
+static void Memory_Profiler_Snapshot_add_delta(VALUE changes, VALUE klass, long long delta) {
+	// Unchanged classes would only be filtered out again:
+	if (delta == 0) return;
+	
+	// A class that was untracked and tracked again has a new id, and may appear twice:
+	VALUE existing = rb_hash_lookup2(changes, klass, Qundef);
+	if (existing != Qundef) {
+		delta += NUM2LL(existing);
+	}
+	
+	rb_hash_aset(changes, klass, LL2NUM(delta));
+}
+
+// Remove the classes whose total change is not more than the threshold.
+static int Memory_Profiler_Snapshot_filter_delta(VALUE klass, VALUE delta_value, VALUE threshold_value) {
+	long long delta = NUM2LL(delta_value);
+	long long threshold = NUM2LL(threshold_value);
+	
+	return (delta <= threshold && -delta <= threshold) ? ST_DELETE : ST_CONTINUE;
+}
+
+// Snapshot#diff(other, threshold = 0)
+// Compare with an earlier snapshot of the same capture, returning {klass => change in retained count} for the classes whose retained count changed by more than the threshold. Classes missing from either snapshot count as zero.
+static VALUE Memory_Profiler_Snapshot_diff(int argc, VALUE *argv, VALUE self) {
+	VALUE other_value, threshold_value;
+	rb_scan_args(argc, argv, "11", &other_value, &threshold_value);
+	
+	struct Memory_Profiler_Snapshot *snapshot = Memory_Profiler_Snapshot_get(self);
+	struct Memory_Profiler_Snapshot *other = Memory_Profiler_Snapshot_get(other_value);
+	long long threshold = NIL_P(threshold_value) ? 0 : NUM2LL(threshold_value);
+	
+	VALUE changes = rb_hash_new();
+	
+	// Both are ordered by id, so merge them in a single pass:
+	size_t i = 0, j = 0;
+	while (i < snapshot->count || j < other->count) {
+		const struct Memory_Profiler_Snapshot_Entry *current = i < snapshot->count ? &snapshot->entries[i] : NULL;
+		const struct Memory_Profiler_Snapshot_Entry *previous = j < other->count ? &other->entries[j] : NULL;
+		
+		if (current && previous && current->id == previous->id && current->klass == previous->klass) {
+			Memory_Profiler_Snapshot_add_delta(changes, current->klass, (long long)Memory_Profiler_Snapshot_retained(current) - (long long)Memory_Profiler_Snapshot_retained(previous));
+			i++, j++;
+		} else if (current && (!previous || current->id <= previous->id)) {
+			// The id was reused by a different class, or the class is new:
+			Memory_Profiler_Snapshot_add_delta(changes, current->klass, (long long)Memory_Profiler_Snapshot_retained(current));
+			i++;
+		} else {
+			Memory_Profiler_Snapshot_add_delta(changes, previous->klass, -(long long)Memory_Profiler_Snapshot_retained(previous));
+			j++;
+		}
+	}
+	
+	// The threshold applies to the total change of each class, once all of its ids have been added:
+	rb_hash_foreach(changes, Memory_Profiler_Snapshot_filter_delta, LL2NUM(threshold));
+	
+	RB_GC_GUARD(other_value);
+	
+	return changes;
+}
+
+void Init_Memory_Profiler_Snapshot(VALUE Memory_Profiler)
+{
+	// Snapshot class - immutable per-class counters, created by Capture#snapshot
+	Memory_Profiler_Snapshot = rb_define_class_under(Memory_Profiler, "Snapshot", rb_cObject);
+	rb_undef_alloc_func(Memory_Profiler_Snapshot);
+	
+	rb_define_method(Memory_Profiler_Snapshot, "size", Memory_Profiler_Snapshot_size, 0);
+	rb_define_method(Memory_Profiler_Snapshot, "each", Memory_Profiler_Snapshot_each, 0);
+	rb_define_method(Memory_Profiler_Snapshot, "diff", Memory_Profiler_Snapshot_diff, -1);
+}
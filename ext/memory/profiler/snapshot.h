@@ -0,0 +1,30 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include "classes.h"
+
+#include <ruby.h>
+#include <stdint.h>
+
+// The counters of one class when the snapshot was taken.
+struct Memory_Profiler_Snapshot_Entry {
+	VALUE klass;
+	uint32_t id;
+	size_t new_count;
+	size_t free_count;
+};
+
+// Immutable copy of the per-class counters of a capture, so successive samples can be compared natively.
+struct Memory_Profiler_Snapshot {
+	// Ordered by class id:
+	struct Memory_Profiler_Snapshot_Entry *entries;
+	size_t count;
+};
+
+// Create a (frozen) Snapshot of the classes in a registry. Classes merged into "other" are not included.
+VALUE Memory_Profiler_Snapshot_new(struct Memory_Profiler_Classes *classes);
+
+// Initialize the Snapshot class.
+void Init_Memory_Profiler_Snapshot(VALUE Memory_Profiler);
@@ -4,16 +4,14 @@
 #include "table.h"
 #include <stdlib.h>
 #include <string.h>
-#include <stdio.h>
+#include <time.h>
 
 enum {
-	DEBUG = 1,
-	
 	// Performance monitoring thresholds
-
-	// Log warning if probe chain exceeds this
+	
+	// Count as a long probe chain if it reaches this
 	WARN_PROBE_LENGTH = 100,
-
+	
 	// Safety limit - abort search if exceeded
 	MAX_PROBE_LENGTH = 10000,
 };
@@ -34,7 +32,12 @@ struct Memory_Profiler_Object_Table* Memory_Profiler_Object_Table_new(size_t ini
 		return NULL;
 	}
 	
-	table->capacity = initial_capacity > 0 ? initial_capacity : INITIAL_CAPACITY;
+	// Round up to a power of two, so slots can be found by masking:
+	size_t capacity = initial_capacity > 0 ? initial_capacity : INITIAL_CAPACITY;
+	table->capacity = 2;
+	while (table->capacity < capacity) {
+		table->capacity <<= 1;
+	}
 	table->count = 0;
 	table->tombstones = 0;
 	
@@ -46,6 +49,19 @@ struct Memory_Profiler_Object_Table* Memory_Profiler_Object_Table_new(size_t ini
 		return NULL;
 	}
 	
+	// Values are allocated on first use:
+	table->values = NULL;
+	table->values_capacity = 0;
+	table->values_count = 0;
+	table->free_values = NULL;
+	table->free_values_count = 0;
+	
+	// Class lists are allocated on first use:
+	table->lists = NULL;
+	table->lists_capacity = 0;
+	
+	memset(&table->statistics, 0, sizeof(table->statistics));
+	
 	return table;
 }
 
@@ -53,37 +69,197 @@ struct Memory_Profiler_Object_Table* Memory_Profiler_Object_Table_new(size_t ini
 void Memory_Profiler_Object_Table_free(struct Memory_Profiler_Object_Table *table) {
 	if (table) {
 		free(table->entries);
+		free(table->values);
+		free(table->free_values);
+		for (size_t klass = 0; klass < table->lists_capacity; klass++) {
+			free(table->lists[klass].records);
+		}
+		free(table->lists);
 		free(table);
 	}
 }
 
-// Hash function for object addresses
-// Uses multiplicative hashing with bit mixing to reduce clustering
-static inline size_t hash_object(VALUE object, size_t capacity) {
-	size_t hash = (size_t)object;
+// Allocate a value slot, returns 0 if allocation failed.
+static uint32_t allocate_value(struct Memory_Profiler_Object_Table *table) {
+	if (table->free_values_count > 0) {
+		return table->free_values[--table->free_values_count];
+	}
+	
+	if (table->values_count == table->values_capacity) {
+		size_t capacity = table->values_capacity ? table->values_capacity * 2 : 64;
+		if (capacity > UINT32_MAX) return 0;
+		
+		VALUE *values = realloc(table->values, capacity * sizeof(VALUE));
+		if (!values) return 0;
+		table->values = values;
+		
+		// The free list can never hold more than every slot:
+		uint32_t *free_values = realloc(table->free_values, capacity * sizeof(uint32_t));
+		if (!free_values) return 0;
+		table->free_values = free_values;
+		
+		for (size_t i = table->values_capacity; i < capacity; i++) {
+			table->values[i] = Qnil;
+		}
+		
+		table->values_capacity = capacity;
+		
+		// Reserve slot 0 to mean "no data":
+		if (table->values_count == 0) table->values_count = 1;
+	}
+	
+	return (uint32_t)table->values_count++;
+}
+
+// The record of a live entry. Every live entry has one.
+static inline struct Memory_Profiler_Object_Table_Record* record_of(struct Memory_Profiler_Object_Table *table, struct Memory_Profiler_Object_Table_Entry *entry) {
+	return &table->lists[entry->klass].records[entry->position - 1];
+}
+
+// Release a record's value slot (if any). Does not allocate.
+static void release_value(struct Memory_Profiler_Object_Table *table, struct Memory_Profiler_Object_Table_Record *record) {
+	if (record->data) {
+		table->values[record->data] = Qnil;
+		table->free_values[table->free_values_count++] = record->data;
+		record->data = 0;
+	}
+}
+
+struct Memory_Profiler_Object_Table_Record* Memory_Profiler_Object_Table_record(struct Memory_Profiler_Object_Table *table, struct Memory_Profiler_Object_Table_Entry *entry) {
+	return record_of(table, entry);
+}
+
+VALUE Memory_Profiler_Object_Table_data(struct Memory_Profiler_Object_Table *table, struct Memory_Profiler_Object_Table_Entry *entry) {
+	struct Memory_Profiler_Object_Table_Record *record = record_of(table, entry);
+	
+	return record->data ? table->values[record->data] : Qnil;
+}
+
+void Memory_Profiler_Object_Table_set_data(struct Memory_Profiler_Object_Table *table, struct Memory_Profiler_Object_Table_Entry *entry, VALUE data) {
+	struct Memory_Profiler_Object_Table_Record *record = record_of(table, entry);
+	
+	if (NIL_P(data)) {
+		release_value(table, record);
+		return;
+	}
+	
+	if (!record->data) {
+		record->data = allocate_value(table);
+		
+		// Out of memory - drop the data rather than fail the allocation event:
+		if (!record->data) return;
+	}
+	
+	table->values[record->data] = data;
+}
+
+// Make sure the class has a list, returns 0 if allocation failed.
+static int ensure_list(struct Memory_Profiler_Object_Table *table, uint32_t klass) {
+	if (klass < table->lists_capacity) return 1;
+	
+	size_t capacity = table->lists_capacity ? table->lists_capacity : 64;
+	while (capacity <= klass) capacity *= 2;
+	
+	struct Memory_Profiler_Object_Table_List *lists = realloc(table->lists, capacity * sizeof(struct Memory_Profiler_Object_Table_List));
+	if (!lists) return 0;
+	
+	memset(lists + table->lists_capacity, 0, (capacity - table->lists_capacity) * sizeof(struct Memory_Profiler_Object_Table_List));
+	table->lists = lists;
+	table->lists_capacity = capacity;
+	
+	return 1;
+}
+
+// Make sure the class's list has room for more records, returns 0 if allocation failed.
+static int reserve_records(struct Memory_Profiler_Object_Table *table, uint32_t klass, size_t more) {
+	if (!ensure_list(table, klass)) return 0;
+	
+	struct Memory_Profiler_Object_Table_List *list = &table->lists[klass];
+	size_t required = (size_t)list->count + more;
+	if (required <= list->capacity) return 1;
+	
+	size_t capacity = list->capacity ? list->capacity : 16;
+	while (capacity < required) capacity *= 2;
+	if (capacity > UINT32_MAX) return 0;
+	
+	struct Memory_Profiler_Object_Table_Record *records = realloc(list->records, capacity * sizeof(struct Memory_Profiler_Object_Table_Record));
+	if (!records) return 0;
+	
+	list->records = records;
+	list->capacity = (uint32_t)capacity;
+	
+	return 1;
+}
+
+// Append a record for the entry at index to its class's list. There must be room (see reserve_records). Does not allocate.
+static void add_record(struct Memory_Profiler_Object_Table *table, size_t index) {
+	struct Memory_Profiler_Object_Table_Entry *entry = &table->entries[index];
+	struct Memory_Profiler_Object_Table_List *list = &table->lists[entry->klass];
+	
+	list->records[list->count] = (struct Memory_Profiler_Object_Table_Record){.index = (uint32_t)index};
+	entry->position = ++list->count;
+}
+
+// Remove the entry's record from its class's list, moving the last record into its place. Does not allocate.
+static void remove_record(struct Memory_Profiler_Object_Table *table, struct Memory_Profiler_Object_Table_Entry *entry) {
+	struct Memory_Profiler_Object_Table_List *list = &table->lists[entry->klass];
+	uint32_t position = entry->position;
+	
+	if (position != list->count) {
+		struct Memory_Profiler_Object_Table_Record *last = &list->records[list->count - 1];
+		list->records[position - 1] = *last;
+		table->entries[last->index].position = position;
+	}
+	
+	list->count--;
+	entry->position = 0;
+}
+
+// Turn the entry at index into a tombstone. Its record must have been removed.
+static void bury_entry(struct Memory_Profiler_Object_Table *table, size_t index) {
+	struct Memory_Profiler_Object_Table_Entry *entry = &table->entries[index];
 	
-	// Remove alignment bits (objects are typically 8-byte aligned)
-	hash >>= 3;
+	entry->object = TOMBSTONE;
+	entry->klass = 0;
+	entry->shift = 0;
+	entry->sampled = 0;
+	table->count--;
+	table->tombstones++;
+}
+
+// Hash an object address to a slot index (capacity is always a power of two, at least 2).
+// Fibonacci hashing: a single multiply by 2^64 / phi, keeping the top bits of the product, which depend on every bit of the address. Consecutive slots land far apart, and there is no division.
+static inline size_t hash_object(VALUE object, size_t mask) {
+	// Remove alignment bits (objects are typically 8-byte aligned):
+	uint64_t hash = ((uint64_t)object >> 3) * 0x9E3779B97F4A7C15ULL;
 	
-	// Multiplicative hashing (Knuth's golden ratio method)
-	// This helps distribute consecutive addresses across the table
-	hash *= 2654435761UL;  // 2^32 / phi (golden ratio)
+	return (size_t)(hash >> __builtin_clzll(mask)) & mask;
+}
+
+// Record the length of a completed probe sequence. Cheap enough for every lookup.
+static inline void record_probe(struct Memory_Profiler_Object_Table_Statistics *statistics, size_t probe_count) {
+	// Bucket i counts probe lengths in [2^i, 2^(i+1)):
+	size_t bucket = 0;
+	for (size_t length = probe_count; length > 1 && bucket < MEMORY_PROFILER_OBJECT_TABLE_PROBE_BUCKETS - 1; length >>= 1) {
+		bucket++;
+	}
+	statistics->probes[bucket]++;
 	
-	// Mix high bits into low bits for better distribution
-	hash ^= (hash >> 16);
-	hash *= 0x85ebca6b;
-	hash ^= (hash >> 13);
-	hash *= 0xc2b2ae35;
-	hash ^= (hash >> 16);
+	if (probe_count > statistics->maximum_probe) {
+		statistics->maximum_probe = probe_count;
+	}
 	
-	return hash % capacity;
+	if (probe_count >= WARN_PROBE_LENGTH) {
+		statistics->long_probes++;
+	}
 }
 
 // Find entry index for an object (linear probing)
 // Returns index if found, or index of empty slot if not found
-// If table is provided (not NULL), logs statistics when probe length is excessive
-static size_t find_entry(struct Memory_Profiler_Object_Table_Entry *entries, size_t capacity, VALUE object, int *found, struct Memory_Profiler_Object_Table *table, const char *operation) {
-	size_t index = hash_object(object, capacity);
+// If statistics is provided (not NULL), records the probe length
+static size_t find_entry(struct Memory_Profiler_Object_Table_Entry *entries, size_t capacity, VALUE object, int *found, struct Memory_Profiler_Object_Table_Statistics *statistics) {
+	size_t mask = capacity - 1;
+	size_t index = hash_object(object, mask);
 	size_t start = index;
 	size_t probe_count = 0;
 	
@@ -94,45 +270,24 @@ static size_t find_entry(struct Memory_Profiler_Object_Table_Entry *entries, siz
 		
 		// Safety check - prevent infinite loops
 		if (probe_count > MAX_PROBE_LENGTH) {
-			if (DEBUG && table) {
-				double load = (double)table->count / capacity;
-				double tomb_ratio = (double)table->tombstones / capacity;
-				fprintf(stderr, "{\"subject\":\"Memory::Profiler::ObjectTable\",\"level\":\"critical\",\"operation\":\"%s\",\"event\":\"max_probes_exceeded\",\"probe_count\":%zu,\"capacity\":%zu,\"count\":%zu,\"tombstones\":%zu,\"load_factor\":%.3f,\"tombstone_ratio\":%.3f}\n", 
-					operation, probe_count, capacity, table->count, table->tombstones, load, tomb_ratio);
-			} else if (DEBUG) {
-				fprintf(stderr, "{\"subject\":\"Memory::Profiler::ObjectTable\",\"level\":\"critical\",\"operation\":\"%s\",\"event\":\"max_probes_exceeded\",\"probe_count\":%zu,\"capacity\":%zu}\n", 
-					operation, probe_count, capacity);
-			}
+			if (statistics) statistics->aborted_probes++;
 			return index;
 		}
 		
-		// Log warning for excessive probing
-		if (DEBUG && probe_count == WARN_PROBE_LENGTH && table) {
-			double load = (double)table->count / capacity;
-			double tomb_ratio = (double)table->tombstones / capacity;
-			fprintf(stderr, "{\"subject\":\"Memory::Profiler::ObjectTable\",\"level\":\"warning\",\"operation\":\"%s\",\"event\":\"long_probe_chain\",\"probe_count\":%zu,\"capacity\":%zu,\"count\":%zu,\"tombstones\":%zu,\"load_factor\":%.3f,\"tombstone_ratio\":%.3f}\n", 
-				operation, probe_count, capacity, table->count, table->tombstones, load, tomb_ratio);
-		}
-		
 		if (entries[index].object == 0) {
-			return index;
+			break;
 		}
 		
 		if (entries[index].object != TOMBSTONE && entries[index].object == object) {
 			*found = 1;
-			return index;
+			break;
 		}
 		
-		index = (index + 1) % capacity;
+		index = (index + 1) & mask;
 	} while (index != start);
 	
-	// Table is full
-	if (DEBUG && table) {
-		double load = (double)table->count / capacity;
-		double tomb_ratio = (double)table->tombstones / capacity;
-		fprintf(stderr, "{\"subject\":\"Memory::Profiler::ObjectTable\",\"level\":\"error\",\"operation\":\"%s\",\"event\":\"table_full\",\"probe_count\":%zu,\"capacity\":%zu,\"count\":%zu,\"tombstones\":%zu,\"load_factor\":%.3f,\"tombstone_ratio\":%.3f}\n", 
-			operation, probe_count, capacity, table->count, table->tombstones, load, tomb_ratio);
-	}
+	if (statistics) record_probe(statistics, probe_count);
+	
 	return index;
 }
 
@@ -141,8 +296,8 @@ static size_t find_entry(struct Memory_Profiler_Object_Table_Entry *entries, siz
 // If object exists, returns its index with found=1
 static size_t find_insert_slot(struct Memory_Profiler_Object_Table *table, VALUE object, int *found) {
 	struct Memory_Profiler_Object_Table_Entry *entries = table->entries;
-	size_t capacity = table->capacity;
-	size_t index = hash_object(object, capacity);
+	size_t mask = table->capacity - 1;
+	size_t index = hash_object(object, mask);
 	size_t start = index;
 	size_t first_tombstone = SIZE_MAX;  // Track first tombstone we encounter
 	size_t probe_count = 0;
@@ -154,26 +309,14 @@ static size_t find_insert_slot(struct Memory_Profiler_Object_Table *table, VALUE
 		
 		// Safety check - prevent infinite loops
 		if (probe_count > MAX_PROBE_LENGTH) {
-			if (DEBUG) {
-				double load = (double)table->count / capacity;
-				double tomb_ratio = (double)table->tombstones / capacity;
-				fprintf(stderr, "{\"subject\":\"Memory::Profiler::ObjectTable\",\"level\":\"critical\",\"operation\":\"insert\",\"event\":\"max_probes_exceeded\",\"probe_count\":%zu,\"capacity\":%zu,\"count\":%zu,\"tombstones\":%zu,\"load_factor\":%.3f,\"tombstone_ratio\":%.3f}\n", 
-					probe_count, capacity, table->count, table->tombstones, load, tomb_ratio);
-			}
+			table->statistics.aborted_probes++;
 			// Return tombstone if we found one, otherwise current position
 			return (first_tombstone != SIZE_MAX) ? first_tombstone : index;
 		}
 		
-		// Log warning for excessive probing
-		if (DEBUG && probe_count == WARN_PROBE_LENGTH) {
-			double load = (double)table->count / capacity;
-			double tomb_ratio = (double)table->tombstones / capacity;
-			fprintf(stderr, "{\"subject\":\"Memory::Profiler::ObjectTable\",\"level\":\"warning\",\"operation\":\"insert\",\"event\":\"long_probe_chain\",\"probe_count\":%zu,\"capacity\":%zu,\"count\":%zu,\"tombstones\":%zu,\"load_factor\":%.3f,\"tombstone_ratio\":%.3f}\n", 
-				probe_count, capacity, table->count, table->tombstones, load, tomb_ratio);
-		}
-		
 		if (entries[index].object == 0) {
 			// Empty slot - use tombstone if we found one, otherwise this slot
+			record_probe(&table->statistics, probe_count);
 			return (first_tombstone != SIZE_MAX) ? first_tombstone : index;
 		}
 		
@@ -185,19 +328,16 @@ static size_t find_insert_slot(struct Memory_Profiler_Object_Table *table, VALUE
 		} else if (entries[index].object == object) {
 			// Found existing entry
 			*found = 1;
+			record_probe(&table->statistics, probe_count);
 			return index;
 		}
 		
-		index = (index + 1) % capacity;
+		index = (index + 1) & mask;
 	} while (index != start);
 	
-	// Table is full
-	if (DEBUG) {
-		double load = (double)table->count / capacity;
-		double tomb_ratio = (double)table->tombstones / capacity;
-		fprintf(stderr, "{\"subject\":\"Memory::Profiler::ObjectTable\",\"level\":\"error\",\"operation\":\"insert\",\"event\":\"table_full\",\"probe_count\":%zu,\"capacity\":%zu,\"count\":%zu,\"tombstones\":%zu,\"load_factor\":%.3f,\"tombstone_ratio\":%.3f}\n", 
-			probe_count, capacity, table->count, table->tombstones, load, tomb_ratio);
-	}
+	// Table is full (only possible if a resize failed):
+	record_probe(&table->statistics, probe_count);
+	
 	// Use tombstone slot if we found one
 	return (first_tombstone != SIZE_MAX) ? first_tombstone : index;
 }
@@ -208,7 +348,10 @@ static void resize_table(struct Memory_Profiler_Object_Table *table) {
 	size_t old_capacity = table->capacity;
 	struct Memory_Profiler_Object_Table_Entry *old_entries = table->entries;
 	
-	// Double capacity
+	// Records hold 32-bit slot indexes:
+	if (old_capacity * 2 > UINT32_MAX) return;
+	
+	// Double capacity (stays a power of two)
 	table->capacity = old_capacity * 2;
 	table->count = 0;
 	table->tombstones = 0;  // Reset tombstones
@@ -221,13 +364,17 @@ static void resize_table(struct Memory_Profiler_Object_Table *table) {
 		return;
 	}
 	
+	table->statistics.resizes++;
+	
 	// Rehash all non-tombstone entries
 	for (size_t i = 0; i < old_capacity; i++) {
 		// Skip empty slots and tombstones
 		if (old_entries[i].object != 0 && old_entries[i].object != TOMBSTONE) {
 			int found;
-			size_t new_index = find_entry(table->entries, table->capacity, old_entries[i].object, &found, NULL, "resize");
+			size_t new_index = find_entry(table->entries, table->capacity, old_entries[i].object, &found, NULL);
 			table->entries[new_index] = old_entries[i];
+			// Every entry moves, so its record must follow:
+			record_of(table, &table->entries[new_index])->index = (uint32_t)new_index;
 			table->count++;
 		}
 	}
@@ -236,7 +383,11 @@ static void resize_table(struct Memory_Profiler_Object_Table *table) {
 }
 
 // Insert object, returns pointer to entry for caller to fill
-struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_insert(struct Memory_Profiler_Object_Table *table, VALUE object) {
+struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_insert(struct Memory_Profiler_Object_Table *table, VALUE object, uint32_t klass) {
+	if (!reserve_records(table, klass, 1)) {
+		return NULL;
+	}
+	
 	// Resize if load factor exceeded (count + tombstones)
 	// This clears tombstones and gives us fresh space
 	if ((double)(table->count + table->tombstones) / table->capacity > LOAD_FACTOR) {
@@ -252,15 +403,22 @@ struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_insert(s
 			table->tombstones--;  // Reusing tombstone
 		}
 		table->count++;
+		if (table->count > table->statistics.peak_count) {
+			table->statistics.peak_count = table->count;
+		}
 		// Zero out the entry
 		table->entries[index].object = object;
-		table->entries[index].klass = 0;
-		table->entries[index].data = 0;
+		table->entries[index].shift = 0;
+		table->entries[index].sampled = 0;
 	} else {
-		// Updating existing entry
-		table->entries[index].object = object;
+		// Updating existing entry (stale, its object was freed without us seeing it):
+		release_value(table, record_of(table, &table->entries[index]));
+		remove_record(table, &table->entries[index]);
 	}
 	
+	table->entries[index].klass = klass;
+	add_record(table, index);
+	
 	// Return pointer for caller to fill fields
 	return &table->entries[index];
 }
@@ -268,7 +426,7 @@ struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_insert(s
 // Lookup entry for object - returns pointer or NULL
 struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_lookup(struct Memory_Profiler_Object_Table *table, VALUE object) {
 	int found;
-	size_t index = find_entry(table->entries, table->capacity, object, &found, table, "lookup");
+	size_t index = find_entry(table->entries, table->capacity, object, &found, &table->statistics);
 	
 	if (found) {
 		return &table->entries[index];
@@ -280,103 +438,200 @@ struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_lookup(s
 // Delete object from table
 void Memory_Profiler_Object_Table_delete(struct Memory_Profiler_Object_Table *table, VALUE object) {
 	int found;
-	size_t index = find_entry(table->entries, table->capacity, object, &found, table, "delete");
+	size_t index = find_entry(table->entries, table->capacity, object, &found, &table->statistics);
 	
 	if (!found) {
 		return;
 	}
 	
 	// Mark as tombstone - no rehashing needed!
-	table->entries[index].object = TOMBSTONE;
-	table->entries[index].klass = 0;
-	table->entries[index].data = 0;
-	table->count--;
-	table->tombstones++;
+	release_value(table, record_of(table, &table->entries[index]));
+	remove_record(table, &table->entries[index]);
+	bury_entry(table, index);
 }
 
-// Mark all entries for GC
-void Memory_Profiler_Object_Table_mark(struct Memory_Profiler_Object_Table *table) {
-	if (!table) return;
+size_t Memory_Profiler_Object_Table_delete_class(struct Memory_Profiler_Object_Table *table, uint32_t klass, Memory_Profiler_Object_Table_deleted_callback deleted_callback, void *argument) {
+	if (klass >= table->lists_capacity) return 0;
 	
-	for (size_t i = 0; i < table->capacity; i++) {
-		struct Memory_Profiler_Object_Table_Entry *entry = &table->entries[i];
-		// Skip empty slots and tombstones
-		if (entry->object != 0 && entry->object != TOMBSTONE) {
-			// Don't mark object keys - table is weak (object keys can be GC'd, that's how we detect frees)
-			// Always mark the other fields (klass, data) - we own these
-			if (entry->klass) rb_gc_mark_movable(entry->klass);
-			if (entry->data) rb_gc_mark_movable(entry->data);
+	struct Memory_Profiler_Object_Table_List *list = &table->lists[klass];
+	size_t count = list->count;
+	
+	for (size_t i = 0; i < count; i++) {
+		struct Memory_Profiler_Object_Table_Record *record = &list->records[i];
+		struct Memory_Profiler_Object_Table_Entry *entry = &table->entries[record->index];
+		
+		VALUE object = entry->object;
+		
+		release_value(table, record);
+		entry->position = 0;
+		bury_entry(table, record->index);
+		
+		if (deleted_callback) {
+			deleted_callback(object, argument);
 		}
 	}
+	
+	// The class is gone, so its list is released rather than kept for reuse:
+	free(list->records);
+	*list = (struct Memory_Profiler_Object_Table_List){0};
+	
+	return count;
 }
 
-// Update object pointers during compaction
-void Memory_Profiler_Object_Table_compact(struct Memory_Profiler_Object_Table *table) {
-	if (!table || table->count == 0) return;
+int Memory_Profiler_Object_Table_relabel(struct Memory_Profiler_Object_Table *table, uint32_t from, uint32_t to) {
+	if (from == to || from >= table->lists_capacity || table->lists[from].count == 0) return 1;
 	
-	// First pass: check if any objects moved
-	int any_moved = 0;
-	for (size_t i = 0; i < table->capacity; i++) {
-		// Skip empty slots and tombstones
-		if (table->entries[i].object != 0 && table->entries[i].object != TOMBSTONE) {
-			VALUE new_loc = rb_gc_location(table->entries[i].object);
-			if (new_loc != table->entries[i].object) {
-				any_moved = 1;
-				break;
-			}
+	if (!ensure_list(table, to)) return 0;
+	
+	struct Memory_Profiler_Object_Table_List *source = &table->lists[from];
+	struct Memory_Profiler_Object_Table_List *target = &table->lists[to];
+	
+	// The moved records are at the end of the target's list:
+	uint32_t moved = target->count;
+	
+	if (target->count == 0) {
+		// Take over the whole list, the positions of its records don't change:
+		free(target->records);
+		*target = *source;
+	} else {
+		if (!reserve_records(table, to, source->count)) return 0;
+		
+		for (uint32_t i = 0; i < source->count; i++) {
+			struct Memory_Profiler_Object_Table_Record record = source->records[i];
+			target->records[target->count] = record;
+			table->entries[record.index].position = ++target->count;
 		}
+		
+		free(source->records);
 	}
 	
-	// If nothing moved, just update VALUE fields and we're done
-	if (!any_moved) {
-		for (size_t i = 0; i < table->capacity; i++) {
-			// Skip empty slots and tombstones
-			if (table->entries[i].object != 0 && table->entries[i].object != TOMBSTONE) {
-				// Update VALUE fields if they moved
-				table->entries[i].klass = rb_gc_location(table->entries[i].klass);
-				table->entries[i].data = rb_gc_location(table->entries[i].data);
-			}
-		}
-		return;
+	*source = (struct Memory_Profiler_Object_Table_List){0};
+	
+	for (uint32_t i = moved; i < target->count; i++) {
+		struct Memory_Profiler_Object_Table_Entry *entry = &table->entries[target->records[i].index];
+		entry->klass = to;
+		
+		// Samples are kept per class by the owner, so the entry is no longer in one:
+		entry->sampled = 0;
 	}
 	
-	// Something moved - need to rehash entire table
-	// Collect all entries into temporary array (use system malloc, not Ruby's)
-	struct Memory_Profiler_Object_Table_Entry *temp_entries = malloc(table->count * sizeof(struct Memory_Profiler_Object_Table_Entry));
-	if (!temp_entries) {
-		// Allocation failed - this is bad, but can't do much during GC
-		return;
+	return 1;
+}
+
+struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_first(struct Memory_Profiler_Object_Table *table, uint32_t klass) {
+	if (klass >= table->lists_capacity || table->lists[klass].count == 0) return NULL;
+	
+	return &table->entries[table->lists[klass].records[0].index];
+}
+
+struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_next(struct Memory_Profiler_Object_Table *table, struct Memory_Profiler_Object_Table_Entry *entry) {
+	struct Memory_Profiler_Object_Table_List *list = &table->lists[entry->klass];
+	
+	// Positions are index + 1, so the position is also the index of the next record:
+	if (entry->position >= list->count) return NULL;
+	
+	return &table->entries[list->records[entry->position].index];
+}
+
+size_t Memory_Profiler_Object_Table_class_count(struct Memory_Profiler_Object_Table *table, uint32_t klass) {
+	return klass < table->lists_capacity ? table->lists[klass].count : 0;
+}
+
+struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_class_entry(struct Memory_Profiler_Object_Table *table, uint32_t klass, size_t index) {
+	return &table->entries[table->lists[klass].records[index].index];
+}
+
+// Mark all callback data for GC
+void Memory_Profiler_Object_Table_mark(struct Memory_Profiler_Object_Table *table) {
+	if (!table) return;
+	
+	// Don't mark object keys - table is weak (object keys can be GC'd, that's how we detect frees)
+	// Only mark the values we own - released slots hold Qnil
+	for (size_t i = 1; i < table->values_count; i++) {
+		rb_gc_mark_movable(table->values[i]);
 	}
+}
+
+// Move the (live) entry at index to a new key: the old slot becomes a tombstone and the entry is reinserted at the new key's hash position, replacing any stale entry already there. Does not allocate. Returns the entry's new location.
+static struct Memory_Profiler_Object_Table_Entry* relocate_entry(struct Memory_Profiler_Object_Table *table, size_t index, VALUE object) {
+	struct Memory_Profiler_Object_Table_Entry *entry = &table->entries[index];
 	
-	size_t temp_count = 0;
-	for (size_t i = 0; i < table->capacity; i++) {
-		// Skip empty slots and tombstones
-		if (table->entries[i].object != 0 && table->entries[i].object != TOMBSTONE) {
-			// Update all pointers first
-			temp_entries[temp_count].object = rb_gc_location(table->entries[i].object);
-			temp_entries[temp_count].klass = rb_gc_location(table->entries[i].klass);
-			temp_entries[temp_count].data = rb_gc_location(table->entries[i].data);
-			temp_count++;
+	struct Memory_Profiler_Object_Table_Entry moved = *entry;
+	moved.object = object;
+	
+	// The entry keeps its record, which still refers to the old slot:
+	bury_entry(table, index);
+	
+	int found;
+	size_t new_index = find_insert_slot(table, object, &found);
+	
+	if (!found) {
+		if (table->entries[new_index].object == TOMBSTONE) {
+			table->tombstones--;
 		}
+		table->count++;
+	} else {
+		// Replacing a stale entry:
+		release_value(table, record_of(table, &table->entries[new_index]));
+		remove_record(table, &table->entries[new_index]);
+		
+		// Which may have moved this entry's record, updating the position left in the old slot:
+		moved.position = table->entries[index].position;
 	}
 	
-	// Clear the table (zero out all entries, clears tombstones too)
-	memset(table->entries, 0, table->capacity * sizeof(struct Memory_Profiler_Object_Table_Entry));
-	table->count = 0;
-	table->tombstones = 0;  // Compaction clears tombstones
+	table->entries[index].position = 0;
+	table->entries[new_index] = moved;
+	record_of(table, &table->entries[new_index])->index = (uint32_t)new_index;
+	
+	return &table->entries[new_index];
+}
+
+struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_rekey(struct Memory_Profiler_Object_Table *table, struct Memory_Profiler_Object_Table_Entry *entry, VALUE object) {
+	size_t index = entry - table->entries;
+	
+	if (index >= table->capacity || entry->object == 0 || entry->object == TOMBSTONE) {
+		return NULL;
+	}
 	
-	// Reinsert all entries with new hash values:
-	for (size_t i = 0; i < temp_count; i++) {
-		int found;
-		size_t index = find_entry(table->entries, table->capacity, temp_entries[i].object, &found, NULL, "compact");
+	return relocate_entry(table, index, object);
+}
+
+// Update object pointers during compaction.
+// Entries whose object moved are relocated individually: the old slot becomes a tombstone and the entry is reinserted at its new hash position. Destination addresses are always free slots (never the old address of another moved object), so relocating in a single pass is safe, and an entry relocated ahead of the scan position is simply visited again as unmoved.
+void Memory_Profiler_Object_Table_compact(struct Memory_Profiler_Object_Table *table, Memory_Profiler_Object_Table_moved_callback moved_callback, void *argument) {
+	if (!table || table->count == 0) return;
+	
+	struct timespec start, finish;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	// Values are indexed, so they can be updated in place:
+	for (size_t i = 1; i < table->values_count; i++) {
+		table->values[i] = rb_gc_location(table->values[i]);
+	}
+	
+	for (size_t i = 0; i < table->capacity; i++) {
+		struct Memory_Profiler_Object_Table_Entry *entry = &table->entries[i];
 		
-		// Insert at new location
-		table->entries[index] = temp_entries[i];
-		table->count++;
+		// Skip empty slots and tombstones
+		if (entry->object == 0 || entry->object == TOMBSTONE) continue;
+		
+		VALUE old_object = entry->object;
+		VALUE new_object = rb_gc_location(old_object);
+		if (new_object == old_object) continue;
+		
+		// The object moved, so its hash changed - relocate just this entry:
+		relocate_entry(table, i, new_object);
+		table->statistics.relocations++;
+		
+		if (moved_callback) {
+			moved_callback(old_object, new_object, argument);
+		}
 	}
 	
-	// Free temporary array
-	free(temp_entries);
+	clock_gettime(CLOCK_MONOTONIC, &finish);
+	
+	table->statistics.compactions++;
+	table->statistics.compaction_time += (uint64_t)(finish.tv_sec - start.tv_sec) * 1000000000ULL + (finish.tv_nsec - start.tv_nsec);
 }
 
 // Delete by entry pointer (faster - avoids second lookup)
@@ -395,11 +650,9 @@ void Memory_Profiler_Object_Table_delete_entry(struct Memory_Profiler_Object_Tab
 	}
 	
 	// Mark as tombstone - no rehashing needed!
-	entry->object = TOMBSTONE;
-	entry->klass = 0;
-	entry->data = 0;
-	table->count--;
-	table->tombstones++;
+	release_value(table, record_of(table, entry));
+	remove_record(table, entry);
+	bury_entry(table, index);
 }
 
 // Get current size
@@ -407,3 +660,7 @@ size_t Memory_Profiler_Object_Table_size(struct Memory_Profiler_Object_Table *ta
 	return table->count;
 }
 
+
+const struct Memory_Profiler_Object_Table_Statistics* Memory_Profiler_Object_Table_statistics(struct Memory_Profiler_Object_Table *table) {
+	return &table->statistics;
+}
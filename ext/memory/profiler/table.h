@@ -5,15 +5,65 @@
 
 #include <ruby.h>
 #include <stddef.h>
+#include <stdint.h>
 
-// Entry in the object table
+// Entry in the object table (16 bytes). Only what lookups and the hooks need is kept here, everything else is in the entry's record.
 struct Memory_Profiler_Object_Table_Entry {
 	// Object pointer (key):
 	VALUE object;
-	// The class of the allocated object:
-	VALUE klass;
-	// User-defined state from callback:
-	VALUE data;
+	// The class of the allocated object, as an id assigned by the owner of the table (0 = none, at most MEMORY_PROFILER_CLASSES_MAXIMUM_ID):
+	uint32_t klass : 27;
+	// Set by the owner of the table when allocations are sampled: the object stands for 2^shift allocations:
+	uint32_t shift : 4;
+	// Set by the owner of the table when the object is held in a sample, so frees of other objects don't need to search it:
+	uint32_t sampled : 1;
+	// Where the entry's record is in its class's list, as index + 1:
+	uint32_t position;
+};
+
+// Record of a live entry, held in its class's list rather than in the table, so it costs memory per object instead of per slot (16 bytes).
+struct Memory_Profiler_Object_Table_Record {
+	// Slot index of the entry:
+	uint32_t index;
+	// User-defined state from callback, as an index into the table's values (0 = none):
+	uint32_t data;
+	// The number of garbage collections that had run when the allocation was recorded, set by the owner of the table:
+	uint32_t epoch;
+	// What the allocation is attributed to, as an id assigned by the owner of the table (0 = none):
+	uint32_t attribution;
+};
+
+// The records of a class's entries, in no particular order. Removing a record moves the last one into its place.
+struct Memory_Profiler_Object_Table_List {
+	struct Memory_Profiler_Object_Table_Record *records;
+	uint32_t count;
+	uint32_t capacity;
+};
+
+enum {
+	// Probe lengths are bucketed by powers of two: 1, 2-3, 4-7, ... (the last bucket holds everything longer).
+	MEMORY_PROFILER_OBJECT_TABLE_PROBE_BUCKETS = 16,
+};
+
+// Runtime counters, cheap enough to keep updated on every operation.
+struct Memory_Profiler_Object_Table_Statistics {
+	// Histogram of probe lengths for lookups, inserts and deletes:
+	size_t probes[MEMORY_PROFILER_OBJECT_TABLE_PROBE_BUCKETS];
+	size_t maximum_probe;
+	
+	// Probe sequences that were unusually long, or that hit the safety limit and were aborted:
+	size_t long_probes;
+	size_t aborted_probes;
+	
+	// Highest count seen:
+	size_t peak_count;
+	
+	size_t resizes;
+	
+	// Compaction passes, entries relocated by them, and the total time spent:
+	size_t compactions;
+	size_t relocations;
+	uint64_t compaction_time; // nanoseconds
 };
 
 // Custom object table for tracking allocations during GC.
@@ -21,26 +71,52 @@ struct Memory_Profiler_Object_Table_Entry {
 // Keys are object addresses (updated during compaction).
 // Table is always weak - object keys are not marked, allowing GC to collect them.
 struct Memory_Profiler_Object_Table {
-	size_t capacity;    // Total slots
+	size_t capacity;    // Total slots (always a power of two)
 	size_t count;       // Used slots (occupied entries)
 	size_t tombstones;  // Deleted slots (tombstone markers)
 	struct Memory_Profiler_Object_Table_Entry *entries;  // System malloc'd array
+	
+	// Callback data is rare, so it is stored out of line and only for the entries that have it.
+	// Slot 0 is reserved, unused slots hold Qnil.
+	VALUE *values;
+	size_t values_capacity;
+	size_t values_count;  // Slots handed out so far (including reserved slot 0)
+	
+	// Released slots, available for reuse:
+	uint32_t *free_values;
+	size_t free_values_count;
+	
+	// The list of each class's entries, indexed by class id:
+	struct Memory_Profiler_Object_Table_List *lists;
+	size_t lists_capacity;
+	
+	struct Memory_Profiler_Object_Table_Statistics statistics;
 };
 
-// Create a new object table with initial capacity
+// Create a new object table with initial capacity (rounded up to a power of two)
 struct Memory_Profiler_Object_Table* Memory_Profiler_Object_Table_new(size_t initial_capacity);
 
 // Free the table and all its memory
 void Memory_Profiler_Object_Table_free(struct Memory_Profiler_Object_Table *table);
 
-// Insert an object, returns pointer to entry for caller to fill fields.
+// Insert an object of the given class, returns pointer to entry for caller to fill fields, or NULL if out of memory.
 // Safe to call from postponed job (not during GC).
-struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_insert(struct Memory_Profiler_Object_Table *table, VALUE object);
+struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_insert(struct Memory_Profiler_Object_Table *table, VALUE object, uint32_t klass);
 
 // Lookup entry for an object. Returns pointer to entry or NULL if not found.
 // Safe to call during FREEOBJ event handler (no allocation) - READ ONLY!
 struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_lookup(struct Memory_Profiler_Object_Table *table, VALUE object);
 
+// Get the record of a live entry, for the owner of the table to read or fill its fields. Valid until the next insert or delete.
+struct Memory_Profiler_Object_Table_Record* Memory_Profiler_Object_Table_record(struct Memory_Profiler_Object_Table *table, struct Memory_Profiler_Object_Table_Entry *entry);
+
+// Get the callback data for an entry (Qnil if none).
+VALUE Memory_Profiler_Object_Table_data(struct Memory_Profiler_Object_Table *table, struct Memory_Profiler_Object_Table_Entry *entry);
+
+// Set the callback data for an entry. May allocate, safe to call from postponed job (not during GC).
+// The caller is responsible for the write barrier of the owning object.
+void Memory_Profiler_Object_Table_set_data(struct Memory_Profiler_Object_Table *table, struct Memory_Profiler_Object_Table_Entry *entry, VALUE data);
+
 // Delete an object. Safe to call from postponed job (not during GC).
 void Memory_Profiler_Object_Table_delete(struct Memory_Profiler_Object_Table *table, VALUE object);
 
@@ -49,14 +125,47 @@ void Memory_Profiler_Object_Table_delete(struct Memory_Profiler_Object_Table *ta
 // entry must be a valid pointer from Object_Table_lookup.
 void Memory_Profiler_Object_Table_delete_entry(struct Memory_Profiler_Object_Table *table, struct Memory_Profiler_Object_Table_Entry *entry);
 
-// Mark all entries for GC.
+// Move an entry to a new key, replacing any entry already there. Returns the entry's new location (entry pointers are invalidated), or NULL if the entry is not live.
+// Does not allocate, so it's safe during GC.
+struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_rekey(struct Memory_Profiler_Object_Table *table, struct Memory_Profiler_Object_Table_Entry *entry, VALUE object);
+
+// Called for each entry deleted by Memory_Profiler_Object_Table_delete_class.
+typedef void (*Memory_Profiler_Object_Table_deleted_callback)(VALUE object, void *argument);
+
+// Delete every entry of a class, returning the number deleted. Cost is proportional to the number of entries of the class. The deleted callback is optional.
+// Safe to call from postponed job (not during GC).
+size_t Memory_Profiler_Object_Table_delete_class(struct Memory_Profiler_Object_Table *table, uint32_t klass, Memory_Profiler_Object_Table_deleted_callback deleted, void *argument);
+
+// Move every entry of one class to another, returns 0 (leaving the entries unchanged) if out of memory. The moved entries are no longer sampled. Cost is proportional to the number of entries moved.
+// Safe to call from postponed job (not during GC).
+int Memory_Profiler_Object_Table_relabel(struct Memory_Profiler_Object_Table *table, uint32_t from, uint32_t to);
+
+// The first entry of the class's list, or NULL if the class has no entries.
+struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_first(struct Memory_Profiler_Object_Table *table, uint32_t klass);
+
+// The next entry of the same class, or NULL at the end of the list. Do not insert or delete while walking the list, as that may move entries.
+struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_next(struct Memory_Profiler_Object_Table *table, struct Memory_Profiler_Object_Table_Entry *entry);
+
+// The number of entries of the class. Does not allocate.
+size_t Memory_Profiler_Object_Table_class_count(struct Memory_Profiler_Object_Table *table, uint32_t klass);
+
+// The entry at index (less than the class's count) in the class's list, so entries can be chosen at random. Does not allocate.
+struct Memory_Profiler_Object_Table_Entry* Memory_Profiler_Object_Table_class_entry(struct Memory_Profiler_Object_Table *table, uint32_t klass, size_t index);
+
+// Mark all callback data for GC (object keys are weak).
 // Must be called from dmark callback.
 void Memory_Profiler_Object_Table_mark(struct Memory_Profiler_Object_Table *table);
 
-// Update object pointers after compaction.
-// Must be called from dcompact callback.
-void Memory_Profiler_Object_Table_compact(struct Memory_Profiler_Object_Table *table);
+// Called for each entry whose object moved during compaction.
+typedef void (*Memory_Profiler_Object_Table_moved_callback)(VALUE from, VALUE to, void *argument);
+
+// Update object pointers after compaction, relocating only the entries whose object moved.
+// Must be called from dcompact callback. Does not allocate. The moved callback is optional.
+void Memory_Profiler_Object_Table_compact(struct Memory_Profiler_Object_Table *table, Memory_Profiler_Object_Table_moved_callback moved, void *argument);
 
 // Get current size
 size_t Memory_Profiler_Object_Table_size(struct Memory_Profiler_Object_Table *table);
 
+// Get the runtime counters. Does not allocate.
+const struct Memory_Profiler_Object_Table_Statistics* Memory_Profiler_Object_Table_statistics(struct Memory_Profiler_Object_Table *table);
+
@@ -0,0 +1,122 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "tags.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const size_t INITIAL_CAPACITY = 64;
+
+void Memory_Profiler_Tags_initialize(struct Memory_Profiler_Tags *tags) {
+	tags->tags = NULL;
+	tags->count = 0;
+	tags->capacity = 0;
+	tags->index = NULL;
+	tags->index_capacity = 0;
+}
+
+void Memory_Profiler_Tags_free(struct Memory_Profiler_Tags *tags) {
+	free(tags->tags);
+	free(tags->index);
+	
+	Memory_Profiler_Tags_initialize(tags);
+}
+
+// Find the index slot of a tag: either the slot holding it, or the empty slot where it would go.
+static size_t find_slot(struct Memory_Profiler_Tags *tags, uint32_t *index, size_t capacity, VALUE value) {
+	size_t mask = capacity - 1;
+	uint64_t hash = (uint64_t)value * 0x9E3779B97F4A7C15ULL;
+	size_t i = (size_t)(hash >> __builtin_clzll(mask)) & mask;
+	
+	while (index[i] && tags->tags[index[i]].value != value) {
+		i = (i + 1) & mask;
+	}
+	
+	return i;
+}
+
+// Grow the index, keeping the load factor at or below 1/2.
+static int resize_index(struct Memory_Profiler_Tags *tags) {
+	size_t capacity = tags->index_capacity ? tags->index_capacity * 2 : INITIAL_CAPACITY;
+	uint32_t *index = calloc(capacity, sizeof(uint32_t));
+	if (!index) return 0;
+	
+	for (size_t i = 0; i < tags->index_capacity; i++) {
+		uint32_t id = tags->index[i];
+		
+		if (id) {
+			index[find_slot(tags, index, capacity, tags->tags[id].value)] = id;
+		}
+	}
+	
+	free(tags->index);
+	tags->index = index;
+	tags->index_capacity = capacity;
+	
+	return 1;
+}
+
+// Grow the tags array, returns zero if out of memory.
+static int grow(struct Memory_Profiler_Tags *tags) {
+	size_t capacity = tags->capacity ? tags->capacity * 2 : INITIAL_CAPACITY;
+	struct Memory_Profiler_Tag *array = realloc(tags->tags, capacity * sizeof(struct Memory_Profiler_Tag));
+	if (!array) return 0;
+	
+	tags->tags = array;
+	tags->capacity = capacity;
+	
+	return 1;
+}
+
+uint32_t Memory_Profiler_Tags_intern(struct Memory_Profiler_Tags *tags, VALUE value) {
+	if (tags->count == 0) {
+		if (!grow(tags)) return MEMORY_PROFILER_TAGS_NONE;
+		
+		// The reserved tags have no value:
+		memset(tags->tags, 0, 2 * sizeof(struct Memory_Profiler_Tag));
+		tags->tags[MEMORY_PROFILER_TAGS_NONE].value = Qnil;
+		tags->tags[MEMORY_PROFILER_TAGS_UNTAGGED].value = Qnil;
+		tags->count = 2;
+	}
+	
+	if (NIL_P(value)) return MEMORY_PROFILER_TAGS_UNTAGGED;
+	
+	if (tags->index_capacity) {
+		uint32_t id = tags->index[find_slot(tags, tags->index, tags->index_capacity, value)];
+		if (id) return id;
+	}
+	
+	if (tags->count > UINT32_MAX / 2) return MEMORY_PROFILER_TAGS_UNTAGGED;
+	
+	if (tags->count == tags->capacity && !grow(tags)) {
+		return MEMORY_PROFILER_TAGS_UNTAGGED;
+	}
+	
+	if ((tags->count + 1) * 2 > tags->index_capacity && !resize_index(tags)) {
+		return MEMORY_PROFILER_TAGS_UNTAGGED;
+	}
+	
+	uint32_t id = (uint32_t)tags->count++;
+	tags->tags[id] = (struct Memory_Profiler_Tag){.value = value};
+	tags->index[find_slot(tags, tags->index, tags->index_capacity, value)] = id;
+	
+	return id;
+}
+
+void Memory_Profiler_Tags_clear(struct Memory_Profiler_Tags *tags) {
+	for (size_t id = 0; id < tags->count; id++) {
+		tags->tags[id].new_count = 0;
+		tags->tags[id].free_count = 0;
+	}
+}
+
+void Memory_Profiler_Tags_mark(struct Memory_Profiler_Tags *tags) {
+	for (size_t id = 2; id < tags->count; id++) {
+		rb_gc_mark(tags->tags[id].value);
+	}
+}
+
+size_t Memory_Profiler_Tags_memsize(const struct Memory_Profiler_Tags *tags) {
+	return tags->capacity * sizeof(struct Memory_Profiler_Tag) + tags->index_capacity * sizeof(uint32_t);
+}
@@ -0,0 +1,60 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <ruby.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+	// Allocations not attributed to a tag (tags were not tracked):
+	MEMORY_PROFILER_TAGS_NONE = 0,
+	
+	// Allocations made while the current fiber had no tag, or that could not be given a tag:
+	MEMORY_PROFILER_TAGS_UNTAGGED = 1,
+};
+
+// An execution context tag (any object, set per fiber), and the allocations recorded for it, weighted by sampling.
+struct Memory_Profiler_Tag {
+	VALUE value;
+	
+	size_t new_count;
+	size_t free_count;
+};
+
+// Registry of tags for a capture.
+// Tags are interned from the event hook, so it uses system malloc and never allocates Ruby objects. Tags are found by identity, and are pinned by the owner's mark function, so a capture retains every tag it has seen (Capture.tag= only accepts immediate and frozen values, so this can't keep fibers or other mutable objects alive). Ids are never reused.
+struct Memory_Profiler_Tags {
+	// Tags by id (ids 0 and 1 are reserved):
+	struct Memory_Profiler_Tag *tags;
+	size_t count;
+	size_t capacity;
+	
+	// Tag => id index (capacity is a power of two, or zero if not allocated, 0 = empty):
+	uint32_t *index;
+	size_t index_capacity;
+};
+
+// Initialize an empty registry (no allocation).
+void Memory_Profiler_Tags_initialize(struct Memory_Profiler_Tags *tags);
+
+// Free the registry, leaving it empty.
+void Memory_Profiler_Tags_free(struct Memory_Profiler_Tags *tags);
+
+// Find or create a tag (nil for untagged allocations). Never allocates Ruby objects, so it is safe from event hooks. The owner must issue a write barrier for the value (RB_OBJ_WRITTEN) as it may now be referenced. Returns MEMORY_PROFILER_TAGS_UNTAGGED if the tag can't be created.
+uint32_t Memory_Profiler_Tags_intern(struct Memory_Profiler_Tags *tags, VALUE value);
+
+// Get a tag by id, or NULL if there is none. Does not allocate.
+static inline struct Memory_Profiler_Tag* Memory_Profiler_Tags_get(struct Memory_Profiler_Tags *tags, uint32_t id) {
+	return id != MEMORY_PROFILER_TAGS_NONE && id < tags->count ? &tags->tags[id] : NULL;
+}
+
+// Reset the counters of every tag, keeping the ids.
+void Memory_Profiler_Tags_clear(struct Memory_Profiler_Tags *tags);
+
+// Mark the tag values (pinned).
+void Memory_Profiler_Tags_mark(struct Memory_Profiler_Tags *tags);
+
+// Memory used by the registry.
+size_t Memory_Profiler_Tags_memsize(const struct Memory_Profiler_Tags *tags);
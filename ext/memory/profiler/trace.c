@@ -0,0 +1,277 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#include "trace.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+enum {
+	INITIAL_CAPACITY = 2 * MEMORY_PROFILER_TRACE_FLUSH_SIZE,
+	
+	// The largest record, other than CLASS: a tag and five 64-bit varints:
+	MAXIMUM_RECORD_SIZE = 1 + 5 * 10,
+};
+
+static const char MAGIC[7] = {'M', 'P', 'T', 'R', 'A', 'C', 'E'};
+
+static inline uint64_t monotonic_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static inline size_t put_varint(unsigned char *buffer, uint64_t value) {
+	size_t size = 0;
+	
+	while (value >= 0x80) {
+		buffer[size++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	
+	buffer[size++] = (unsigned char)value;
+	
+	return size;
+}
+
+// Zigzag encoding maps small negative deltas to small unsigned values:
+static inline size_t put_delta(unsigned char *buffer, uintptr_t from, uintptr_t to) {
+	int64_t delta = (int64_t)(to - from);
+	
+	return put_varint(buffer, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+}
+
+// Make room for a record of up to size bytes, returns zero if the record must be dropped. Does not flush, so it's safe during GC.
+static int reserve(struct Memory_Profiler_Trace *trace, size_t size) {
+	if (trace->error) {
+		trace->dropped++;
+		return 0;
+	}
+	
+	if (trace->size + size <= trace->capacity) return 1;
+	
+	size_t capacity = trace->capacity * 2;
+	while (capacity < trace->size + size) capacity *= 2;
+	
+	unsigned char *buffer = realloc(trace->buffer, capacity);
+	if (!buffer) {
+		trace->dropped++;
+		return 0;
+	}
+	
+	trace->buffer = buffer;
+	trace->capacity = capacity;
+	
+	return 1;
+}
+
+static inline void commit(struct Memory_Profiler_Trace *trace, size_t size) {
+	trace->size += size;
+	trace->bytes += size;
+	trace->records++;
+}
+
+// The time since the previous record:
+static inline uint64_t elapsed(struct Memory_Profiler_Trace *trace, uint64_t time) {
+	uint64_t delta = time > trace->time ? time - trace->time : 0;
+	if (time > trace->time) trace->time = time;
+	
+	return delta;
+}
+
+struct Memory_Profiler_Trace* Memory_Profiler_Trace_new(int descriptor) {
+	struct Memory_Profiler_Trace *trace = calloc(1, sizeof(struct Memory_Profiler_Trace));
+	if (!trace) return NULL;
+	
+	trace->buffer = malloc(INITIAL_CAPACITY);
+	if (!trace->buffer) {
+		free(trace);
+		return NULL;
+	}
+	
+	trace->descriptor = descriptor;
+	trace->capacity = INITIAL_CAPACITY;
+	trace->time = monotonic_time();
+	
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	uint64_t start_time = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+	
+	memcpy(trace->buffer, MAGIC, sizeof(MAGIC));
+	trace->buffer[7] = MEMORY_PROFILER_TRACE_VERSION;
+	for (int i = 0; i < 8; i++) {
+		trace->buffer[8 + i] = (unsigned char)(start_time >> (i * 8));
+	}
+	
+	trace->size = trace->bytes = MEMORY_PROFILER_TRACE_HEADER_SIZE;
+	
+	return trace;
+}
+
+void Memory_Profiler_Trace_free(struct Memory_Profiler_Trace *trace) {
+	if (!trace) return;
+	
+	free(trace->buffer);
+	free(trace->classes);
+	free(trace->sites);
+	
+	if (trace->descriptor >= 0) close(trace->descriptor);
+	
+	free(trace);
+}
+
+int Memory_Profiler_Trace_class_p(struct Memory_Profiler_Trace *trace, uint32_t id, VALUE klass) {
+	return id < trace->classes_capacity && trace->classes[id] == klass;
+}
+
+void Memory_Profiler_Trace_class(struct Memory_Profiler_Trace *trace, uint32_t id, VALUE klass, const char *name, size_t length) {
+	if (id >= trace->classes_capacity) {
+		size_t capacity = trace->classes_capacity ? trace->classes_capacity : 64;
+		while (capacity <= id) capacity *= 2;
+		
+		VALUE *classes = realloc(trace->classes, capacity * sizeof(VALUE));
+		if (!classes) {
+			trace->dropped++;
+			return;
+		}
+		
+		memset(classes + trace->classes_capacity, 0, (capacity - trace->classes_capacity) * sizeof(VALUE));
+		trace->classes = classes;
+		trace->classes_capacity = capacity;
+	}
+	
+	if (!reserve(trace, 1 + 5 + 10 + length)) return;
+	
+	unsigned char *buffer = trace->buffer + trace->size;
+	size_t size = 0;
+	
+	buffer[size++] = MEMORY_PROFILER_TRACE_CLASS;
+	size += put_varint(buffer + size, id);
+	size += put_varint(buffer + size, length);
+	memcpy(buffer + size, name, length);
+	size += length;
+	
+	commit(trace, size);
+	trace->classes[id] = klass;
+}
+
+int Memory_Profiler_Trace_site_p(struct Memory_Profiler_Trace *trace, uint32_t id) {
+	return id < trace->sites_capacity && trace->sites[id];
+}
+
+void Memory_Profiler_Trace_site(struct Memory_Profiler_Trace *trace, uint32_t id, const char *path, size_t length, int line) {
+	if (id >= trace->sites_capacity) {
+		size_t capacity = trace->sites_capacity ? trace->sites_capacity : 256;
+		while (capacity <= id) capacity *= 2;
+		
+		unsigned char *sites = realloc(trace->sites, capacity);
+		if (!sites) {
+			trace->dropped++;
+			return;
+		}
+		
+		memset(sites + trace->sites_capacity, 0, capacity - trace->sites_capacity);
+		trace->sites = sites;
+		trace->sites_capacity = capacity;
+	}
+	
+	if (!reserve(trace, 1 + 5 + 5 + 10 + length)) return;
+	
+	unsigned char *buffer = trace->buffer + trace->size;
+	size_t size = 0;
+	
+	buffer[size++] = MEMORY_PROFILER_TRACE_SITE;
+	size += put_varint(buffer + size, id);
+	size += put_varint(buffer + size, line > 0 ? (uint64_t)line : 0);
+	size += put_varint(buffer + size, length);
+	memcpy(buffer + size, path, length);
+	size += length;
+	
+	commit(trace, size);
+	trace->sites[id] = 1;
+}
+
+void Memory_Profiler_Trace_newobj(struct Memory_Profiler_Trace *trace, uint64_t time, VALUE object, uint32_t id, size_t size, unsigned int shift, uint32_t site) {
+	if (!reserve(trace, MAXIMUM_RECORD_SIZE)) return;
+	
+	unsigned char *buffer = trace->buffer + trace->size;
+	size_t length = 0;
+	
+	buffer[length++] = MEMORY_PROFILER_TRACE_NEWOBJ | (shift << MEMORY_PROFILER_TRACE_SHIFT_OFFSET) | (site ? MEMORY_PROFILER_TRACE_HAS_SITE : 0);
+	length += put_varint(buffer + length, elapsed(trace, time));
+	length += put_delta(buffer + length, trace->address, object);
+	length += put_varint(buffer + length, id);
+	length += put_varint(buffer + length, size);
+	if (site) length += put_varint(buffer + length, site);
+	
+	trace->address = object;
+	commit(trace, length);
+}
+
+void Memory_Profiler_Trace_freeobj(struct Memory_Profiler_Trace *trace, uint64_t time, VALUE object, uint32_t id) {
+	if (!reserve(trace, MAXIMUM_RECORD_SIZE)) return;
+	
+	unsigned char *buffer = trace->buffer + trace->size;
+	size_t length = 0;
+	
+	buffer[length++] = MEMORY_PROFILER_TRACE_FREEOBJ;
+	length += put_varint(buffer + length, elapsed(trace, time));
+	length += put_delta(buffer + length, trace->address, object);
+	length += put_varint(buffer + length, id);
+	
+	trace->address = object;
+	commit(trace, length);
+}
+
+void Memory_Profiler_Trace_moved(struct Memory_Profiler_Trace *trace, uint64_t time, VALUE from, VALUE to) {
+	if (!reserve(trace, MAXIMUM_RECORD_SIZE)) return;
+	
+	unsigned char *buffer = trace->buffer + trace->size;
+	size_t length = 0;
+	
+	buffer[length++] = MEMORY_PROFILER_TRACE_MOVED;
+	length += put_varint(buffer + length, elapsed(trace, time));
+	length += put_delta(buffer + length, trace->address, from);
+	length += put_delta(buffer + length, from, to);
+	
+	trace->address = to;
+	commit(trace, length);
+}
+
+int Memory_Profiler_Trace_flush(struct Memory_Profiler_Trace *trace) {
+	size_t offset = 0;
+	
+	while (offset < trace->size && !trace->error) {
+		ssize_t result = write(trace->descriptor, trace->buffer + offset, trace->size - offset);
+		
+		if (result < 0) {
+			if (errno == EINTR) continue;
+			trace->error = errno;
+		} else {
+			offset += (size_t)result;
+		}
+	}
+	
+	trace->size = 0;
+	
+	return !trace->error;
+}
+
+size_t Memory_Profiler_Trace_memsize(const struct Memory_Profiler_Trace *trace) {
+	return sizeof(struct Memory_Profiler_Trace) + trace->capacity + trace->classes_capacity * sizeof(VALUE) + trace->sites_capacity;
+}
+
+VALUE Memory_Profiler_Trace_statistics(const struct Memory_Profiler_Trace *trace) {
+	VALUE statistics = rb_hash_new();
+	
+	rb_hash_aset(statistics, ID2SYM(rb_intern("records")), SIZET2NUM(trace->records));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("bytes")), SIZET2NUM(trace->bytes));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("buffered")), SIZET2NUM(trace->size));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("dropped")), SIZET2NUM(trace->dropped));
+	rb_hash_aset(statistics, ID2SYM(rb_intern("error")), trace->error ? rb_str_new_cstr(strerror(trace->error)) : Qnil);
+	
+	return statistics;
+}
@@ -0,0 +1,113 @@
+// Released under the MIT License.
+// Copyright, 2025, by Samuel Williams.
+
+#pragma once
+
+#include <ruby.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary event trace format (all integers are LEB128 varints, addresses are zigzag encoded deltas):
+//
+//   header:  "MPTRACE" version(1 byte) start_time(wall clock nanoseconds, 8 bytes little endian)
+//   record:  tag(1 byte) fields...
+//
+// The low 3 bits of the tag are the record type, bits 3-6 hold the sampling shift of a NEWOBJ (it stands for 2^shift allocations), and bit 7 is set if a NEWOBJ has a site id.
+//
+//   NEWOBJ   time address class size [site]
+//   FREEOBJ  time address class
+//   MOVED    time from to
+//   CLASS    class name_length name
+//   SITE     site line path_length path
+//
+// Times are nanoseconds since the previous record (or the start of the trace). Addresses are relative to the previous address (from, for the `to` of a MOVED), and a MOVED leaves `to` as the previous address. A CLASS record names a class id before its first use, and again if the id is reused for another class. A SITE record names a site id before its first use (an empty path is an unknown location).
+enum {
+	MEMORY_PROFILER_TRACE_VERSION = 1,
+	MEMORY_PROFILER_TRACE_HEADER_SIZE = 16,
+	
+	MEMORY_PROFILER_TRACE_NEWOBJ = 1,
+	MEMORY_PROFILER_TRACE_FREEOBJ = 2,
+	MEMORY_PROFILER_TRACE_MOVED = 3,
+	MEMORY_PROFILER_TRACE_CLASS = 4,
+	MEMORY_PROFILER_TRACE_SITE = 5,
+	
+	MEMORY_PROFILER_TRACE_TYPE_MASK = 0x07,
+	MEMORY_PROFILER_TRACE_SHIFT_OFFSET = 3,
+	MEMORY_PROFILER_TRACE_HAS_SITE = 0x80,
+	
+	// The buffer is written out once it holds this much:
+	MEMORY_PROFILER_TRACE_FLUSH_SIZE = 64 * 1024,
+};
+
+// Buffered writer of the event trace of a capture.
+// Records are appended to a buffer (system malloc, so moves can be recorded during GC compaction), which is only written to the file descriptor by Memory_Profiler_Trace_flush, called while processing events, never from the event hook.
+struct Memory_Profiler_Trace {
+	int descriptor;
+	
+	unsigned char *buffer;
+	size_t size;
+	size_t capacity;
+	
+	// The previous record's time and address, which the next record is relative to:
+	uint64_t time;
+	uintptr_t address;
+	
+	// The class each id was last named as, so CLASS records are only written when needed (0 = not named yet):
+	VALUE *classes;
+	size_t classes_capacity;
+	
+	// Whether each site id has been named (site ids are never reused):
+	unsigned char *sites;
+	size_t sites_capacity;
+	
+	// Records and bytes written (or waiting in the buffer), and records dropped:
+	size_t records;
+	size_t bytes;
+	size_t dropped;
+	
+	// The errno of the first failed write. Once set, every later record is dropped, so the file ends with a valid prefix of the trace:
+	int error;
+};
+
+// Create a trace writing to the file descriptor, which the trace owns and closes when freed. Returns NULL if out of memory (the descriptor is left open).
+struct Memory_Profiler_Trace* Memory_Profiler_Trace_new(int descriptor);
+
+// Free the trace and close its file descriptor, discarding anything still buffered (flush first to keep it).
+void Memory_Profiler_Trace_free(struct Memory_Profiler_Trace *trace);
+
+// Whether the class has been named for the id in the trace.
+int Memory_Profiler_Trace_class_p(struct Memory_Profiler_Trace *trace, uint32_t id, VALUE klass);
+
+// Name the class for the id. The class is only compared by identity, never dereferenced.
+void Memory_Profiler_Trace_class(struct Memory_Profiler_Trace *trace, uint32_t id, VALUE klass, const char *name, size_t length);
+
+// Whether the site has been named in the trace.
+int Memory_Profiler_Trace_site_p(struct Memory_Profiler_Trace *trace, uint32_t id);
+
+// Name the site for the id.
+void Memory_Profiler_Trace_site(struct Memory_Profiler_Trace *trace, uint32_t id, const char *path, size_t length, int line);
+
+// Record an allocation. The site is optional (0 = none).
+void Memory_Profiler_Trace_newobj(struct Memory_Profiler_Trace *trace, uint64_t time, VALUE object, uint32_t id, size_t size, unsigned int shift, uint32_t site);
+
+// Record a free.
+void Memory_Profiler_Trace_freeobj(struct Memory_Profiler_Trace *trace, uint64_t time, VALUE object, uint32_t id);
+
+// Record an object moved by compaction. Does not flush, so it's safe during GC.
+void Memory_Profiler_Trace_moved(struct Memory_Profiler_Trace *trace, uint64_t time, VALUE from, VALUE to);
+
+// Write the buffer to the file descriptor. Returns zero if a write failed (see error).
+int Memory_Profiler_Trace_flush(struct Memory_Profiler_Trace *trace);
+
+// Flush if the buffer is full enough.
+static inline void Memory_Profiler_Trace_flush_if_full(struct Memory_Profiler_Trace *trace) {
+	if (trace->size >= MEMORY_PROFILER_TRACE_FLUSH_SIZE) {
+		Memory_Profiler_Trace_flush(trace);
+	}
+}
+
+// Memory used by the buffer and the class and site names.
+size_t Memory_Profiler_Trace_memsize(const struct Memory_Profiler_Trace *trace);
+
+// Statistics: {records:, bytes:, dropped:, buffered:, error:}.
+VALUE Memory_Profiler_Trace_statistics(const struct Memory_Profiler_Trace *trace);
@@ -8,3 +8,4 @@ require_relative "profiler/call_tree"
 require_relative "profiler/capture"
 require_relative "profiler/allocations"
 require_relative "profiler/sampler"
+require_relative "profiler/trace"
@@ -3,4 +3,24 @@
 # Released under the MIT License.
 # Copyright, 2025, by Samuel Williams.
 
-require_relative "native"
\ No newline at end of file
+require_relative "native"
+
+module Memory
+	module Profiler
+		class Capture
+			# Tag the allocations made by the current fiber while the block runs, restoring the previous tag afterwards.
+			# Captures with {track_tags} enabled count these allocations, and their frees, against the tag (see {each_tag}). Tags are compared by identity and retained by the capture, so they must be immediate or frozen values, and a small set of them, such as symbols naming kinds of work, works best.
+			# @parameter tag [Symbol | Integer | Object] The tag, e.g. `:request`. Must be immediate or frozen.
+			# @raises [ArgumentError] If the tag is a mutable object.
+			# @returns [Object] The result of the block.
+			def self.tagged(tag)
+				previous = self.tag
+				self.tag = tag
+				
+				yield
+			ensure
+				self.tag = previous
+			end
+		end
+	end
+end
@@ -96,7 +96,9 @@ module Memory
 			# @parameter prune_threshold [Integer] Number of insertions before auto-pruning (nil = no auto-pruning).
 			# @parameter gc [Hash | Nil] Run GC with these options before each sample (nil = don't run GC).
 			# @parameter track_all [Boolean] Automatically track all classes that allocate objects (default: true).
-			def initialize(depth: 4, filter: nil, increases_threshold: 10, prune_limit: 5, prune_threshold: nil, gc: nil, track_all: true)
+			# @parameter maximum_classes [Integer | Nil] Maximum number of automatically tracked classes, beyond which the least retained are merged into {Capture#other} (nil = unlimited).
+			# @parameter overhead_budget [Float | Nil] Fraction of CPU time the capture may use, by recording a sample of allocations (nil = record every allocation). See {Capture#overhead_budget}.
+			def initialize(depth: 4, filter: nil, increases_threshold: 10, prune_limit: 5, prune_threshold: nil, gc: nil, track_all: true, maximum_classes: nil, overhead_budget: nil)
 				@depth = depth
 				@filter = filter || default_filter
 				@increases_threshold = increases_threshold
@@ -106,6 +108,8 @@ module Memory
 				
 				@capture = Capture.new
 				@capture.track_all = track_all
+				@capture.maximum_classes = maximum_classes
+				@capture.overhead_budget = overhead_budget
 				@call_trees = {}
 				@samples = {}
 			end
@@ -197,8 +201,8 @@ module Memory
 			#
 			# @yields {|sample| ...} Called when a class shows significant growth.
 			def sample!
-				@capture.each do |klass, allocations|
-					count = allocations.retained_count
+				# Copy the counters natively, rather than wrapping each class in an Allocations object:
+				@capture.snapshot.each do |klass, new_count, free_count, count|
 					sample = @samples[klass] ||= Sample.new(klass, count)
 					increased = false
 					
@@ -209,7 +213,7 @@ module Memory
 						if sample.increases >= @increases_threshold
 							# Start tracking with call path analysis if not already doing so:
 							unless tracking?(klass)
-								track(klass, allocations)
+								track(klass, @capture[klass])
 							end
 						end
 					end
@@ -219,6 +223,11 @@ module Memory
 					end
 				end
 				
+				# Forget samples of classes that were merged into "other":
+				if @capture.maximum_classes
+					@samples.select!{|klass, sample| @capture.tracking?(klass)}
+				end
+				
 				# Prune call trees to control memory usage
 				prune_call_trees!
 			end
@@ -304,10 +313,17 @@ module Memory
 				end
 				
 				if retained_addresses
-					addresses = []
-					@capture.each_object(klass) do |object, state|
-						addresses << Memory::Profiler.address_of(object)
-						break if retained_addresses.is_a?(Integer) && addresses.size >= retained_addresses
+					if retained_addresses.is_a?(Integer) && retained_addresses <= Capture::SAMPLE_SIZE
+						# A random sample of the live objects is maintained for each class, so there is no need to scan the object table:
+						addresses = @capture.sample_objects(klass).first(retained_addresses).map do |object|
+							Memory::Profiler.address_of(object)
+						end
+					else
+						addresses = []
+						@capture.each_object(klass) do |object, state|
+							addresses << Memory::Profiler.address_of(object)
+							break if retained_addresses.is_a?(Integer) && addresses.size >= retained_addresses
+						end
 					end
 					
 					result[:retained_addresses] = addresses
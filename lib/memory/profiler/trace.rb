@@ -0,0 +1,229 @@
+# frozen_string_literal: true
+
+# Released under the MIT License.
+# Copyright, 2025, by Samuel Williams.
+
+module Memory
+	module Profiler
+		# Reads the binary event traces written by {Capture#trace=}, one record at a time, so traces of any size can be read with bounded memory.
+		#
+		# See `ext/memory/profiler/trace.h` for the format.
+		class Trace
+			MAGIC = "MPTRACE".b
+			VERSION = 1
+			
+			NEWOBJ = 1
+			FREEOBJ = 2
+			MOVED = 3
+			CLASS = 4
+			SITE = 5
+			
+			# A decoded record. The time is in nanoseconds since the start of the trace. For `:moved` records, the address is where the object was, and `to` is where it moved to.
+			Event = Struct.new(:type, :time, :address, :class_id, :size, :weight, :site, :to)
+			
+			# The error raised if the input is not a trace.
+			class FormatError < StandardError
+			end
+			
+			BUFFER_SIZE = 64 * 1024
+			
+			# Open a trace file.
+			#
+			# @parameter path [String] The path of the trace file.
+			# @yields {|trace| ...} If a block is given, the file is closed after the block returns.
+			# 	@parameter trace [Trace] The trace.
+			def self.open(path)
+				file = File.open(path, "rb")
+				trace = self.new(file)
+				
+				return trace unless block_given?
+				
+				begin
+					yield trace
+				ensure
+					file.close
+				end
+			end
+			
+			# Read a trace from an IO.
+			#
+			# @parameter io [IO] The input, positioned at the start of the trace.
+			def initialize(io)
+				@io = io
+				@buffer = String.new(capacity: BUFFER_SIZE, encoding: Encoding::BINARY)
+				@offset = 0
+				
+				header = read_exactly(16)
+				unless header && header.byteslice(0, 7) == MAGIC
+					raise FormatError, "Not a memory profiler trace!"
+				end
+				
+				@version = header.getbyte(7)
+				unless @version == VERSION
+					raise FormatError, "Unsupported trace version: #{@version}!"
+				end
+				
+				nanoseconds = header.byteslice(8, 8).unpack1("Q<")
+				@start_time = Time.at(nanoseconds / 1_000_000_000, nanoseconds % 1_000_000_000, :nanosecond)
+				
+				@classes = {}
+				@sites = {}
+				@time = 0
+				@address = 0
+			end
+			
+			# @attribute [Time] The wall clock time the trace started.
+			attr :start_time
+			
+			# @attribute [Hash(Integer, String)] The class names seen so far, by class id. Ids can be reused for other classes, so the name of an id is only valid for the records that follow it.
+			attr :classes
+			
+			# @attribute [Hash(Integer, String)] The allocation sites seen so far, as `path:line`, by site id.
+			attr :sites
+			
+			# The name of the class with the given id, as of the records read so far.
+			#
+			# @parameter class_id [Integer] The class id of a record.
+			# @returns [String | Nil] The class name.
+			def class_name(class_id)
+				@classes[class_id]
+			end
+			
+			# The location of the allocation site with the given id.
+			#
+			# @parameter site [Integer] The site id of a record.
+			# @returns [String | Nil] The location, as `path:line`.
+			def site_name(site)
+				@sites[site]
+			end
+			
+			# Read the next record.
+			#
+			# @returns [Event | Nil] The next allocation, free or move, or nil at the end of the trace. A truncated final record is treated as the end of the trace.
+			def read
+				while tag = read_byte
+					case tag & 0x07
+					when NEWOBJ
+						time = read_time or return nil
+						address = read_address or return nil
+						class_id = read_varint or return nil
+						size = read_varint or return nil
+						site = nil
+						
+						if tag & 0x80 != 0
+							site = read_varint or return nil
+						end
+						
+						return Event.new(:newobj, time, address, class_id, size, 1 << ((tag >> 3) & 0x0F), site)
+					when FREEOBJ
+						time = read_time or return nil
+						address = read_address or return nil
+						class_id = read_varint or return nil
+						
+						return Event.new(:freeobj, time, address, class_id)
+					when MOVED
+						time = read_time or return nil
+						from = read_address or return nil
+						delta = read_varint or return nil
+						@address = from + decode_delta(delta)
+						
+						return Event.new(:moved, time, from, nil, nil, nil, nil, @address)
+					when CLASS
+						class_id = read_varint or return nil
+						length = read_varint or return nil
+						name = read_exactly(length) or return nil
+						
+						@classes[class_id] = name.force_encoding(Encoding::UTF_8)
+					when SITE
+						site = read_varint or return nil
+						line = read_varint or return nil
+						length = read_varint or return nil
+						path = read_exactly(length) or return nil
+						
+						@sites[site] = path.empty? ? "(unknown)" : "#{path.force_encoding(Encoding::UTF_8)}:#{line}"
+					else
+						raise FormatError, "Unknown record type: #{tag & 0x07}!"
+					end
+				end
+				
+				return nil
+			end
+			
+			# Enumerate the records of the trace.
+			#
+			# @yields {|event| ...} Each allocation, free or move.
+			# 	@parameter event [Event] The record.
+			def each
+				return to_enum(:each) unless block_given?
+				
+				while event = read
+					yield event
+				end
+			end
+			
+			include Enumerable
+			
+			private
+			
+			def fill
+				return false if @io.eof?
+				
+				@buffer = @buffer.byteslice(@offset, @buffer.bytesize - @offset) + @io.readpartial(BUFFER_SIZE)
+				@offset = 0
+				
+				return true
+			end
+			
+			def read_byte
+				if @offset >= @buffer.bytesize
+					return nil unless fill
+				end
+				
+				byte = @buffer.getbyte(@offset)
+				@offset += 1
+				
+				return byte
+			end
+			
+			def read_varint
+				value = 0
+				shift = 0
+				
+				while byte = read_byte
+					value |= (byte & 0x7F) << shift
+					return value if byte < 0x80
+					shift += 7
+				end
+				
+				return nil
+			end
+			
+			def read_exactly(size)
+				while @buffer.bytesize - @offset < size
+					return nil unless fill
+				end
+				
+				data = @buffer.byteslice(@offset, size)
+				@offset += size
+				
+				return data
+			end
+			
+			def decode_delta(value)
+				(value >> 1) ^ -(value & 1)
+			end
+			
+			def read_time
+				if delta = read_varint
+					@time += delta
+				end
+			end
+			
+			def read_address
+				if delta = read_varint
+					@address += decode_delta(delta)
+				end
+			end
+		end
+	end
+end
@@ -0,0 +1,331 @@
+# frozen_string_literal: true
+
+# Released under the MIT License.
+# Copyright, 2025, by Samuel Williams.
+
+require_relative "../trace"
+
+require "json"
+require "time"
+
+module Memory
+	module Profiler
+		class Trace
+			# Analyzes a trace offline, in a single pass over its records.
+			#
+			# Memory is bounded by the number of objects live at any one time in the trace, not by its length: only live objects and per-class and per-site aggregates are kept.
+			class Analyzer
+				# Object lifetimes, counted in power of two buckets of nanoseconds.
+				class Histogram
+					def initialize
+						@counts = Array.new(65, 0)
+						@count = 0
+					end
+					
+					# @attribute [Integer] The number of values added.
+					attr :count
+					
+					# Add a value.
+					#
+					# @parameter nanoseconds [Integer] The lifetime.
+					# @parameter weight [Integer] The number of objects it stands for.
+					def add(nanoseconds, weight = 1)
+						@counts[nanoseconds.bit_length] += weight
+						@count += weight
+					end
+					
+					# An upper bound of the given percentile, to within a factor of two.
+					#
+					# @parameter percentile [Numeric] Between 0 and 100.
+					# @returns [Float | Nil] The lifetime in seconds, or nil if the histogram is empty.
+					def percentile(percentile)
+						return nil if @count.zero?
+						
+						target = (@count * percentile / 100.0).ceil.clamp(1, @count)
+						total = 0
+						
+						@counts.each_with_index do |count, bucket|
+							total += count
+							return upper_bound(bucket) if total >= target
+						end
+					end
+					
+					def as_json(*)
+						{
+							count: @count,
+							p50: percentile(50),
+							p90: percentile(90),
+							p99: percentile(99),
+							buckets: @counts.each_with_index.filter_map{|count, bucket| [upper_bound(bucket), count] if count > 0},
+						}
+					end
+					
+					private
+					
+					def upper_bound(bucket)
+						((1 << bucket) - 1) / 1_000_000_000.0
+					end
+				end
+				
+				# Per-class counts, weighted by sampling.
+				class Statistics
+					def initialize(name)
+						@name = name
+						@allocated = 0
+						@freed = 0
+						@allocated_bytes = 0
+						@freed_bytes = 0
+						@lifetimes = Histogram.new
+					end
+					
+					attr :name
+					attr_accessor :allocated
+					attr_accessor :freed
+					attr_accessor :allocated_bytes
+					attr_accessor :freed_bytes
+					
+					# @attribute [Histogram] The lifetimes of the objects freed during the trace.
+					attr :lifetimes
+					
+					def retained
+						@allocated - @freed
+					end
+					
+					def retained_bytes
+						@allocated_bytes - @freed_bytes
+					end
+					
+					def as_json(duration)
+						{
+							name: @name,
+							allocated: @allocated,
+							freed: @freed,
+							retained: retained,
+							allocated_bytes: @allocated_bytes,
+							retained_bytes: retained_bytes,
+							allocations_per_second: rate(@allocated, duration),
+							frees_per_second: rate(@freed, duration),
+							churn: @allocated.zero? ? 0.0 : @freed.fdiv(@allocated),
+							lifetime: @lifetimes.as_json,
+						}
+					end
+					
+					private
+					
+					def rate(count, duration)
+						duration > 0 ? count / duration : 0.0
+					end
+				end
+				
+				# The objects of one class allocated at one site (the location, or nil if the trace has no sites).
+				Site = Struct.new(:name, :site, :allocated, :retained, :retained_bytes, :age)
+				
+				# A live object: when it was allocated, what it is and how many allocations it stands for.
+				Allocation = Struct.new(:time, :statistics, :weight, :size, :site)
+				
+				# @parameter interval [Numeric] Seconds between the points of the retained curve, at least one nanosecond.
+				# @parameter maximum_points [Integer] When the curve would have more points, the interval is doubled and every other point discarded.
+				# @raises [ArgumentError] If the interval is less than one nanosecond.
+				def initialize(interval: 1.0, maximum_points: 1000)
+					@interval = (interval * 1_000_000_000).to_i
+					
+					# The curve advances one interval at a time, so it would never catch up:
+					unless @interval > 0
+						raise ArgumentError, "interval must be at least one nanosecond!"
+					end
+					@maximum_points = maximum_points
+					
+					@classes = {}
+					@sites = {}
+					@objects = {}
+					
+					@points = []
+					@next_point = @interval
+					
+					@records = 0
+					@time = 0
+					@start_time = nil
+				end
+				
+				# @attribute [Hash(String, Statistics)] Per-class statistics, by class name.
+				attr :classes
+				
+				# @attribute [Integer] The number of records analyzed.
+				attr :records
+				
+				# @attribute [Time | Nil] The wall clock time the trace started.
+				attr :start_time
+				
+				# @returns [Float] The seconds between the start of the trace and its last record.
+				def duration
+					@time / 1_000_000_000.0
+				end
+				
+				# @returns [Float] The seconds between the points of the retained curve.
+				def interval
+					@interval / 1_000_000_000.0
+				end
+				
+				# Analyze every record of a trace.
+				#
+				# @parameter trace [Trace] The trace, which is read to the end.
+				# @returns [Analyzer] Self.
+				def analyze(trace)
+					@start_time ||= trace.start_time
+					
+					trace.each do |event|
+						add(event, trace.class_name(event.class_id), event.site && trace.site_name(event.site))
+					end
+					
+					return self
+				end
+				
+				# Analyze one record.
+				#
+				# @parameter event [Event] The record.
+				# @parameter class_name [String | Nil] The name of the record's class, at the time of the record.
+				# @parameter site_name [String | Nil] The location of the record's allocation site.
+				def add(event, class_name = nil, site_name = nil)
+					@records += 1
+					advance(event.time)
+					
+					case event.type
+					when :newobj
+						statistics = (@classes[class_name || "(unknown)"] ||= Statistics.new(class_name || "(unknown)"))
+						statistics.allocated += event.weight
+						statistics.allocated_bytes += event.size * event.weight
+						
+						location = site_name || (event.site && "site #{event.site}")
+						site = (@sites[[statistics.name, location]] ||= Site.new(statistics.name, location, 0, 0, 0, 0))
+						site.allocated += event.weight
+						
+						# An object we never saw freed, e.g. if records were dropped, is replaced:
+						if previous = @objects[event.address]
+							free(previous, event.time)
+						end
+						
+						@objects[event.address] = Allocation.new(event.time, statistics, event.weight, event.size, site)
+					when :freeobj
+						if object = @objects.delete(event.address)
+							free(object, event.time)
+						end
+					when :moved
+						if object = @objects.delete(event.address)
+							@objects[event.to] = object
+						end
+					end
+				end
+				
+				# The number of objects of each class retained over time, one point per interval.
+				#
+				# @parameter classes [Array(String) | Nil] The classes to include, or nil for all of them.
+				# @returns [Array(Hash)] Each point's time in seconds, the total retained of all classes, and the retained count of each included class.
+				def retained_curve(classes = nil)
+					# The last point is the state at the end of the trace:
+					points = @points.reject{|time, _| time == @time} << [@time, current_point]
+					
+					points.map do |time, counts|
+						total = counts.each_value.sum
+						counts = counts.slice(*classes) if classes
+						
+						{time: time / 1_000_000_000.0, total: total, classes: counts}
+					end
+				end
+				
+				# The sites (or classes, for traces without sites) with the most objects still live at the end of the trace.
+				#
+				# @parameter limit [Integer] The number of sites.
+				# @returns [Array(Site)] The sites, most retained first. The age is the mean age of the live objects, in seconds.
+				def leaking_sites(limit = 10)
+					sites = {}
+					
+					@objects.each_value do |object|
+						site = object.site
+						entry = (sites[site] ||= Site.new(site.name, site.site, site.allocated, 0, 0, 0))
+						
+						entry.retained += object.weight
+						entry.retained_bytes += object.size * object.weight
+						entry.age += (@time - object.time) * object.weight
+					end
+					
+					sites.each_value do |site|
+						site.age = site.age / site.retained / 1_000_000_000.0
+					end
+					
+					sites.each_value.max_by(limit, &:retained)
+				end
+				
+				# Write folded stacks (`class;site count` lines), as read by flame graph tools. Semicolons and whitespace separate frames and counts, so they are replaced in class names and paths.
+				#
+				# @parameter output [IO] The output.
+				# @parameter metric [Symbol] Either `:retained` (objects live at the end of the trace) or `:allocated`.
+				def write_folded(output, metric: :retained)
+					sites = (metric == :retained) ? leaking_sites(@sites.size) : @sites.each_value
+					
+					sites.each do |site|
+						count = site[metric]
+						next if count.zero?
+						
+						frames = site.site ? "#{frame(site.name)};#{frame(site.site)}" : frame(site.name)
+						output.puts "#{frames} #{count}"
+					end
+				end
+				
+				# A summary of the analysis.
+				#
+				# @parameter top [Integer] The number of classes and sites to include.
+				def as_json(top: 20)
+					classes = @classes.each_value.max_by(top, &:retained)
+					
+					{
+						start_time: @start_time&.utc&.iso8601(9),
+						duration: duration,
+						records: @records,
+						interval: interval,
+						classes: classes.map{|statistics| statistics.as_json(duration)},
+						retained: retained_curve(classes.map(&:name)),
+						sites: leaking_sites(top).map(&:to_h),
+					}
+				end
+				
+				def to_json(*arguments)
+					as_json.to_json(*arguments)
+				end
+				
+				private
+				
+				def frame(name)
+					name.tr(";", ":").gsub(/\s/, "_")
+				end
+				
+				def free(object, time)
+					statistics = object.statistics
+					
+					statistics.freed += object.weight
+					statistics.freed_bytes += object.size * object.weight
+					statistics.lifetimes.add(time - object.time, object.weight)
+				end
+				
+				def current_point
+					@classes.each_value.filter_map{|statistics| [statistics.name, statistics.retained] if statistics.retained > 0}.to_h
+				end
+				
+				# Add the points the trace has passed, as of the state before the record at the given time:
+				def advance(time)
+					while time >= @next_point
+						@points << [@next_point, current_point]
+						@next_point += @interval
+						
+						if @points.size > @maximum_points
+							@interval *= 2
+							@points.select!{|point, _| point % @interval == 0}
+							@next_point = (@next_point + @interval - 1) / @interval * @interval
+						end
+					end
+					
+					@time = time if time > @time
+				end
+			end
+		end
+	end
+end
@@ -4,6 +4,7 @@
 # Copyright, 2025, by Samuel Williams.
 
 require "memory/profiler/capture"
+require "stringio"
 
 describe Memory::Profiler::Capture do
 	let(:capture) {subject.new}
@@ -45,12 +46,904 @@ describe Memory::Profiler::Capture do
 		end
 	end
 	
+	with "#[]" do
+		it "creates allocations objects only when requested" do
+			classes = 100.times.map{Class.new}
+			wrappers = ObjectSpace.each_object(Memory::Profiler::Allocations).count
+			
+			capture.track_all = true
+			capture.start
+			objects = classes.map(&:new)
+			capture.stop
+			
+			expect(ObjectSpace.each_object(Memory::Profiler::Allocations).count).to be <= wrappers
+			
+			allocations = capture[classes.first]
+			expect(allocations.retained_count).to be == 1
+			expect(capture[classes.first]).to be(:equal?, allocations)
+		end
+		
+		it "keeps allocations objects usable after untracking" do
+			allocations = capture.track(Hash)
+			capture.start
+			hashes = 3.times.map{{}}
+			capture.stop
+			
+			capture.untrack(Hash)
+			GC.start
+			
+			expect(capture[Hash]).to be_nil
+			expect(allocations.new_count).to be >= 3
+		end
+	end
+	
+	with "#export_objects" do
+		let(:klass) {Class.new}
+		
+		it "exports packed records of the tracked objects" do
+			capture.track(klass)
+			capture.track(Hash)
+			capture.start
+			objects = 10.times.map{klass.new}
+			hashes = 5.times.map{Hash.new}
+			capture.stop
+			
+			data = capture.export_objects(klass)
+			expect(data.encoding).to be == Encoding::BINARY
+			expect(data.bytesize).to be == 10 * 24
+			
+			records = data.unpack("QLLQ" * 10).each_slice(4).to_a
+			addresses = objects.map{|object| Memory::Profiler.address_of(object).to_i(16)}
+			expect(records.map(&:first).sort).to be == addresses.sort
+			
+			id = capture.classes.key(klass)
+			records.each do |address, klass_id, epoch, size|
+				expect(klass_id).to be == id
+				expect(epoch).to be <= GC.count
+				expect(size).to be > 0
+			end
+		end
+		
+		it "skips objects left unswept by a lazy sweep" do
+			capture.track(klass)
+			capture.start
+			50_000.times{klass.new}
+			GC.start(full_mark: true, immediate_sweep: false)
+			
+			expect(capture.export_objects(klass)).to be == ""
+		end
+		
+		it "limits the number of records" do
+			capture.track(klass)
+			capture.start
+			objects = 100.times.map{klass.new}
+			capture.stop
+			
+			expect(capture.export_objects(klass, limit: 7).bytesize).to be == 7 * 24
+			expect(capture.export_objects(limit: 0)).to be == ""
+		end
+		
+		it "rejects a negative limit" do
+			expect{capture.export_objects(limit: -1)}.to raise_exception(ArgumentError)
+		end
+		
+		it "writes records to an IO" do
+			capture.track(klass)
+			capture.start
+			objects = 1000.times.map{klass.new}
+			capture.stop
+			
+			io = StringIO.new(String.new(encoding: Encoding::BINARY))
+			expect(capture.export_objects(io: io)).to be == 1000
+			expect(io.string.bytesize).to be == 1000 * 24
+		end
+		
+		it "exports nothing for untracked classes" do
+			expect(capture.export_objects(klass)).to be == ""
+		end
+	end
+	
+	with "#sample_objects" do
+		let(:klass) {Class.new}
+		
+		it "holds every live object while there are few of them" do
+			capture.track(klass)
+			capture.start
+			objects = 10.times.map{klass.new}
+			capture.stop
+			
+			sample = capture.sample_objects(klass)
+			expect(sample.size).to be == 10
+			objects.each do |object|
+				expect(sample.any?{|sampled| sampled.equal?(object)}).to be == true
+			end
+		end
+		
+		it "holds a bounded sample of live objects" do
+			capture.track(klass)
+			capture.start
+			retained = 1000.times.map{klass.new}
+			capture.stop
+			
+			sample = capture.sample_objects(klass)
+			expect(sample.size).to be == Memory::Profiler::Capture::SAMPLE_SIZE
+			sample.each do |object|
+				expect(retained.any?{|live| live.equal?(object)}).to be == true
+			end
+		end
+		
+		it "stays uniform when allocations are sampled" do
+			capture.track(klass)
+			capture.sampling_interval = 16
+			capture.start
+			early = 40_000.times.map{klass.new}
+			late = 40_000.times.map{klass.new}
+			capture.stop
+			
+			late_ids = late.to_h{|object| [object.__id__, true]}
+			sample = capture.sample_objects(klass)
+			expect(sample.size).to be == Memory::Profiler::Capture::SAMPLE_SIZE
+			
+			# About half of the sample should be late objects, as they are half of the live objects:
+			expect(sample.count{|object| late_ids[object.__id__]}).to be > sample.size / 4
+		end
+		
+		it "refills the sample when sampled objects are freed" do
+			capture.track(klass)
+			capture.start
+			10_000.times{klass.new}
+			retained = 50.times.map{klass.new}
+			10_000.times{klass.new}
+			GC.start
+			capture.stop
+			
+			sample = capture.sample_objects(klass)
+			expect(sample.size).to be > 0
+			expect(sample.size).to be <= capture.retained_count_of(klass)
+			sample.each do |object|
+				expect(object).to be_a(klass)
+			end
+		end
+		
+		it "follows sampled objects through compaction" do
+			capture.track(klass)
+			capture.start
+			objects = 200.times.map{klass.new}
+			capture.stop
+			
+			begin
+				GC.verify_compaction_references(expand_heap: true, toward: :empty)
+			rescue NotImplementedError
+				skip "GC compaction not available"
+			end
+			
+			sample = capture.sample_objects(klass)
+			expect(sample.size).to be == Memory::Profiler::Capture::SAMPLE_SIZE
+			sample.each do |object|
+				expect(object).to be_a(klass)
+			end
+		end
+		
+		it "skips objects left unswept by a lazy sweep" do
+			capture.track(klass)
+			capture.start
+			50_000.times{klass.new}
+			GC.start(full_mark: true, immediate_sweep: false)
+			
+			expect(capture.sample_objects(klass)).to be == []
+		end
+		
+		it "skips objects freed while stopped" do
+			capture.track(klass)
+			capture.start
+			objects = 200_000.times.map{klass.new}
+			capture.stop
+			
+			objects = nil
+			10.times{GC.start}
+			
+			expect(capture.sample_objects(klass)).to be == []
+		end
+		
+		it "is empty for untracked classes" do
+			expect(capture.sample_objects(klass)).to be == []
+		end
+	end
+	
+	with "#measure" do
+		let(:klass) {Class.new}
+		
+		it "only records allocations inside the block when scoped" do
+			capture.track(klass)
+			capture.scoped = true
+			capture.start
+			
+			outside = 10.times.map{klass.new}
+			inside = capture.measure{20.times.map{klass.new}}
+			
+			capture.measure do
+				Fiber.new{5.times.map{klass.new}}.resume
+				Thread.new{5.times.map{klass.new}}.join
+			end
+			
+			capture.stop
+			
+			expect(inside.size).to be == 20
+			expect(capture.retained_count_of(klass)).to be == 20
+		end
+		
+		it "records frees of objects allocated inside the block" do
+			capture.track(klass)
+			capture.scoped = true
+			capture.start
+			
+			capture.measure{100.times{klass.new}}
+			GC.start
+			
+			capture.stop
+			
+			allocations = capture[klass]
+			expect(allocations.new_count).to be == 100
+			expect(allocations.free_count).to be > 0
+		end
+		
+		it "can be nested and restores the scope after an exception" do
+			other = subject.new
+			capture.track(klass)
+			capture.scoped = true
+			capture.start
+			
+			expect{other.measure{capture.measure{raise "Failure"}}}.to raise_exception(RuntimeError)
+			
+			objects = other.measure{10.times.map{klass.new}}
+			capture.stop
+			
+			expect(capture.retained_count_of(klass)).to be == 0
+		end
+		
+		it "records everything when not scoped" do
+			capture.track(klass)
+			capture.start
+			
+			outside = 10.times.map{klass.new}
+			inside = capture.measure{10.times.map{klass.new}}
+			
+			capture.stop
+			
+			expect(capture.scoped).to be == false
+			expect(capture.retained_count_of(klass)).to be == 20
+		end
+	end
+	
+	with "#each_site" do
+		let(:klass) {Class.new}
+		
+		def allocate_retained
+			10.times.map{klass.new}
+		end
+		
+		it "counts allocations and frees by source line" do
+			capture.track(klass)
+			capture.track_sites = true
+			capture.start
+			
+			retained = allocate_retained
+			line = __LINE__; 100.times{klass.new}
+			GC.start
+			
+			capture.stop
+			
+			sites = capture.each_site.to_h{|path, line, new_count, free_count| [[path, line], [new_count, free_count]]}
+			retained_site = sites[[__FILE__, method(:allocate_retained).source_location.last + 1]]
+			expect(retained_site).to be == [10, 0]
+			
+			new_count, free_count = sites[[__FILE__, line]]
+			expect(new_count).to be == 100
+			expect(free_count).to be > 0
+			
+			expect(capture.statistics[:sites_count]).to be == 2
+		end
+		
+		it "identifies paths by content" do
+			capture.track(klass)
+			capture.track_sites = true
+			capture.start
+			
+			# Each eval compiles the code again, with a new path string:
+			objects = 10.times.map{|index| eval("klass.new", binding, "dynamic#{index % 2}.rb", 1)}
+			
+			capture.stop
+			
+			sites = capture.each_site.select{|path, line| path.start_with?("dynamic")}
+			expect(sites.sort).to be == [["dynamic0.rb", 1, 5, 0], ["dynamic1.rb", 1, 5, 0]]
+		end
+		
+		it "records nothing unless enabled" do
+			capture.track(klass)
+			capture.start
+			objects = 10.times.map{klass.new}
+			capture.stop
+			
+			expect(capture.track_sites).to be == false
+			expect(capture.each_site.to_a).to be == []
+		end
+		
+		it "resets the counts when cleared" do
+			capture.track(klass)
+			capture.track_sites = true
+			capture.start
+			objects = 10.times.map{klass.new}
+			capture.stop
+			capture.clear
+			
+			expect(capture.each_site.to_a).to be == []
+		end
+	end
+	
+	with "#each_method" do
+		let(:allocator) do
+			Class.new do
+				def allocate(count)
+					count.times.map{|index| [index]}
+				end
+			end
+		end
+		
+		it "counts allocations and frees by method" do
+			capture.track(Array)
+			capture.track_methods = true
+			capture.start
+			
+			retained = allocator.new.allocate(10)
+			allocator.new.allocate(100)
+			GC.start
+			
+			capture.stop
+			
+			methods = capture.each_method.to_h{|defined_class, name, new_count, free_count| [[defined_class, name], [new_count, free_count]]}
+			new_count, free_count = methods[[allocator, :allocate]]
+			expect(new_count).to be == 110
+			expect(free_count).to be <= 100
+			
+			expect(capture.statistics[:methods_count]).to be >= 1
+		end
+		
+		it "attributes allocations by C methods to them" do
+			klass = Class.new
+			capture.track(klass)
+			capture.track_methods = true
+			capture.start
+			objects = 10.times.map{klass.new}
+			capture.stop
+			
+			expect(capture.each_method.to_a).to be == [[Class, :new, 10, 0]]
+		end
+		
+		it "can be combined with sites" do
+			capture.track(Array)
+			capture.track_methods = true
+			capture.track_sites = true
+			capture.start
+			retained = allocator.new.allocate(10)
+			capture.stop
+			
+			line = allocator.instance_method(:allocate).source_location.last + 1
+			site = capture.each_site.find{|path, site_line| path == __FILE__ && site_line == line}
+			# The line also allocates the array returned by map, which is attributed to Enumerable#map:
+			expect(site).to be == [__FILE__, line, 11, 0]
+			
+			method = capture.each_method.find{|defined_class, name| defined_class == allocator}
+			expect(method).to be == [allocator, :allocate, 10, 0]
+		end
+		
+		it "records nothing unless enabled" do
+			capture.track(Array)
+			capture.start
+			retained = allocator.new.allocate(10)
+			capture.stop
+			
+			expect(capture.track_methods).to be == false
+			expect(capture.each_method.to_a).to be == []
+		end
+	end
+	
+	with "#each_tag" do
+		let(:klass) {Class.new}
+		
+		it "counts allocations and frees by the tag of the allocating fiber" do
+			capture.track(klass)
+			capture.track_tags = true
+			capture.start
+			
+			retained = subject.tagged(:retained){10.times.map{klass.new}}
+			Fiber.new{subject.tagged(:transient){100.times{klass.new}}}.resume
+			untagged = 5.times.map{klass.new}
+			GC.start
+			
+			capture.stop
+			
+			tags = capture.each_tag.to_h{|tag, new_count, free_count| [tag, [new_count, free_count]]}
+			expect(tags[:retained]).to be == [10, 0]
+			expect(tags[nil]).to be == [5, 0]
+			
+			new_count, free_count = tags[:transient]
+			expect(new_count).to be == 100
+			expect(free_count).to be > 0
+			
+			expect(capture.statistics[:tags_count]).to be == 2
+		end
+		
+		it "is local to each fiber" do
+			subject.tagged(:outer) do
+				expect(Fiber.new{subject.tag}.resume).to be_nil
+				expect(subject.tag).to be == :outer
+			end
+			
+			expect(subject.tag).to be_nil
+		end
+		
+		it "must be immediate or frozen" do
+			expect{subject.tag = Object.new}.to raise_exception(ArgumentError)
+			expect{subject.tagged(Fiber.current){}}.to raise_exception(ArgumentError)
+			expect(subject.tag).to be_nil
+			
+			subject.tagged("request".freeze){expect(subject.tag).to be == "request"}
+		end
+		
+		it "does not retain tagged fibers" do
+			capture.track(klass)
+			capture.track_tags = true
+			capture.start
+			
+			fibers = ObjectSpace::WeakMap.new
+			10.times do |i|
+				fiber = Fiber.new{subject.tagged(:request){klass.new}}
+				fiber.resume
+				fibers[i] = fiber
+			end
+			
+			GC.start
+			capture.stop
+			
+			expect(fibers.keys.size).to be < 10
+			expect(capture.each_tag.to_h{|tag, new_count, free_count| [tag, new_count]}[:request]).to be == 10
+		end
+		
+		it "records nothing unless enabled" do
+			capture.track(klass)
+			capture.start
+			objects = subject.tagged(:request){10.times.map{klass.new}}
+			capture.stop
+			
+			expect(capture.track_tags).to be == false
+			expect(capture.each_tag.to_a).to be == []
+		end
+	end
+	
+	with "#top" do
+		let(:small) {Class.new}
+		let(:medium) {Class.new}
+		let(:large) {Class.new}
+		
+		def allocate!
+			capture.track(small)
+			capture.track(medium)
+			capture.track(large)
+			capture.start
+			
+			@objects = [
+				1.times.map{small.new},
+				50.times.map{medium.new},
+				100.times.map{large.new},
+			]
+			
+			# Allocated but not retained:
+			10_000.times{small.new}
+			GC.start
+			
+			capture.stop
+		end
+		
+		it "ranks classes by retained count" do
+			allocate!
+			
+			expect(capture.top(2)).to be == [[large, 100], [medium, 50]]
+		end
+		
+		it "ranks classes by allocation count" do
+			allocate!
+			
+			expect(capture.top(1, by: :allocated)).to be == [[small, 10_001]]
+		end
+		
+		it "ranks classes by retained bytes" do
+			string_class = Class.new(String)
+			capture.track(string_class)
+			capture.track(small)
+			capture.start
+			
+			strings = 10.times.map{string_class.new(capacity: 10_000)}
+			objects = 20.times.map{small.new}
+			
+			capture.stop
+			
+			top = capture.top(2, by: :bytes)
+			expect(top.map(&:first)).to be == [string_class, small]
+			expect(top.first.last).to be >= 100_000
+		end
+		
+		it "skips objects freed while stopped when ranking by bytes" do
+			capture.track(small)
+			capture.start
+			objects = 200_000.times.map{small.new}
+			capture.stop
+			
+			objects = nil
+			10.times{GC.start}
+			
+			expect(capture.top(1, by: :bytes)).to be == []
+		end
+		
+		it "returns every class when there are fewer than k" do
+			allocate!
+			
+			expect(capture.top(100).size).to be == 3
+		end
+		
+		it "excludes classes with nothing retained" do
+			capture.track(small)
+			
+			expect(capture.top(10)).to be == []
+		end
+		
+		it "rejects unknown rankings" do
+			expect{capture.top(10, by: :unknown)}.to raise_exception(ArgumentError)
+		end
+	end
+	
+	with "#write_metrics" do
+		let(:klass) {Class.new}
+		
+		it "writes per-class counters in the OpenMetrics format" do
+			capture.track(String)
+			capture.start
+			strings = 3.times.map{"x" * 100}
+			capture.stop
+			
+			output = capture.write_metrics(+"")
+			
+			expect(output).to be(:start_with?, "# TYPE memory_profiler_allocations counter\n")
+			expect(output).to be(:include?, "memory_profiler_allocations_total{class=\"String\"} ")
+			expect(output).to be(:include?, "memory_profiler_frees_total{class=\"String\"} ")
+			expect(output).to be(:include?, "# TYPE memory_profiler_retained gauge\n")
+			expect(output).to be(:end_with?, "# EOF\n")
+			
+			retained = output[/^memory_profiler_retained\{class="String"\} (\d+)$/, 1]
+			expect(Integer(retained)).to be == capture.retained_count_of(String)
+		end
+		
+		it "appends to the given buffer" do
+			buffer = +"existing\n"
+			
+			expect(capture.write_metrics(buffer)).to be(:equal?, buffer)
+			expect(buffer).to be(:start_with?, "existing\n# TYPE")
+		end
+		
+		it "writes to an IO" do
+			capture.track(klass)
+			capture.start
+			objects = 2.times.map{klass.new}
+			capture.stop
+			
+			io = StringIO.new
+			capture.write_metrics(io, prefix: "app_memory")
+			
+			expect(io.string).to be == capture.write_metrics(+"", prefix: "app_memory")
+			expect(io.string).to be(:include?, "app_memory_retained{class=\"#{klass.inspect}\"} 2\n")
+		end
+		
+		it "only writes the classes with the most retained objects" do
+			small = Class.new
+			capture.track(small)
+			capture.track(klass)
+			capture.start
+			objects = 10.times.map{klass.new}
+			others = 1.times.map{small.new}
+			capture.stop
+			
+			output = capture.write_metrics(+"", top: 1)
+			
+			expect(output).to be(:include?, klass.inspect)
+			expect(output).not.to be(:include?, small.inspect)
+		end
+		
+		it "rejects invalid prefixes" do
+			expect{capture.write_metrics(+"", prefix: "not valid")}.to raise_exception(ArgumentError)
+		end
+		
+		it "rejects a negative top" do
+			expect{capture.write_metrics(+"", top: -1)}.to raise_exception(ArgumentError)
+		end
+	end
+	
+	with "#statistics" do
+		it "does not watch allocations of untracked classes" do
+			klass = Class.new
+			capture.track(klass)
+			capture.start
+			
+			strings = 100.times.map{"test#{rand}"}
+			objects = 10.times.map{klass.new}
+			
+			capture.stop
+			
+			statistics = capture.statistics
+			expect(statistics[:object_table_size]).to be == 10
+			expect(statistics[:object_pages_size]).to be >= 1
+			
+			capture.clear
+			expect(capture.statistics[:object_pages_size]).to be == 0
+		end
+		
+		it "reports object table health" do
+			capture.track_all = true
+			capture.start
+			
+			objects = 5000.times.map{Object.new}
+			
+			capture.stop
+			
+			object_table = capture.statistics[:object_table]
+			expect(object_table[:count]).to be >= 5000
+			expect(object_table[:peak_count]).to be >= object_table[:count]
+			expect(object_table[:capacity]).to be > object_table[:count]
+			expect(object_table[:load_factor]).to be <= 0.5
+			expect(object_table[:resizes]).to be > 0
+			expect(object_table[:probes].sum).to be >= 5000
+			expect(object_table[:aborted_probes]).to be == 0
+		end
+		
+		it "reports the event queue's peak" do
+			capture.track_all = true
+			capture.start
+			
+			objects = 1000.times.map{Object.new}
+			
+			capture.stop
+			
+			event_queue = capture.statistics[:event_queue]
+			expect(event_queue[:count]).to be == 0
+			expect(event_queue[:peak_count]).to be >= 1
+			expect(event_queue[:capacity]).to be >= event_queue[:peak_count]
+		end
+	end
+	
+	with "#timing_interval" do
+		it "is disabled by default" do
+			expect(capture.timing_interval).to be_nil
+			expect(capture.statistics).not.to have_keys(:timing)
+		end
+		
+		it "reports sampled timing histograms" do
+			klass = Class.new
+			capture.track(klass)
+			capture.timing_interval = 4
+			capture.start
+			
+			objects = 1000.times.map{klass.new}
+			
+			capture.stop
+			
+			timing = capture.statistics[:timing]
+			expect(timing[:interval]).to be == 4
+			
+			hook = timing[:hook]
+			expect(hook[:count]).to be > 0
+			expect(hook[:count]).to be < 1000
+			expect(hook[:buckets].values.sum).to be == hook[:count]
+			expect(hook[:maximum]).to be >= hook[:mean]
+			
+			expect(timing[:newobj][:count]).to be_within(1).of(250)
+			expect(timing[:table][:count]).to be >= timing[:newobj][:count]
+			
+			queue = timing[:queue]
+			expect(queue[:batch_size][:total]).to be >= 1000
+			expect(queue[:batch_time][:count]).to be > 0
+			expect(queue[:latency][:count]).to be > 0
+		end
+		
+		it "can be disabled" do
+			capture.timing_interval = 10
+			capture.timing_interval = nil
+			
+			expect(capture.timing_interval).to be_nil
+			expect(capture.statistics[:timing][:interval]).to be_nil
+		end
+		
+		it "must be positive" do
+			expect{capture.timing_interval = 0}.to raise_exception(ArgumentError)
+		end
+	end
+	
+	with "#sampling_interval" do
+		let(:klass) {Class.new}
+		
+		it "records every allocation by default" do
+			expect(capture.sampling_interval).to be == 1
+		end
+		
+		it "records a sample of allocations, weighted by the interval" do
+			capture.track(klass)
+			capture.sampling_interval = 16
+			capture.start
+			
+			objects = 20_000.times.map{klass.new}
+			
+			capture.stop
+			
+			# Only about one in 16 allocations is in the object table:
+			expect(capture.statistics[:object_table_size]).to be < 20_000 / 4
+			
+			# But the counts are estimates of every allocation:
+			expect(capture[klass].new_count).to be_within(4000).of(20_000)
+			expect(capture.retained_count_of(klass)).to be == capture[klass].new_count
+		end
+		
+		it "must be a power of two" do
+			expect{capture.sampling_interval = 3}.to raise_exception(ArgumentError)
+			expect{capture.sampling_interval = 0}.to raise_exception(ArgumentError)
+		end
+	end
+	
+	with "#overhead_budget" do
+		it "is not governed by default" do
+			expect(capture.overhead_budget).to be_nil
+			expect(capture.statistics).not.to have_keys(:governor)
+		end
+		
+		it "enables timing" do
+			capture.overhead_budget = 0.02
+			
+			expect(capture.overhead_budget).to be == 0.02
+			expect(capture.timing_interval).to be > 0
+		end
+		
+		it "raises the sampling interval when over budget" do
+			capture.track_all = true
+			capture.overhead_budget = 0.0001
+			capture.start
+			
+			deadline = Process.clock_gettime(Process::CLOCK_MONOTONIC) + 5
+			while capture.sampling_interval == 1 && Process.clock_gettime(Process::CLOCK_MONOTONIC) < deadline
+				1000.times{Object.new}
+			end
+			
+			capture.stop
+			
+			expect(capture.sampling_interval).to be > 1
+			
+			governor = capture.statistics[:governor]
+			expect(governor[:adjustments]).to be > 0
+			expect(governor[:overhead]).to be > 0.0001
+			expect(governor[:sampling_interval]).to be == capture.sampling_interval
+		end
+		
+		it "restores the sampling interval and timing when disabled" do
+			capture.sampling_interval = 8
+			capture.overhead_budget = 0.01
+			expect(capture.timing_interval).to be > 0
+			
+			capture.overhead_budget = nil
+			
+			expect(capture.sampling_interval).to be == 8
+			expect(capture.timing_interval).to be_nil
+		end
+		
+		it "keeps timing enabled by the user when disabled" do
+			capture.timing_interval = 10
+			capture.overhead_budget = 0.01
+			capture.overhead_budget = nil
+			
+			expect(capture.timing_interval).to be == 10
+		end
+		
+		it "must be a fraction" do
+			expect{capture.overhead_budget = 0}.to raise_exception(ArgumentError)
+			expect{capture.overhead_budget = 2}.to raise_exception(ArgumentError)
+		end
+		
+		it "keeps timing enabled while set" do
+			capture.overhead_budget = 0.01
+			
+			expect{capture.timing_interval = nil}.to raise_exception(ArgumentError)
+			expect(capture.timing_interval).to be > 0
+			
+			capture.timing_interval = 10
+			expect(capture.timing_interval).to be == 10
+		end
+	end
+	
+	with "#maximum_classes" do
+		it "is unlimited by default" do
+			expect(capture.maximum_classes).to be_nil
+			expect(capture.other).to be_nil
+		end
+		
+		it "merges the least retained classes into other" do
+			retained = Class.new
+			capture.track_all = true
+			capture.maximum_classes = 20
+			capture.start
+			
+			objects = 10.times.map{retained.new}
+			transient = 100.times.map{Class.new.new}
+			
+			capture.stop
+			
+			statistics = capture.statistics
+			expect(statistics[:tracked_count]).to be <= 20
+			expect(statistics[:evicted_count]).to be > 0
+			
+			# The class with the most retained objects is kept:
+			expect(capture.retained_count_of(retained)).to be == 10
+			
+			# Counts of merged classes are kept in aggregate:
+			other = capture.other
+			expect(other.new_count).to be >= statistics[:evicted_count]
+			
+			# Objects of merged classes are still counted when freed:
+			transient = nil
+			capture.start
+			3.times{GC.start}
+			capture.stop
+			
+			expect(capture.other.free_count).to be > 0
+		end
+		
+		it "never evicts explicitly tracked classes" do
+			capture.track(Hash)
+			capture.track_all = true
+			capture.maximum_classes = 1
+			capture.start
+			
+			objects = 10.times.map{Class.new.new}
+			hashes = 3.times.map{{}}
+			
+			capture.stop
+			
+			expect(capture.tracking?(Hash)).to be == true
+			expect(capture.retained_count_of(Hash)).to be >= 3
+			expect(capture.other.new_count).to be >= 10
+		end
+	end
+	
 	with "#untrack" do
 		it "can stop tracking a class" do
 			capture.track(Hash)
 			capture.untrack(Hash)
 			expect(capture.tracking?(Hash)).to be == false
 		end
+		
+		it "releases the object table entries of the class" do
+			capture.track(Hash)
+			capture.track(Array)
+			capture.start
+			
+			hashes = 100.times.map{{}}
+			arrays = 10.times.map{[]}
+			
+			capture.stop
+			
+			size = capture.statistics[:object_table_size]
+			retained_hashes = capture.retained_count_of(Hash)
+			retained_arrays = capture.retained_count_of(Array)
+			expect(retained_hashes).to be >= 100
+			
+			capture.untrack(Hash)
+			
+			expect(capture.statistics[:object_table_size]).to be == size - retained_hashes
+			expect(capture.each_object(Array).count).to be == retained_arrays
+		end
 	end
 	
 	with "#retained_count_of" do
@@ -673,6 +1566,61 @@ describe Memory::Profiler::Capture do
 			end
 		end
 		
+		it "finds retained objects after compaction moves them" do
+			capture.track(String)
+			capture.start
+			
+			strings = 1000.times.map{"test#{rand}"}
+			
+			begin
+				GC.verify_compaction_references(expand_heap: true, toward: :empty)
+			rescue NotImplementedError
+				skip "GC compaction not available"
+			end
+			
+			retained = strings.to_h{|string| [string, true]}.compare_by_identity
+			found = 0
+			capture.each_object(String) do |object, allocations|
+				found += 1 if retained.key?(object)
+			end
+			
+			expect(found).to be == strings.size
+			
+			# Frees must still find the relocated entries:
+			retained_count = capture.retained_count_of(String)
+			strings = retained = nil
+			3.times{GC.start}
+			
+			expect(capture.retained_count_of(String)).to be <= retained_count - 900
+		ensure
+			capture.stop
+		end
+		
+		it "keeps objects moved into the slots of objects waiting to be freed" do
+			skip "GC compaction not available" unless GC.respond_to?(:compact)
+			
+			capture.track(Object)
+			capture.start
+			
+			# The compaction frees the unreferenced objects and moves the retained ones into their slots in the same GC, before the frees are processed:
+			retained = []
+			30_000.times do |index|
+				object = Object.new
+				retained << object if index % 10 == 0
+				GC.compact if index == 15_000
+			end
+			
+			lookup = retained.to_h{|object| [object, true]}.compare_by_identity
+			found = 0
+			capture.each_object(Object) do |object, allocations|
+				found += 1 if lookup.key?(object)
+			end
+			
+			expect(found).to be == retained.size
+		ensure
+			capture.stop
+		end
+		
 		it "handles compaction with events still in queue" do
 			# Test that compaction works even when events haven't been processed yet
 			# This exercises the write barriers and ensures queue contents are valid
@@ -723,7 +1671,7 @@ describe Memory::Profiler::Capture do
 				return false
 			end
 		end
-
+		
 		it "re-enables GC after iteration completes" do
 			capture.track(Hash)
 			capture.start
@@ -737,12 +1685,12 @@ describe Memory::Profiler::Capture do
 			GC.enable
 			expect(gc_enabled?).to be == true
 			
-			# Call each_object (which temporarily disables GC)
+			# Call each_object (GC keeps running while iterating)
 			capture.each_object(Hash) do |object, allocations|
 				# Do nothing, just iterate
 			end
 			
-			# Verify GC is re-enabled after each_object completes
+			# Verify GC is still enabled after each_object completes
 			expect(gc_enabled?).to be == true
 		end
 		
@@ -768,7 +1716,7 @@ describe Memory::Profiler::Capture do
 				expect(e.message).to be == "test exception"
 			end
 			
-			# Verify GC is re-enabled even after exception
+			# Verify GC is still enabled after an exception
 			expect(gc_enabled?).to be == true
 		end
 		
@@ -785,7 +1733,7 @@ describe Memory::Profiler::Capture do
 			GC.disable
 			expect(gc_enabled?).to be == false
 			
-			# Call each_object (which temporarily disables GC, but it was already disabled)
+			# Call each_object while GC is disabled
 			capture.each_object(Hash) do |object, allocations|
 				# Do nothing, just iterate
 			end
@@ -796,5 +1744,163 @@ describe Memory::Profiler::Capture do
 			# Re-enable GC for other tests
 			GC.enable
 		end
+		
+		it "keeps GC enabled while iterating" do
+			klass = Class.new
+			capture.track(klass)
+			capture.start
+			objects = 1000.times.map{klass.new}
+			capture.stop
+			
+			visited = 0
+			capture.each_object(klass) do |object, allocations|
+				expect(gc_enabled?).to be == true
+				GC.start if visited == 0
+				
+				expect(object).to be_a(klass)
+				visited += 1
+			end
+			
+			expect(visited).to be == 1000
+		end
+		
+		it "follows objects moved by compaction while iterating" do
+			klass = Class.new
+			capture.track(klass)
+			capture.start
+			objects = 1000.times.map{klass.new}
+			capture.stop
+			
+			visited = 0
+			capture.each_object(klass) do |object, allocations|
+				if visited == 0
+					begin
+						GC.verify_compaction_references(expand_heap: true, toward: :empty)
+					rescue NotImplementedError
+						skip "GC compaction not available"
+					end
+				end
+				
+				expect(object).to be_a(klass)
+				visited += 1
+			end
+			
+			expect(visited).to be == 1000
+		end
+		
+		it "skips objects freed while iterating" do
+			klass = Class.new
+			capture.track(klass)
+			capture.start
+			objects = 1000.times.map{klass.new}
+			capture.stop
+			
+			visited = 0
+			capture.each_object(klass) do |object, allocations|
+				if visited == 0
+					objects.clear
+					GC.start
+				end
+				
+				expect(object).to be_a(klass)
+				visited += 1
+			end
+			
+			expect(visited).to be < 1000
+		end
+		
+		it "skips objects left unswept by a lazy sweep" do
+			klass = Class.new
+			capture.track(klass)
+			capture.start
+			50_000.times{klass.new}
+			GC.start(full_mark: true, immediate_sweep: false)
+			
+			visited = 0
+			capture.each_object(klass) do |object, allocations|
+				expect(object).to be_a(klass)
+				Array.new(100)
+				visited += 1
+			end
+			
+			expect(visited).to be == 0
+		end
+		
+		it "skips objects left unswept by a lazy sweep when stopped" do
+			klass = Class.new
+			capture.track(klass)
+			capture.start
+			50_000.times{klass.new}
+			capture.stop
+			GC.start(full_mark: true, immediate_sweep: false)
+			
+			visited = 0
+			capture.each_object(klass) do |object, allocations|
+				expect(object).to be_a(klass)
+				Array.new(100)
+				visited += 1
+			end
+			
+			expect(visited).to be == 0
+		end
+		
+		it "skips objects freed while stopped" do
+			klass = Class.new
+			capture.track(klass)
+			capture.start
+			objects = 1000.times.map{klass.new}
+			capture.stop
+			
+			objects = nil
+			GC.start
+			
+			visited = 0
+			capture.each_object(klass) do |object, allocations|
+				expect(object).to be_a(klass)
+				visited += 1
+			end
+			
+			expect(visited).to be < 1000
+			expect(capture.retained_count_of(klass)).to be == 1000
+		end
+		
+		it "only visits objects of the requested class" do
+			capture.track(Hash)
+			capture.track(Array)
+			capture.start
+			
+			hashes = 5.times.map{Hash.new}
+			arrays = 100.times.map{Array.new}
+			
+			capture.stop
+			
+			objects = []
+			capture.each_object(Hash) do |object, allocations|
+				expect(object).to be_a(Hash)
+				expect(allocations).to be == capture[Hash]
+				objects << object
+			end
+			
+			hashes.each do |hash|
+				expect(objects.any?{|object| object.equal?(hash)}).to be == true
+			end
+		end
+		
+		it "skips objects removed while iterating" do
+			capture.track(Hash)
+			capture.start
+			
+			hashes = 5.times.map{Hash.new}
+			
+			capture.stop
+			
+			count = 0
+			capture.each_object(Hash) do |object, allocations|
+				count += 1
+				capture.untrack(Hash)
+			end
+			
+			expect(count).to be == 1
+		end
 	end
 end
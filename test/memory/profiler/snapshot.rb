@@ -0,0 +1,141 @@
+# frozen_string_literal: true
+
+# Released under the MIT License.
+# Copyright, 2025, by Samuel Williams.
+
+require "memory/profiler"
+
+class SnapshotTestObject; end
+class SnapshotOtherObject; end
+
+describe Memory::Profiler::Snapshot do
+	let(:capture) {Memory::Profiler::Capture.new}
+	
+	after do
+		capture.stop
+	end
+	
+	it "can't be created directly" do
+		expect{Memory::Profiler::Snapshot.new}.to raise_exception(TypeError)
+	end
+	
+	it "is frozen" do
+		expect(capture.snapshot).to be(:frozen?)
+	end
+	
+	with "#each" do
+		it "yields the counters of each tracked class" do
+			capture.track(SnapshotTestObject)
+			capture.start
+			
+			objects = 5.times.map{SnapshotTestObject.new}
+			snapshot = capture.snapshot
+			
+			counts = snapshot.each.to_h{|klass, new_count, free_count, retained_count| [klass, [new_count, free_count, retained_count]]}
+			
+			expect(counts[SnapshotTestObject]).to be == [5, 0, 5]
+			expect(snapshot.size).to be == counts.size
+		end
+		
+		it "does not change when the capture does" do
+			capture.track(SnapshotTestObject)
+			capture.start
+			
+			snapshot = capture.snapshot
+			objects = 3.times.map{SnapshotTestObject.new}
+			
+			counts = snapshot.each.to_h{|klass, new_count| [klass, new_count]}
+			expect(counts[SnapshotTestObject]).to be == 0
+		end
+		
+		it "excludes classes merged into other" do
+			capture.track_all = true
+			capture.maximum_classes = 20
+			capture.start
+			
+			transient = 100.times.map{Class.new.new}
+			capture.stop
+			
+			classes = capture.snapshot.each.map{|klass, *counts| klass}
+			
+			expect(classes.size).to be <= 20
+			expect(classes).to be == classes.select{|klass| capture.tracking?(klass)}
+		end
+	end
+	
+	with "#diff" do
+		it "returns the change in retained count per class" do
+			capture.track(SnapshotTestObject)
+			capture.track(SnapshotOtherObject)
+			capture.start
+			
+			before = capture.snapshot
+			objects = 10.times.map{SnapshotTestObject.new}
+			others = 2.times.map{SnapshotOtherObject.new}
+			after = capture.snapshot
+			
+			expect(after.diff(before)).to be == {SnapshotTestObject => 10, SnapshotOtherObject => 2}
+			expect(before.diff(after)).to be == {SnapshotTestObject => -10, SnapshotOtherObject => -2}
+		end
+		
+		it "only includes changes larger than the threshold" do
+			capture.track(SnapshotTestObject)
+			capture.track(SnapshotOtherObject)
+			capture.start
+			
+			before = capture.snapshot
+			objects = 10.times.map{SnapshotTestObject.new}
+			others = 2.times.map{SnapshotOtherObject.new}
+			after = capture.snapshot
+			
+			expect(after.diff(before, 2)).to be == {SnapshotTestObject => 10}
+		end
+		
+		it "is empty when nothing changed" do
+			capture.track(SnapshotTestObject)
+			
+			snapshot = capture.snapshot
+			expect(snapshot.diff(snapshot)).to be == {}
+		end
+		
+		it "includes classes tracked after the earlier snapshot" do
+			before = capture.snapshot
+			
+			capture.track(SnapshotTestObject)
+			capture.start
+			objects = 3.times.map{SnapshotTestObject.new}
+			
+			expect(capture.snapshot.diff(before)).to be == {SnapshotTestObject => 3}
+		end
+		
+		it "includes classes untracked after the earlier snapshot" do
+			capture.track(SnapshotTestObject)
+			capture.start
+			objects = 3.times.map{SnapshotTestObject.new}
+			
+			before = capture.snapshot
+			capture.untrack(SnapshotTestObject)
+			
+			expect(capture.snapshot.diff(before)).to be == {SnapshotTestObject => -3}
+		end
+		
+		it "applies the threshold to the total change of a class tracked again" do
+			capture.track(SnapshotTestObject)
+			capture.start
+			objects = 3.times.map{SnapshotTestObject.new}
+			
+			before = capture.snapshot
+			capture.untrack(SnapshotTestObject)
+			capture.track(SnapshotTestObject)
+			more = 2.times.map{SnapshotTestObject.new}
+			after = capture.snapshot
+			
+			expect(after.diff(before)).to be == {SnapshotTestObject => -1}
+			expect(after.diff(before, 2)).to be == {}
+		end
+		
+		it "requires a snapshot" do
+			expect{capture.snapshot.diff(Object.new)}.to raise_exception(TypeError)
+		end
+	end
+end
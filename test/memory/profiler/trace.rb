@@ -0,0 +1,182 @@
+# frozen_string_literal: true
+
+# Released under the MIT License.
+# Copyright, 2025, by Samuel Williams.
+
+require "memory/profiler"
+require "objspace"
+require "tempfile"
+
+class TraceTestObject; end
+
+describe Memory::Profiler::Trace do
+	let(:capture) {Memory::Profiler::Capture.new}
+	let(:file) {Tempfile.new("trace", binmode: true)}
+	
+	after do
+		capture.stop
+		capture.trace = nil
+		file.close!
+	end
+	
+	def address_of(object)
+		ObjectSpace.dump(object)[/"address":"0x(\h+)"/, 1].to_i(16)
+	end
+	
+	def events
+		file.rewind
+		trace = Memory::Profiler::Trace.new(file)
+		
+		return trace, trace.to_a
+	end
+	
+	it "keeps writing to its own file after the IO is closed" do
+		io = File.open(file.path, "wb")
+		capture.track(TraceTestObject)
+		capture.trace = io
+		capture.start
+		
+		# The closed descriptor's number is likely to be reused by the next file opened:
+		io.close
+		other = Tempfile.new("other")
+		
+		objects = 10.times.map{TraceTestObject.new}
+		capture.stop
+		capture.trace = nil
+		
+		expect(File.size(other.path)).to be == 0
+		
+		trace, events = self.events
+		expect(events.count{|event| event.type == :newobj}).to be == 10
+	ensure
+		other&.close!
+	end
+	
+	it "writes what's buffered when stopped" do
+		capture.track(TraceTestObject)
+		capture.trace = file
+		capture.start
+		objects = 10.times.map{TraceTestObject.new}
+		capture.stop
+		
+		trace, events = self.events
+		expect(events.count{|event| event.type == :newobj}).to be == 10
+	end
+	
+	it "records allocations and frees" do
+		capture.track(TraceTestObject)
+		capture.trace = file
+		expect(capture.trace).to be == file
+		capture.start
+		
+		retained = 10.times.map{TraceTestObject.new}
+		100.times{TraceTestObject.new}
+		GC.start
+		
+		capture.stop
+		capture.trace = nil
+		
+		trace, events = self.events
+		newobj = events.select{|event| event.type == :newobj}
+		freeobj = events.select{|event| event.type == :freeobj}
+		
+		expect(newobj.size).to be == 110
+		expect(freeobj.size).to be >= 90
+		expect(trace.class_name(newobj.first.class_id)).to be == "TraceTestObject"
+		expect(newobj.map(&:size).min).to be > 0
+		expect(newobj.map(&:weight).uniq).to be == [1]
+		expect(events.map(&:time)).to be == events.map(&:time).sort
+		expect(trace.start_time).to be_within(60).of(Time.now)
+		
+		# The retained objects were never freed:
+		live = newobj.map(&:address) - freeobj.map(&:address)
+		expect(retained.map{|object| address_of(object)} - live).to be == []
+	end
+	
+	it "records moves by compaction" do
+		skip "GC.compact is not supported" unless GC.respond_to?(:compact)
+		
+		capture.track(TraceTestObject)
+		capture.trace = file
+		capture.start
+		
+		retained = 1000.times.map{TraceTestObject.new}
+		GC.compact
+		
+		capture.stop
+		capture.trace = nil
+		
+		trace, events = self.events
+		live = {}
+		
+		events.each do |event|
+			case event.type
+			when :newobj
+				live[event.address] = true
+			when :freeobj
+				live.delete(event.address)
+			when :moved
+				live[event.to] = live.delete(event.address)
+			end
+		end
+		
+		expect(retained.map{|object| address_of(object)} - live.keys).to be == []
+	end
+	
+	it "records allocation sites" do
+		capture.track(TraceTestObject)
+		capture.track_sites = true
+		capture.trace = file
+		capture.start
+		
+		retained = 10.times.map{TraceTestObject.new}; line = __LINE__
+		
+		capture.stop
+		capture.trace = nil
+		
+		trace, events = self.events
+		sites = events.map{|event| trace.site_name(event.site)}.uniq
+		
+		expect(sites).to be == ["#{__FILE__}:#{line}"]
+	end
+	
+	it "records the weight of sampled allocations" do
+		capture.track(TraceTestObject)
+		capture.sampling_interval = 4
+		capture.trace = file
+		capture.start
+		
+		retained = 1000.times.map{TraceTestObject.new}
+		
+		capture.stop
+		capture.trace = nil
+		
+		trace, events = self.events
+		newobj = events.select{|event| event.type == :newobj}
+		
+		expect(newobj.size).to be < 1000
+		expect(newobj.map(&:weight).uniq).to be == [4]
+	end
+	
+	it "reports statistics" do
+		capture.track(TraceTestObject)
+		capture.trace = file
+		capture.start
+		
+		retained = 10.times.map{TraceTestObject.new}
+		
+		capture.stop
+		
+		statistics = capture.statistics[:trace]
+		expect(statistics[:records]).to be == 11
+		expect(statistics[:dropped]).to be == 0
+		expect(statistics[:error]).to be_nil
+	end
+	
+	it "rejects input that is not a trace" do
+		file.write("not a trace at all")
+		file.rewind
+		
+		expect{Memory::Profiler::Trace.new(file)}.to raise_exception(Memory::Profiler::Trace::FormatError)
+	end
+end
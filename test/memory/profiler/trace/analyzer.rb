@@ -0,0 +1,134 @@
+# frozen_string_literal: true
+
+# Released under the MIT License.
+# Copyright, 2025, by Samuel Williams.
+
+require "memory/profiler"
+require "memory/profiler/trace/analyzer"
+require "stringio"
+require "tempfile"
+
+class AnalyzerTestObject; end
+
+describe Memory::Profiler::Trace::Analyzer do
+	let(:analyzer) {subject.new(interval: 1.0)}
+	
+	def event(type, seconds, address, size: 40, weight: 1, site: nil, to: nil)
+		Memory::Profiler::Trace::Event.new(type, (seconds * 1_000_000_000).to_i, address, 1, size, weight, site, to)
+	end
+	
+	with "synthetic records" do
+		def replay!
+			# Two strings live for one and three seconds, one hash is retained, and one string moves:
+			analyzer.add(event(:newobj, 0, 0x1000), "String")
+			analyzer.add(event(:newobj, 0, 0x1028), "String")
+			analyzer.add(event(:newobj, 0.5, 0x2000, size: 160, weight: 4, site: 7), "Hash", "app.rb:12")
+			analyzer.add(event(:freeobj, 1.0, 0x1000))
+			analyzer.add(event(:moved, 2.0, 0x1028, to: 0x3000))
+			analyzer.add(event(:freeobj, 3.0, 0x3000))
+			analyzer.add(event(:freeobj, 4.0, 0x9999))
+		end
+		
+		it "counts allocations, frees and lifetimes per class" do
+			replay!
+			
+			strings = analyzer.classes["String"]
+			expect(strings.allocated).to be == 2
+			expect(strings.freed).to be == 2
+			expect(strings.retained).to be == 0
+			expect(strings.lifetimes.count).to be == 2
+			expect(strings.lifetimes.percentile(50)).to be_within(1.0).of(1.0)
+			expect(strings.lifetimes.percentile(100)).to be_within(2.0).of(3.0)
+			
+			hashes = analyzer.classes["Hash"]
+			expect(hashes.allocated).to be == 4
+			expect(hashes.retained_bytes).to be == 640
+			
+			expect(analyzer.records).to be == 7
+			expect(analyzer.duration).to be == 4.0
+		end
+		
+		it "reports the retained objects over time" do
+			replay!
+			
+			curve = analyzer.retained_curve
+			expect(curve.map{|point| point[:time]}).to be == [1.0, 2.0, 3.0, 4.0]
+			expect(curve.map{|point| point[:total]}).to be == [6, 5, 5, 4]
+			expect(curve.first[:classes]).to be == {"String" => 2, "Hash" => 4}
+		end
+		
+		it "coarsens the retained curve to the maximum number of points" do
+			analyzer = subject.new(interval: 1.0, maximum_points: 4)
+			analyzer.add(event(:newobj, 0, 0x1000), "String")
+			analyzer.add(event(:freeobj, 100, 0x1000))
+			
+			expect(analyzer.interval).to be == 32.0
+			expect(analyzer.retained_curve.map{|point| point[:time]}).to be == [32.0, 64.0, 96.0, 100.0]
+		end
+		
+		it "ranks the sites of retained objects" do
+			replay!
+			
+			sites = analyzer.leaking_sites(1)
+			expect(sites.size).to be == 1
+			expect(sites.first.name).to be == "Hash"
+			expect(sites.first.site).to be == "app.rb:12"
+			expect(sites.first.retained).to be == 4
+			expect(sites.first.age).to be == 3.5
+		end
+		
+		it "writes folded stacks" do
+			replay!
+			
+			output = StringIO.new
+			analyzer.write_folded(output, metric: :allocated)
+			
+			expect(output.string.lines).to be == ["String 2\n", "Hash;app.rb:12 4\n"]
+		end
+		
+		it "replaces separators in folded stack frames" do
+			analyzer.add(event(:newobj, 0, 0x1000, site: 1), "Struct;Point", "my app/main.rb:3")
+			
+			output = StringIO.new
+			analyzer.write_folded(output, metric: :allocated)
+			
+			expect(output.string.lines).to be == ["Struct:Point;my_app/main.rb:3 1\n"]
+		end
+	end
+	
+	it "requires a positive interval" do
+		expect{subject.new(interval: 0)}.to raise_exception(ArgumentError)
+		expect{subject.new(interval: -1.0)}.to raise_exception(ArgumentError)
+		expect{subject.new(interval: 1e-12)}.to raise_exception(ArgumentError)
+	end
+	
+	it "analyzes a recorded trace" do
+		file = Tempfile.new("trace", binmode: true)
+		capture = Memory::Profiler::Capture.new
+		capture.track(AnalyzerTestObject)
+		capture.trace = file
+		capture.start
+		
+		retained = 10.times.map{AnalyzerTestObject.new}
+		100.times{AnalyzerTestObject.new}
+		GC.start
+		
+		capture.stop
+		capture.trace = nil
+		
+		file.rewind
+		analyzer.analyze(Memory::Profiler::Trace.new(file))
+		
+		statistics = analyzer.classes["AnalyzerTestObject"]
+		expect(statistics.allocated).to be == 110
+		expect(statistics.retained).to be >= 10
+		expect(statistics.retained).to be <= 20
+		
+		report = JSON.parse(analyzer.to_json, symbolize_names: true)
+		expect(report[:classes].first[:name]).to be == "AnalyzerTestObject"
+		expect(report[:sites].first[:name]).to be == "AnalyzerTestObject"
+	ensure
+		capture&.stop
+		file&.close!
+	end
+end